@@ -0,0 +1,10 @@
+#ifdef GL_ES
+precision highp float;
+#endif
+
+uniform sampler2D al_tex;
+varying vec2 varying_texcoord;
+
+void main() {
+	gl_FragColor = texture2D(al_tex, varying_texcoord);
+}
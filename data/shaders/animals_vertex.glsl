@@ -0,0 +1,53 @@
+#ifdef GL_ES
+precision highp float;
+precision highp int;
+#endif
+
+// Places one corner of an animal sprite from the static data of its walk, see animalbuffer.c.
+
+attribute vec4 al_pos; // corner, relative to the animal
+attribute vec2 al_texcoord;
+attribute vec4 al_user_attr_0; // x0, y0, x1, y1: walking from x0, y0 to x1, y1
+attribute vec4 al_user_attr_1; // spawn, despawn (in ticks), wobble phase, angle of the path
+attribute vec2 al_user_attr_2; // wobble amplitude (0 when sitting), when it stops waiting at x0, y0
+uniform mat4 al_projview_matrix;
+uniform bool al_use_tex_matrix;
+uniform mat4 al_tex_matrix;
+uniform float time; // of the day, 0..1
+uniform int part; // DGZ_PART: 0 loops the day, 1 only shows it until midnight, 2 only after
+varying vec2 varying_texcoord;
+
+#define TICKS_PER_DAY 1440.0
+
+void main() {
+	float spawn = al_user_attr_1.x;
+	float despawn = al_user_attr_1.y;
+	float day = time;
+	float tick = floor(day * TICKS_PER_DAY);
+	if ((tick < spawn) || (tick >= despawn) || (part == 2)) {
+		// walks that started before midnight go on in the morning
+		day += 1.0;
+		tick += TICKS_PER_DAY;
+	}
+	if ((tick < spawn) || (tick >= despawn) || ((part == 1) && (day >= 1.0))) {
+		// not there; all corners end up in the same spot outside of the screen
+		gl_Position = vec4(2.0, 2.0, 2.0, 1.0);
+		varying_texcoord = vec2(0.0);
+		return;
+	}
+
+	float depart = al_user_attr_2.y;
+	float progress = max((day * TICKS_PER_DAY - depart) / (despawn - depart), 0.0);
+	vec2 position = mix(al_user_attr_0.xy, al_user_attr_0.zw, progress);
+	float angle = al_user_attr_1.w + al_user_attr_2.x * sin(day * 6000.0 + al_user_attr_1.z);
+	float c = cos(angle), s = sin(angle);
+	position += vec2(al_pos.x * c - al_pos.y * s, al_pos.x * s + al_pos.y * c);
+
+	if (al_use_tex_matrix) {
+		vec4 uv = al_tex_matrix * vec4(al_texcoord, 0, 1);
+		varying_texcoord = uv.xy;
+	} else {
+		varying_texcoord = al_texcoord;
+	}
+	gl_Position = al_projview_matrix * vec4(position, 0.0, 1.0);
+}
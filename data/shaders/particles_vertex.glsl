@@ -0,0 +1,58 @@
+#ifdef GL_ES
+precision highp float;
+precision highp int;
+#endif
+
+// Places one corner of a particle from the static data of its emitter, see emitters.c.
+
+attribute vec4 al_pos; // corner, relative to the middle of the sprite
+attribute vec2 al_texcoord; // within the frame
+attribute vec4 al_user_attr_0; // x, y, vx, vy: at x, y at the spawn time, moving by vx, vy per day
+attribute vec4 al_user_attr_1; // spawn, from, to (on the screen in between), phase
+attribute vec4 al_user_attr_2; // angle, spin, wobble, wobble speed
+attribute vec4 al_user_attr_3; // wave, wave speed, frame rate, frame offset
+attribute vec2 al_user_attr_4; // first frame, frame count
+uniform mat4 al_projview_matrix;
+uniform bool al_use_tex_matrix;
+uniform mat4 al_tex_matrix;
+uniform float time; // of the day, 0..1
+uniform vec2 frames[32]; // where every frame starts in the atlas, PARTICLE_MAX_FRAMES of them
+varying vec2 varying_texcoord;
+
+void main() {
+	float spawn = al_user_attr_1.x;
+	float from = al_user_attr_1.y;
+	float to = al_user_attr_1.z;
+	float phase = al_user_attr_1.w;
+	float day = time;
+	if (day < from) {
+		// windows that started before midnight go on in the morning
+		day += 1.0;
+	}
+	if ((day < from) || (day >= to)) {
+		// not there; all corners end up in the same spot outside of the screen
+		gl_Position = vec4(2.0, 2.0, 2.0, 1.0);
+		varying_texcoord = vec2(0.0);
+		return;
+	}
+
+	vec2 velocity = al_user_attr_0.zw;
+	vec2 position = al_user_attr_0.xy + velocity * (day - spawn);
+	float speed = length(velocity);
+	if ((al_user_attr_3.x != 0.0) && (speed > 0.0)) {
+		position += vec2(-velocity.y, velocity.x) / speed * al_user_attr_3.x * sin(al_user_attr_3.y * day + phase);
+	}
+	float angle = al_user_attr_2.x + al_user_attr_2.y * day + al_user_attr_2.z * sin(al_user_attr_2.w * day + phase);
+	float c = cos(angle), s = sin(angle);
+	position += vec2(al_pos.x * c - al_pos.y * s, al_pos.x * s + al_pos.y * c);
+
+	float frame = mod(floor(day * al_user_attr_3.z) + al_user_attr_3.w, al_user_attr_4.y);
+	vec2 texcoord = frames[int(al_user_attr_4.x + frame)] + al_texcoord;
+	if (al_use_tex_matrix) {
+		vec4 uv = al_tex_matrix * vec4(texcoord, 0, 1);
+		varying_texcoord = uv.xy;
+	} else {
+		varying_texcoord = texcoord;
+	}
+	gl_Position = al_projview_matrix * vec4(position, 0.0, 1.0);
+}
@@ -3,6 +3,9 @@ precision highp float;
 precision highp int;
 #endif
 
+// One of VHS_FULL, VHS_LIGHT or VHS_PASSTHROUGH gets defined by the game before compiling.
+// VHS_LIGHT drops the grain and color bleed, which are invisible when fade is 0.
+
 uniform sampler2D al_tex;
 varying vec2 varying_texcoord;
 varying vec4 varying_color;
@@ -25,6 +28,14 @@ uniform vec4 colorBleedC;
 uniform vec4 colorBleedR;
 uniform float TIME;
 uniform vec2 RENDERSIZE;
+uniform vec2 texturePadding;
+uniform vec2 sceneRange; // the columns of the scene that were drawn, as texture coordinates
+uniform sampler2D noiseTex;
+
+// these only depend on TIME, so they're computed once per frame on the CPU
+uniform float actualXLine;
+uniform float actualXLineWidth;
+uniform float actualYLine;
 
 //  Based on https://www.interactiveshaderformat.com/sketches/871
 //	which was based on https://github.com/staffantan/unity-vhsglitch
@@ -33,33 +44,37 @@ uniform vec2 RENDERSIZE;
 const float tau = 6.28318530718;
 
 vec4 texture2DNorm(sampler2D tex, vec2 pos) {
-	// FIXME: it's needed, but no idea why
+	// textures get padded to power-of-two sizes there
 #ifdef GL_ES
-	pos.x /= 1.065;
-	pos.y /= 1.895;
+	pos /= texturePadding;
 #endif
 	return texture2D(tex, pos);
 }
 
 float rand(vec3 co){
-	return abs(mod(sin( dot(co.xyz ,vec3(12.9898,78.233,45.5432) )) * 43758.5453, 1.0));
+	// white noise from a precomputed 256x256 texture instead of a per-pixel hash
+	return texture2D(noiseTex, fract(co.xy * vec2(3.71, 2.13) + co.z * 1.618)).r;
+}
+
+#ifdef VHS_PASSTHROUGH
+
+void main() {
+	vec4 c = texture2D(al_tex, varying_texcoord);
+	c.rgb *= c.a;
+	c.a = 1.0;
+	gl_FragColor = c;
 }
 
+#else
+
 void main()	{
-	float	actualXLine = (!autoScan) ? xScanline : mod(xScanline + ((1.0+sin(0.34*TIME))/2.0 + (1.0+sin(TIME))/3.0 + (1.0+cos(2.1*TIME))/3.0 + (1.0+cos(0.027*TIME))/2.0)/3.5,1.0);
-	float	actualXLineWidth = (!autoScan) ? xScanlineSize : 2.0 * xScanlineSize * ((1.0+sin(1.2*TIME))/2.0 + (1.0+cos(3.91*TIME))/3.0 + (1.0+cos(0.014*TIME))/2.0)/3.5;
 	vec2 loc = varying_texcoord;
 #ifdef GL_ES
-	// FIXME: it's needed, but no idea why
-	loc.x *= 1.065;
-	loc.y *= 1.895;
+	loc *= texturePadding;
 #endif
 	float	dx = 1.0+actualXLineWidth/25.0-abs(distance(loc.y, actualXLine));
 	float	dx2 = 1.0+xScanlineSize2/10.0-abs(distance(loc.y, xScanline2));
-	float	dy = (1.0-abs(distance(loc.y, yScanline)));
-	if (autoScan) {
-		dy = (1.0-abs(distance(loc.y, mod(yScanline+TIME,1.0))));
-	}
+	float	dy = (1.0-abs(distance(loc.y, actualYLine)));
 
 	dy = (dy > 0.5) ? 2.0 * dy : 2.0 * (1.0 - dy);
 
@@ -77,10 +92,12 @@ void main()	{
 		loc.y = actualXLine;
 	}
 
-	loc.x = mod(loc.x,1.0);
+	loc.x = clamp(loc.x, sceneRange.x, sceneRange.y);
 	loc.y = mod(loc.y,1.0);
 
 	vec4	c = texture2DNorm(al_tex, loc);
+
+#ifdef VHS_FULL
 	float	x = (loc.x*320.0)/320.0;
 	float	y = (loc.y*240.0)/240.0;
 	float	bleed = 0.0;
@@ -110,8 +127,11 @@ void main()	{
 		c += (bleed * max(xScanlineSize,xTime) * colorBleed) * scanFollowAmount;
 		c += (bleed * colorBleed) * (1.0 - scanFollowAmount);
 	}
+#endif
 
 	c.rgb *= c.a;
 	c.a = 1.0;
 	gl_FragColor = c;
 }
+
+#endif
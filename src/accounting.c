@@ -0,0 +1,225 @@
+/*! \file accounting.c
+ *  \brief Bookkeeping of memory held by bitmaps, fonts, samples and streams.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "common.h"
+#include <libsuperderpy.h>
+
+static const char* categoryNames[RESOURCE_CATEGORIES] = {"bitmaps", "targets", "fonts", "samples", "streams"};
+
+static bool IsVideoCategory(enum RESOURCE_CATEGORY category) {
+	return (category == RESOURCE_BITMAP) || (category == RESOURCE_TARGET) || (category == RESOURCE_FONT);
+}
+
+static struct ResourceAccounting* GetAccounting(struct Game* game) {
+	if (!game->data) {
+		return NULL;
+	}
+	return &game->data->accounting;
+}
+
+static double MiB(size_t bytes) {
+	return bytes / (1024.0 * 1024.0);
+}
+
+void InitResourceAccounting(struct Game* game, struct ResourceAccounting* acc) {
+	acc->allocated = 64;
+	acc->count = 0;
+	acc->entries = calloc(acc->allocated, sizeof(struct TrackedResource));
+	acc->budget = strtoul(GetConfigOptionDefault(game, "nowandthen", "vram_budget", "0"), NULL, 10) * 1024 * 1024;
+	if (acc->budget) {
+		PrintConsole(game, "Video memory budget: %.1f MiB", MiB(acc->budget));
+	}
+}
+
+void DestroyResourceAccounting(struct Game* game, struct ResourceAccounting* acc) {
+	ReportResourceLeaks(game, NULL);
+	PrintConsole(game, "Video memory peak: %.1f MiB", MiB(acc->peak));
+	free(acc->entries);
+}
+
+static void Track(struct Game* game, const char* owner, void* ptr, enum RESOURCE_CATEGORY category, size_t bytes) {
+	struct ResourceAccounting* acc = GetAccounting(game);
+	if (!acc || !ptr) {
+		return;
+	}
+	if (acc->count == acc->allocated) {
+		acc->allocated *= 2;
+		acc->entries = realloc(acc->entries, acc->allocated * sizeof(struct TrackedResource));
+	}
+	struct TrackedResource* entry = &acc->entries[acc->count++];
+	*entry = (struct TrackedResource){.ptr = ptr, .category = category, .bytes = bytes};
+	snprintf(entry->owner, sizeof(entry->owner), "%s", owner);
+	acc->total[category] += bytes;
+
+	size_t video = acc->total[RESOURCE_BITMAP] + acc->total[RESOURCE_TARGET] + acc->total[RESOURCE_FONT];
+	if (video > acc->peak) {
+		acc->peak = video;
+	}
+	if (acc->budget && IsVideoCategory(category)) {
+		if ((video > acc->budget) && !acc->overBudget) {
+			PrintConsole(game, "WARNING: video memory budget exceeded by %s: %.1f of %.1f MiB", owner, MiB(video), MiB(acc->budget));
+		}
+		acc->overBudget = video > acc->budget;
+	}
+}
+
+void UntrackResource(struct Game* game, void* ptr) {
+	struct ResourceAccounting* acc = GetAccounting(game);
+	if (!acc || !ptr) {
+		return;
+	}
+	for (unsigned int i = 0; i < acc->count; i++) {
+		if (acc->entries[i].ptr == ptr) {
+			acc->total[acc->entries[i].category] -= acc->entries[i].bytes;
+			acc->entries[i] = acc->entries[--acc->count];
+			break;
+		}
+	}
+	size_t video = acc->total[RESOURCE_BITMAP] + acc->total[RESOURCE_TARGET] + acc->total[RESOURCE_FONT];
+	acc->overBudget = acc->budget && (video > acc->budget);
+}
+
+ALLEGRO_BITMAP* TrackBitmap(struct Game* game, const char* owner, ALLEGRO_BITMAP* bitmap) {
+	if (!bitmap || al_is_sub_bitmap(bitmap)) {
+		// sub-bitmaps share memory with their parent
+		return bitmap;
+	}
+	size_t bytes = (size_t)al_get_bitmap_width(bitmap) * al_get_bitmap_height(bitmap) * al_get_pixel_size(al_get_bitmap_format(bitmap));
+	int flags = al_get_bitmap_flags(bitmap);
+	if (flags & ALLEGRO_MIPMAP) {
+		bytes = bytes * 4 / 3;
+	}
+	Track(game, owner, bitmap, (flags & ALLEGRO_NO_PRESERVE_TEXTURE) ? RESOURCE_TARGET : RESOURCE_BITMAP, bytes);
+	return bitmap;
+}
+
+ALLEGRO_FONT* TrackFont(struct Game* game, const char* owner, ALLEGRO_FONT* font) {
+	if (!font) {
+		return font;
+	}
+	// Glyphs are rendered lazily into 256x256 cache pages, so there's no way to ask for the real size.
+	// Estimate it as if the printable ASCII range was cached.
+	size_t height = al_get_font_line_height(font);
+	size_t pages = (height * height * 95 + 256 * 256 - 1) / (256 * 256);
+	Track(game, owner, font, RESOURCE_FONT, pages * 256 * 256 * 4);
+	return font;
+}
+
+ALLEGRO_SAMPLE* TrackSample(struct Game* game, const char* owner, ALLEGRO_SAMPLE* sample) {
+	if (!sample) {
+		return sample;
+	}
+	Track(game, owner, sample, RESOURCE_SAMPLE, (size_t)al_get_sample_length(sample) * al_get_channel_count(al_get_sample_channels(sample)) * al_get_audio_depth_size(al_get_sample_depth(sample)));
+	return sample;
+}
+
+ALLEGRO_AUDIO_STREAM* TrackAudioStream(struct Game* game, const char* owner, ALLEGRO_AUDIO_STREAM* stream) {
+	if (!stream) {
+		return stream;
+	}
+	Track(game, owner, stream, RESOURCE_STREAM, (size_t)al_get_audio_stream_fragments(stream) * al_get_audio_stream_length(stream) * al_get_channel_count(al_get_audio_stream_channels(stream)) * al_get_audio_depth_size(al_get_audio_stream_depth(stream)));
+	return stream;
+}
+
+void DestroyTrackedBitmap(struct Game* game, ALLEGRO_BITMAP* bitmap) {
+	UntrackResource(game, bitmap);
+	al_destroy_bitmap(bitmap);
+}
+
+void DestroyTrackedFont(struct Game* game, ALLEGRO_FONT* font) {
+	UntrackResource(game, font);
+	al_destroy_font(font);
+}
+
+void DestroyTrackedSample(struct Game* game, ALLEGRO_SAMPLE* sample) {
+	UntrackResource(game, sample);
+	al_destroy_sample(sample);
+}
+
+void DestroyTrackedAudioStream(struct Game* game, ALLEGRO_AUDIO_STREAM* stream) {
+	UntrackResource(game, stream);
+	al_destroy_audio_stream(stream);
+}
+
+size_t GetTrackedBytes(struct Game* game, const char* owner, enum RESOURCE_CATEGORY category) {
+	struct ResourceAccounting* acc = GetAccounting(game);
+	if (!acc) {
+		return 0;
+	}
+	if (!owner) {
+		return acc->total[category];
+	}
+	size_t bytes = 0;
+	for (unsigned int i = 0; i < acc->count; i++) {
+		if ((acc->entries[i].category == category) && (strcmp(acc->entries[i].owner, owner) == 0)) {
+			bytes += acc->entries[i].bytes;
+		}
+	}
+	return bytes;
+}
+
+size_t GetTrackedVideoBytes(struct Game* game, const char* owner) {
+	return GetTrackedBytes(game, owner, RESOURCE_BITMAP) + GetTrackedBytes(game, owner, RESOURCE_TARGET) + GetTrackedBytes(game, owner, RESOURCE_FONT);
+}
+
+void PrintResourceReport(struct Game* game, const char* owner) {
+	struct ResourceAccounting* acc = GetAccounting(game);
+	if (!acc) {
+		return;
+	}
+	PrintConsole(game, "Resources held by %s:", owner ? owner : "all gamestates");
+	for (int i = 0; i < RESOURCE_CATEGORIES; i++) {
+		PrintConsole(game, "  %-8s %8.2f MiB%s", categoryNames[i], MiB(GetTrackedBytes(game, owner, i)), (i == RESOURCE_FONT) ? " (estimated)" : "");
+	}
+	size_t video = GetTrackedVideoBytes(game, owner);
+	if (acc->budget) {
+		PrintConsole(game, "  video    %8.2f MiB of %.2f MiB budget", MiB(video), MiB(acc->budget));
+	} else {
+		PrintConsole(game, "  video    %8.2f MiB", MiB(video));
+	}
+}
+
+void ReportResourceLeaks(struct Game* game, const char* owner) {
+	struct ResourceAccounting* acc = GetAccounting(game);
+	if (!acc) {
+		return;
+	}
+	for (unsigned int i = 0; i < acc->count; i++) {
+		if (!owner || (strcmp(acc->entries[i].owner, owner) == 0)) {
+			PrintConsole(game, "WARNING: %s still holds %s %p (%.2f MiB)", acc->entries[i].owner, categoryNames[acc->entries[i].category], acc->entries[i].ptr, MiB(acc->entries[i].bytes));
+		}
+	}
+}
+
+void DrawResourceOverlay(struct Game* game, float x, float y) {
+	struct ResourceAccounting* acc = GetAccounting(game);
+	if (!acc || !acc->overlay) {
+		return;
+	}
+	ALLEGRO_FONT* font = game->_priv.font_console;
+	int height = al_get_font_line_height(font);
+	al_draw_filled_rectangle(x, y, x + 320, y + height * (RESOURCE_CATEGORIES + 1) + 8, al_map_rgba(0, 0, 0, 160));
+	for (int i = 0; i < RESOURCE_CATEGORIES; i++) {
+		al_draw_textf(font, al_map_rgb(255, 255, 255), x + 4, y + 4 + height * i, ALLEGRO_ALIGN_LEFT, "%-8s %8.2f MiB", categoryNames[i], MiB(acc->total[i]));
+	}
+	size_t video = acc->total[RESOURCE_BITMAP] + acc->total[RESOURCE_TARGET] + acc->total[RESOURCE_FONT];
+	al_draw_textf(font, acc->overBudget ? al_map_rgb(255, 64, 64) : al_map_rgb(255, 255, 255), x + 4, y + 4 + height * RESOURCE_CATEGORIES, ALLEGRO_ALIGN_LEFT,
+	  "video    %8.2f MiB (peak %.2f)", MiB(video), MiB(acc->peak));
+}
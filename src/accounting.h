@@ -0,0 +1,76 @@
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef ACCOUNTING_H
+#define ACCOUNTING_H
+
+#include <libsuperderpy.h>
+
+enum RESOURCE_CATEGORY {
+	RESOURCE_BITMAP,
+	RESOURCE_TARGET, // not preserved bitmaps used as render targets
+	RESOURCE_FONT,
+	RESOURCE_SAMPLE,
+	RESOURCE_STREAM,
+	RESOURCE_CATEGORIES
+};
+
+#define RESOURCE_OWNER_LENGTH 32
+
+struct TrackedResource {
+	void* ptr;
+	char owner[RESOURCE_OWNER_LENGTH]; // a copy, as the leaks get reported after the gamestates are unloaded
+	enum RESOURCE_CATEGORY category;
+	size_t bytes;
+};
+
+struct ResourceAccounting {
+	struct TrackedResource* entries;
+	unsigned int count;
+	unsigned int allocated;
+
+	size_t total[RESOURCE_CATEGORIES];
+	size_t peak; // of video memory (bitmaps, targets and fonts)
+	size_t budget; // 0 when disabled
+	bool overBudget;
+	bool overlay;
+};
+
+void InitResourceAccounting(struct Game* game, struct ResourceAccounting* acc);
+void DestroyResourceAccounting(struct Game* game, struct ResourceAccounting* acc);
+
+// Every Track* function returns its argument, so it can wrap the allocation directly.
+ALLEGRO_BITMAP* TrackBitmap(struct Game* game, const char* owner, ALLEGRO_BITMAP* bitmap);
+ALLEGRO_FONT* TrackFont(struct Game* game, const char* owner, ALLEGRO_FONT* font);
+ALLEGRO_SAMPLE* TrackSample(struct Game* game, const char* owner, ALLEGRO_SAMPLE* sample);
+ALLEGRO_AUDIO_STREAM* TrackAudioStream(struct Game* game, const char* owner, ALLEGRO_AUDIO_STREAM* stream);
+void UntrackResource(struct Game* game, void* ptr);
+
+void DestroyTrackedBitmap(struct Game* game, ALLEGRO_BITMAP* bitmap);
+void DestroyTrackedFont(struct Game* game, ALLEGRO_FONT* font);
+void DestroyTrackedSample(struct Game* game, ALLEGRO_SAMPLE* sample);
+void DestroyTrackedAudioStream(struct Game* game, ALLEGRO_AUDIO_STREAM* stream);
+
+size_t GetTrackedBytes(struct Game* game, const char* owner, enum RESOURCE_CATEGORY category);
+size_t GetTrackedVideoBytes(struct Game* game, const char* owner);
+
+// Pass NULL as owner to report on everything that is currently tracked.
+void PrintResourceReport(struct Game* game, const char* owner);
+void ReportResourceLeaks(struct Game* game, const char* owner);
+void DrawResourceOverlay(struct Game* game, float x, float y);
+
+#endif
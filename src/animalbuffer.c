@@ -0,0 +1,253 @@
+/*! \file animalbuffer.c
+ *  \brief Draws all the visible animals of a DGZ day in one go.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "common.h"
+#include "animalbuffer.h"
+#include <libsuperderpy.h>
+#include <stddef.h>
+#include <string.h>
+
+#define RESOURCE_OWNER "animals"
+#define ATLAS_PADDING 2
+
+struct AnimalVertex {
+	float x, y; // corner, relative to where the animal is
+	float u, v; // in the atlas, in pixels
+	float x0, y0, x1, y1; // walking from x0, y0 to x1, y1
+	float spawn, despawn, phase, angle;
+	float wobble, depart;
+};
+
+static ALLEGRO_SHADER* CreateAnimalShader(struct Game* game) {
+	ALLEGRO_SHADER* shader = al_create_shader(ALLEGRO_SHADER_GLSL);
+	if (!shader) {
+		return NULL;
+	}
+	bool ok = al_attach_shader_source_file(shader, ALLEGRO_VERTEX_SHADER, GetDataFilePath(game, "shaders/animals_vertex.glsl")) &&
+		al_attach_shader_source_file(shader, ALLEGRO_PIXEL_SHADER, GetDataFilePath(game, "shaders/animals.glsl")) &&
+		al_build_shader(shader);
+	const char* log = al_get_shader_log(shader);
+	if (log && log[0]) {
+		PrintConsole(game, "%s", log);
+	}
+	if (!ok) {
+		al_destroy_shader(shader);
+		return NULL;
+	}
+	return shader;
+}
+
+static void CreateAtlas(struct Game* game, struct AnimalBuffer* buffer) {
+	int width = 0, height = 0;
+	for (int i = 0; i < ANIMAL_TYPES; i++) {
+		for (int j = 0; j < 2; j++) {
+			buffer->atlasX[i][j] = width;
+			width += al_get_bitmap_width(buffer->sprites[i][j]) + ATLAS_PADDING;
+			if (al_get_bitmap_height(buffer->sprites[i][j]) > height) {
+				height = al_get_bitmap_height(buffer->sprites[i][j]);
+			}
+		}
+	}
+	buffer->atlas = TrackBitmap(game, RESOURCE_OWNER, al_create_bitmap(width, height));
+
+	ALLEGRO_STATE state;
+	al_store_state(&state, ALLEGRO_STATE_TARGET_BITMAP | ALLEGRO_STATE_BLENDER);
+	al_set_target_bitmap(buffer->atlas);
+	al_clear_to_color(al_map_rgba(0, 0, 0, 0));
+	al_set_blender(ALLEGRO_ADD, ALLEGRO_ONE, ALLEGRO_ZERO); // copy, it's premultiplied already
+	for (int i = 0; i < ANIMAL_TYPES; i++) {
+		for (int j = 0; j < 2; j++) {
+			al_draw_bitmap(buffer->sprites[i][j], buffer->atlasX[i][j], 0, 0);
+		}
+	}
+	al_restore_state(&state);
+}
+
+struct AnimalBuffer* CreateAnimalBuffer(struct Game* game, const struct AnimalSprites* sprites) {
+	ALLEGRO_SHADER* shader = CreateAnimalShader(game);
+	if (!shader) {
+		PrintConsole(game, "Animal shader unavailable, drawing animals one by one");
+		return NULL;
+	}
+	struct AnimalBuffer* buffer = calloc(1, sizeof(struct AnimalBuffer));
+	buffer->shader = shader;
+	for (int i = 0; i < ANIMAL_TYPES; i++) {
+		buffer->sprites[i][0] = sprites->walking[i];
+		buffer->sprites[i][1] = sprites->sitting[i];
+	}
+	CreateAtlas(game, buffer);
+
+	ALLEGRO_VERTEX_ELEMENT elements[] = {
+		{ALLEGRO_PRIM_POSITION, ALLEGRO_PRIM_FLOAT_2, offsetof(struct AnimalVertex, x)},
+		{ALLEGRO_PRIM_TEX_COORD_PIXEL, ALLEGRO_PRIM_FLOAT_2, offsetof(struct AnimalVertex, u)},
+		{ALLEGRO_PRIM_USER_ATTR, ALLEGRO_PRIM_FLOAT_4, offsetof(struct AnimalVertex, x0)},
+		{ALLEGRO_PRIM_USER_ATTR + 1, ALLEGRO_PRIM_FLOAT_4, offsetof(struct AnimalVertex, spawn)},
+		{ALLEGRO_PRIM_USER_ATTR + 2, ALLEGRO_PRIM_FLOAT_2, offsetof(struct AnimalVertex, wobble)},
+		{0, 0, 0},
+	};
+	buffer->decl = al_create_vertex_decl(elements, sizeof(struct AnimalVertex));
+	return buffer;
+}
+
+static void DestroyBuffers(struct AnimalDayBuffer* slot) {
+	if (slot->vertices) {
+		al_destroy_vertex_buffer(slot->vertices);
+	}
+	if (slot->indices) {
+		al_destroy_index_buffer(slot->indices);
+	}
+	*slot = (struct AnimalDayBuffer){0};
+}
+
+void DestroyAnimalBuffer(struct Game* game, struct AnimalBuffer* buffer) {
+	for (int i = 0; i < ANIMAL_BUFFER_DAYS; i++) {
+		DestroyBuffers(&buffer->days[i]);
+	}
+	al_destroy_vertex_decl(buffer->decl);
+	DestroyTrackedBitmap(game, buffer->atlas);
+	al_destroy_shader(buffer->shader);
+	free(buffer);
+}
+
+static void FillQuad(const struct AnimalBuffer* buffer, const struct DgzDay* day, const struct Segment* segment, struct AnimalVertex* quad) {
+	const struct Animal* animal = &day->animals[segment->walk];
+	bool walking = animal->state == ANIMAL_WALKING;
+	ALLEGRO_BITMAP* bitmap = buffer->sprites[animal->type][walking ? 0 : 1];
+	int width = al_get_bitmap_width(bitmap), height = al_get_bitmap_height(bitmap);
+	float left, top;
+	bool flip;
+	if (walking) {
+		// the same pivot the animals get when drawn one by one
+		left = -(width / 2);
+		top = -height * 0.75;
+		flip = animal->reverse;
+	} else {
+		left = segment->sitX;
+		top = segment->sitY;
+		flip = animal->state == ANIMAL_BENCH_RIGHT;
+	}
+	float u = buffer->atlasX[animal->type][walking ? 0 : 1];
+	for (int i = 0; i < 4; i++) {
+		bool right = (i == 1) || (i == 2);
+		bool bottom = i >= 2;
+		quad[i] = (struct AnimalVertex){
+			.x = left + (right ? width : 0),
+			.y = top + (bottom ? height : 0),
+			.u = u + ((right != flip) ? width : 0),
+			.v = bottom ? height : 0,
+			.x0 = segment->x0,
+			.y0 = segment->y0,
+			.x1 = segment->x1,
+			.y1 = segment->y1,
+			.spawn = segment->spawn,
+			.despawn = segment->despawn,
+			.phase = segment->id,
+			.angle = segment->angle,
+			.wobble = segment->wobble,
+			.depart = segment->depart,
+		};
+	}
+}
+
+static struct AnimalDayBuffer* FindDay(struct AnimalBuffer* buffer, const struct DgzDay* day) {
+	for (int i = 0; i < ANIMAL_BUFFER_DAYS; i++) {
+		if (buffer->days[i].day == day) {
+			return &buffer->days[i];
+		}
+	}
+	return NULL;
+}
+
+bool HasAnimals(struct AnimalBuffer* buffer, const struct DgzDay* day) {
+	return day && FindDay(buffer, day);
+}
+
+void ForgetAnimals(struct AnimalBuffer* buffer, const struct DgzDay* day) {
+	struct AnimalDayBuffer* slot = FindDay(buffer, day);
+	if (day && slot) {
+		DestroyBuffers(slot);
+	}
+}
+
+bool UploadAnimals(struct Game* game, struct AnimalBuffer* buffer, const struct DgzDay* day) {
+	if (HasAnimals(buffer, day)) {
+		return true;
+	}
+	struct AnimalDayBuffer* slot = FindDay(buffer, NULL);
+	if (!slot) {
+		PrintConsole(game, "No room for another day of animals");
+		return false;
+	}
+	slot->day = day;
+	memcpy(slot->offsets, day->offsets, sizeof(slot->offsets));
+	unsigned int quads = day->offsets[DGZ_BUCKETS];
+	for (int b = 0; b < DGZ_BUCKETS; b++) {
+		slot->split[b] = slot->offsets[b + 1];
+		for (unsigned int q = slot->offsets[b]; q < slot->offsets[b + 1]; q++) {
+			if (day->animals[day->segments[day->visible[q]].walk].path->zIndex >= 0) {
+				slot->split[b] = q;
+				break;
+			}
+		}
+	}
+	if (!quads) {
+		return true;
+	}
+
+	// walks visible in more than one bucket get a quad in each, so every bucket is a single range
+	struct AnimalVertex* vertices = malloc(quads * 4 * sizeof(struct AnimalVertex));
+	uint32_t* indices = malloc(quads * 6 * sizeof(uint32_t));
+	static const int corners[6] = {0, 1, 2, 0, 2, 3};
+	for (unsigned int q = 0; q < quads; q++) {
+		FillQuad(buffer, day, &day->segments[day->visible[q]], &vertices[q * 4]);
+		for (int i = 0; i < 6; i++) {
+			indices[q * 6 + i] = q * 4 + corners[i];
+		}
+	}
+	slot->vertices = al_create_vertex_buffer(buffer->decl, vertices, quads * 4, ALLEGRO_PRIM_BUFFER_STATIC);
+	slot->indices = al_create_index_buffer(sizeof(uint32_t), indices, quads * 6, ALLEGRO_PRIM_BUFFER_STATIC);
+	free(vertices);
+	free(indices);
+	if (!slot->vertices || !slot->indices) {
+		PrintConsole(game, "Can't upload %u animal quads", quads);
+		DestroyBuffers(slot);
+		return false;
+	}
+	return true;
+}
+
+unsigned int DrawAnimals(struct AnimalBuffer* buffer, const struct DgzDay* day, double time, enum DGZ_PART part, bool front) {
+	const struct AnimalDayBuffer* slot = day ? FindDay(buffer, day) : NULL;
+	if (!slot || !slot->vertices) {
+		return 0;
+	}
+	int bucket = DgzBucket(time);
+	unsigned int start = front ? slot->split[bucket] : slot->offsets[bucket];
+	unsigned int end = front ? slot->offsets[bucket + 1] : slot->split[bucket];
+	if (start == end) {
+		return 0;
+	}
+	al_use_shader(buffer->shader);
+	al_set_shader_float("time", time);
+	al_set_shader_int("part", part);
+	al_draw_indexed_buffer(slot->vertices, buffer->atlas, slot->indices, start * 6, end * 6, ALLEGRO_PRIM_TRIANGLE_LIST);
+	al_use_shader(NULL);
+	return end - start;
+}
@@ -0,0 +1,70 @@
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef ANIMALBUFFER_H
+#define ANIMALBUFFER_H
+
+#include "dgz.h"
+#include <allegro5/allegro_primitives.h>
+#include <libsuperderpy.h>
+
+struct AnimalSprites {
+	ALLEGRO_BITMAP* walking[ANIMAL_TYPES];
+	ALLEGRO_BITMAP* sitting[ANIMAL_TYPES];
+};
+
+// The current day and the one before it for up to four views.
+#define ANIMAL_BUFFER_DAYS 8
+
+// One indexed DGZ day in a static vertex buffer.
+struct AnimalDayBuffer {
+	const struct DgzDay* day; // NULL when the slot is free
+	ALLEGRO_VERTEX_BUFFER* vertices;
+	ALLEGRO_INDEX_BUFFER* indices;
+	// in quads, laid out like the day's index; the ones before split are behind the foreground
+	unsigned int offsets[DGZ_BUCKETS + 1];
+	unsigned int split[DGZ_BUCKETS];
+};
+
+// Whole DGZ days in static vertex buffers. The vertex shader works out which animals are visible
+// and where from the time alone, so drawing them costs the CPU the same no matter how crowded
+// the park is.
+struct AnimalBuffer {
+	ALLEGRO_SHADER* shader;
+	ALLEGRO_BITMAP* atlas;
+	int atlasX[ANIMAL_TYPES][2]; // walking and sitting sprite
+	ALLEGRO_BITMAP* sprites[ANIMAL_TYPES][2];
+
+	ALLEGRO_VERTEX_DECL* decl;
+	struct AnimalDayBuffer days[ANIMAL_BUFFER_DAYS];
+};
+
+// Returns NULL when the shader can't be built; animals have to be drawn one by one then.
+struct AnimalBuffer* CreateAnimalBuffer(struct Game* game, const struct AnimalSprites* sprites);
+void DestroyAnimalBuffer(struct Game* game, struct AnimalBuffer* buffer);
+// Uploads the day, which has to be indexed, unless it's there already. Fails when all the slots are
+// taken or the buffers can't be created; nothing of the day gets drawn then.
+bool UploadAnimals(struct Game* game, struct AnimalBuffer* buffer, const struct DgzDay* day);
+// Frees the upload of a day before the day itself goes away.
+void ForgetAnimals(struct AnimalBuffer* buffer, const struct DgzDay* day);
+bool HasAnimals(struct AnimalBuffer* buffer, const struct DgzDay* day);
+// Draws the part of the day's animals behind or in front of the foreground at time (0..1) and
+// returns how many quads were submitted.
+unsigned int DrawAnimals(struct AnimalBuffer* buffer, const struct DgzDay* day, double time, enum DGZ_PART part, bool front);
+
+#endif
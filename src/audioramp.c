@@ -0,0 +1,184 @@
+/*! \file audioramp.c
+ *  \brief Gain ramps handed over to the mixer thread without locking.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "common.h"
+#include "audioramp.h"
+#include <libsuperderpy.h>
+
+static void ApplyGain(void* buf, unsigned int samples, void* userdata) {
+	struct AudioRamp* ramp = userdata;
+	float* data = buf;
+
+	unsigned int tail = atomic_load_explicit(&ramp->tail, memory_order_relaxed);
+	unsigned int head = atomic_load_explicit(&ramp->head, memory_order_acquire);
+	if (tail != head) {
+		// only the newest update matters; its ramp starts wherever the current one got to
+		struct AudioRampUpdate update = ramp->queue[(head - 1) % AUDIO_RAMP_QUEUE];
+		atomic_store_explicit(&ramp->tail, head, memory_order_release);
+		if (update.gain != ramp->target) {
+			ramp->target = update.gain;
+			ramp->remaining = update.frames;
+			if (update.frames) {
+				ramp->step = (ramp->target - ramp->gain) / update.frames;
+			} else {
+				ramp->gain = ramp->target;
+			}
+		}
+	}
+
+	unsigned int i = 0;
+	for (; (i < samples) && ramp->remaining; i++) {
+		ramp->gain += ramp->step;
+		if (!--ramp->remaining) {
+			ramp->gain = ramp->target;
+		}
+		data[i * 2] *= ramp->gain;
+		data[i * 2 + 1] *= ramp->gain;
+	}
+
+	if (ramp->gain == 0.0) {
+		memset(data + i * 2, 0, (samples - i) * 2 * sizeof(float));
+	} else if (ramp->gain != 1.0) {
+		for (; i < samples; i++) {
+			data[i * 2] *= ramp->gain;
+			data[i * 2 + 1] *= ramp->gain;
+		}
+	}
+}
+
+struct AudioRamp* CreateAudioRamp(struct Game* game, ALLEGRO_AUDIO_STREAM* stream, ALLEGRO_MIXER* parent, float gain) {
+	struct AudioRamp* ramp = calloc(1, sizeof(struct AudioRamp));
+	ramp->stream = stream;
+	ramp->frequency = al_get_mixer_frequency(parent);
+	ramp->gain = gain;
+	ramp->target = gain;
+	ramp->lastGain = gain;
+	ramp->lastSpeed = al_get_audio_stream_speed(stream);
+	ramp->threshold = strtod(GetConfigOptionDefault(game, "nowandthen", "virtual_voice_threshold", "0.001"), NULL);
+	ramp->length = al_get_audio_stream_length_secs(stream);
+	atomic_init(&ramp->head, 0);
+	atomic_init(&ramp->tail, 0);
+
+	// the callback assumes interleaved stereo floats
+	ramp->mixer = al_create_mixer(ramp->frequency, ALLEGRO_AUDIO_DEPTH_FLOAT32, ALLEGRO_CHANNEL_CONF_2);
+	al_set_mixer_postprocess_callback(ramp->mixer, ApplyGain, ramp);
+	al_set_audio_stream_gain(stream, 1.0);
+	al_attach_audio_stream_to_mixer(stream, ramp->mixer);
+	al_attach_mixer_to_mixer(ramp->mixer, parent);
+	return ramp;
+}
+
+void DestroyAudioRamp(struct AudioRamp* ramp) {
+	al_detach_mixer(ramp->mixer);
+	al_detach_audio_stream(ramp->stream);
+	al_destroy_mixer(ramp->mixer);
+	free(ramp);
+}
+
+void RampAudioGain(struct AudioRamp* ramp, float gain, double seconds) {
+	if (gain == ramp->lastGain) {
+		return;
+	}
+	unsigned int head = atomic_load_explicit(&ramp->head, memory_order_relaxed);
+	unsigned int tail = atomic_load_explicit(&ramp->tail, memory_order_acquire);
+	if (head - tail >= AUDIO_RAMP_QUEUE) {
+		// the mixer isn't running; lastGain stays unchanged so the next call retries
+		ramp->dropped++;
+		return;
+	}
+	ramp->queue[head % AUDIO_RAMP_QUEUE] = (struct AudioRampUpdate){.gain = gain, .frames = seconds * ramp->frequency};
+	atomic_store_explicit(&ramp->head, head + 1, memory_order_release);
+	ramp->lastGain = gain;
+	ramp->rampTime = seconds;
+	ramp->pushed++;
+}
+
+void SetAudioSpeed(struct AudioRamp* ramp, float speed) {
+	if (speed == ramp->lastSpeed) {
+		return;
+	}
+	al_set_audio_stream_speed(ramp->stream, speed);
+	ramp->lastSpeed = speed;
+	ramp->locks++;
+}
+
+void UpdateAudioVoice(struct AudioRamp* ramp, double dt) {
+	if (ramp->virtualized) {
+		ramp->virtualTime += dt;
+		ramp->position += dt * ramp->lastSpeed;
+		if (ramp->length > 0) {
+			ramp->position = fmod(ramp->position, ramp->length);
+		}
+		if (ramp->lastGain >= ramp->threshold) {
+			// the gain ramp starts from silence, so there's no click when it comes back
+			al_seek_audio_stream_secs(ramp->stream, ramp->position);
+			al_set_audio_stream_playing(ramp->stream, true);
+			ramp->virtualized = false;
+			ramp->silentTime = 0;
+			ramp->locks += 2;
+		}
+		return;
+	}
+
+	ramp->audibleTime += dt;
+	if (ramp->lastGain >= ramp->threshold) {
+		ramp->silentTime = 0;
+		return;
+	}
+	ramp->silentTime += dt;
+	// wait for the mixer to finish fading out first
+	if (ramp->silentTime > ramp->rampTime) {
+		ramp->position = al_get_audio_stream_position_secs(ramp->stream);
+		al_set_audio_stream_playing(ramp->stream, false);
+		ramp->virtualized = true;
+		ramp->virtualizations++;
+		ramp->locks += 2;
+	}
+}
+
+void PrintAudioRampStats(struct Game* game, struct AudioRamp* ramps[], int count, double seconds) {
+	unsigned int locks = 0, pushed = 0, dropped = 0;
+	for (int i = 0; i < count; i++) {
+		locks += ramps[i]->locks;
+		pushed += ramps[i]->pushed;
+		dropped += ramps[i]->dropped;
+		ramps[i]->locks = ramps[i]->pushed = ramps[i]->dropped = 0;
+	}
+	if (seconds <= 0) {
+		return;
+	}
+	PrintConsole(game, "Audio: %.1f mixer locks/s, %.1f gain updates/s, %d dropped", locks / seconds, pushed / seconds, dropped);
+}
+
+void PrintAudioVoiceStats(struct Game* game, struct AudioRamp* ramps[], int count) {
+	double audible = 0, virtualized = 0;
+	unsigned int virtualizations = 0;
+	for (int i = 0; i < count; i++) {
+		audible += ramps[i]->audibleTime;
+		virtualized += ramps[i]->virtualTime;
+		virtualizations += ramps[i]->virtualizations;
+		ramps[i]->audibleTime = ramps[i]->virtualTime = 0;
+		ramps[i]->virtualizations = 0;
+	}
+	if (audible + virtualized <= 0) {
+		return;
+	}
+	PrintConsole(game, "Audio: %.1f of %.1f voice-seconds virtualized (%.0f%%), %d times", virtualized, audible + virtualized, virtualized * 100.0 / (audible + virtualized), virtualizations);
+}
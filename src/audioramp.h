@@ -0,0 +1,75 @@
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef AUDIORAMP_H
+#define AUDIORAMP_H
+
+#include <libsuperderpy.h>
+#include <stdatomic.h>
+
+// Must be a power of two.
+#define AUDIO_RAMP_QUEUE 64
+
+struct AudioRampUpdate {
+	float gain;
+	unsigned int frames; // over which to reach the gain
+};
+
+// Puts a stream into its own sub-mixer whose post-process callback applies the gain,
+// so changing it doesn't take the mixer lock on the logic thread.
+struct AudioRamp {
+	ALLEGRO_AUDIO_STREAM* stream;
+	ALLEGRO_MIXER* mixer;
+	unsigned int frequency;
+
+	// single producer (logic thread), single consumer (mixer callback)
+	struct AudioRampUpdate queue[AUDIO_RAMP_QUEUE];
+	atomic_uint head, tail;
+
+	// owned by the mixer callback
+	float gain, target, step;
+	unsigned int remaining;
+
+	// owned by the logic thread
+	float lastGain, lastSpeed;
+	double rampTime; // of the last queued update
+	unsigned int locks, pushed, dropped;
+
+	// A stream that stays below the threshold gets paused and its position is advanced
+	// by hand, so it can resume where it would have been if it was playing all along.
+	float threshold;
+	bool virtualized;
+	double position, length; // in seconds
+	double silentTime;
+	double audibleTime, virtualTime;
+	unsigned int virtualizations;
+};
+
+struct AudioRamp* CreateAudioRamp(struct Game* game, ALLEGRO_AUDIO_STREAM* stream, ALLEGRO_MIXER* parent, float gain);
+void DestroyAudioRamp(struct AudioRamp* ramp);
+
+// Linearly reaches the gain over given time, interpolated per sample. Repeated values are ignored.
+void RampAudioGain(struct AudioRamp* ramp, float gain, double seconds);
+// Speed can't be changed from inside the mixer, so this still locks - but only when the value changes.
+void SetAudioSpeed(struct AudioRamp* ramp, float speed);
+// Call once per tick after setting the parameters; virtualizes and restores the stream.
+void UpdateAudioVoice(struct AudioRamp* ramp, double dt);
+
+void PrintAudioRampStats(struct Game* game, struct AudioRamp* ramps[], int count, double seconds);
+void PrintAudioVoiceStats(struct Game* game, struct AudioRamp* ramps[], int count);
+
+#endif
@@ -35,16 +35,80 @@ bool GlobalEventHandler(struct Game *game, ALLEGRO_EVENT *ev) {
 		SetupViewport(game, game->viewport_config);
 		PrintConsole(game, "Fullscreen toggled");
 	}
+	if ((ev->type == ALLEGRO_EVENT_KEY_DOWN) && (ev->keyboard.keycode == ALLEGRO_KEY_M)) {
+		game->data->accounting.overlay = !game->data->accounting.overlay;
+		PrintResourceReport(game, NULL);
+	}
 
 	return false;
 }
 
 struct CommonResources* CreateGameData(struct Game *game) {
 	struct CommonResources *data = calloc(1, sizeof(struct CommonResources));
+	InitResourceAccounting(game, &data->accounting);
 	return data;
 }
 
+void ParseNetplayOptions(struct Game *game, struct NetplayOptions *options, int argc, char **argv) {
+	options->mode = NETPLAY_OFF;
+	options->port = strtol(GetConfigOptionDefault(game, "nowandthen", "net_port", "7777"), NULL, 10);
+	options->latency = strtol(GetConfigOptionDefault(game, "nowandthen", "net_latency", "0"), NULL, 10);
+	options->jitter = strtol(GetConfigOptionDefault(game, "nowandthen", "net_jitter", "0"), NULL, 10);
+	options->loss = strtod(GetConfigOptionDefault(game, "nowandthen", "net_loss", "0"), NULL) / 100.0;
+	options->spectateServer = false;
+	options->spectateAddress[0] = '\0';
+	options->spectatePort = strtol(GetConfigOptionDefault(game, "nowandthen", "spectate_port", "7778"), NULL, 10);
+
+	for (int i = 1; i < argc; i++) {
+		bool hasValue = i + 1 < argc;
+		if (strcmp(argv[i], "--host") == 0) {
+			options->mode = NETPLAY_HOST;
+		} else if ((strcmp(argv[i], "--join") == 0) && hasValue) {
+			options->mode = NETPLAY_JOIN;
+			snprintf(options->address, sizeof(options->address), "%s", argv[++i]);
+		} else if ((strcmp(argv[i], "--port") == 0) && hasValue) {
+			options->port = strtol(argv[++i], NULL, 10);
+		} else if ((strcmp(argv[i], "--latency") == 0) && hasValue) {
+			options->latency = strtol(argv[++i], NULL, 10);
+		} else if ((strcmp(argv[i], "--jitter") == 0) && hasValue) {
+			options->jitter = strtol(argv[++i], NULL, 10);
+		} else if ((strcmp(argv[i], "--loss") == 0) && hasValue) {
+			options->loss = strtod(argv[++i], NULL) / 100.0;
+		} else if (strcmp(argv[i], "--spectate-server") == 0) {
+			options->spectateServer = true;
+		} else if ((strcmp(argv[i], "--spectate") == 0) && hasValue) {
+			snprintf(options->spectateAddress, sizeof(options->spectateAddress), "%s", argv[++i]);
+		} else if ((strcmp(argv[i], "--spectate-port") == 0) && hasValue) {
+			options->spectatePort = strtol(argv[++i], NULL, 10);
+		}
+	}
+}
+
+void ParseBenchmarkOptions(struct Game *game, struct BenchmarkOptions *options, int argc, char **argv) {
+	options->frames = 0;
+	options->exportEvery = 0;
+	snprintf(options->exportDir, sizeof(options->exportDir), ".");
+
+	for (int i = 1; i < argc; i++) {
+		bool hasValue = i + 1 < argc;
+		if ((strcmp(argv[i], "--render-benchmark") == 0) && hasValue) {
+			options->frames = strtol(argv[++i], NULL, 10);
+		} else if ((strcmp(argv[i], "--export-every") == 0) && hasValue) {
+			options->exportEvery = strtol(argv[++i], NULL, 10);
+		} else if ((strcmp(argv[i], "--export-dir") == 0) && hasValue) {
+			snprintf(options->exportDir, sizeof(options->exportDir), "%s", argv[++i]);
+		}
+	}
+	if (options->frames < 0) {
+		options->frames = 0;
+	}
+	if (options->exportEvery < 0) {
+		options->exportEvery = 0;
+	}
+}
+
 void DestroyGameData(struct Game *game) {
+	DestroyResourceAccounting(game, &game->data->accounting);
 	free(game->data);
 }
 
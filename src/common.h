@@ -17,13 +17,26 @@
 
 #define LIBSUPERDERPY_DATA_TYPE struct CommonResources
 #include <libsuperderpy.h>
+#include "accounting.h"
+#include "netplay.h"
+
+// Renders a scripted match as fast as possible into an offscreen target instead of playing.
+struct BenchmarkOptions {
+	int frames; // 0 when not benchmarking
+	int exportEvery; // save every Nth frame as PNG, 0 to never save
+	char exportDir[256];
+};
 
 struct CommonResources {
 	// Fill in with common data accessible from all gamestates.
 
-	bool unused; // to not malloc 0 bytes
+	struct ResourceAccounting accounting;
+	struct NetplayOptions netplay;
+	struct BenchmarkOptions benchmark;
 };
 
 struct CommonResources* CreateGameData(struct Game* game);
 void DestroyGameData(struct Game* game);
 bool GlobalEventHandler(struct Game* game, ALLEGRO_EVENT* ev);
+void ParseNetplayOptions(struct Game* game, struct NetplayOptions* options, int argc, char** argv);
+void ParseBenchmarkOptions(struct Game* game, struct BenchmarkOptions* options, int argc, char** argv);
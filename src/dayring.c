@@ -0,0 +1,210 @@
+/*! \file dayring.c
+ *  \brief Days of the park generated ahead of time on a worker thread.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "dayring.h"
+#include "match.h"
+#include <stdlib.h>
+
+uint64_t DaySeed(uint64_t seed, int number) {
+	if (number == 0) {
+		// the day everyone starts with is the same one a single looping day would be
+		return seed;
+	}
+	// hashed, so that the days don't share runs of random numbers with each other
+	uint64_t state = seed ^ ((uint64_t)(uint32_t)number << 32);
+	uint64_t high = SplitMix(&state);
+	return (high << 32) | SplitMix(&state);
+}
+
+// Has to be called with the mutex locked.
+static struct DaySlot* FindSlot(struct DayRing* ring, int number) {
+	for (int i = 0; i < DAY_RING_SLOTS; i++) {
+		struct DaySlot* slot = &ring->slots[i];
+		if ((slot->state != DAY_SLOT_EMPTY) && (slot->number == number) && (slot->epoch == ring->epoch)) {
+			return slot;
+		}
+	}
+	return NULL;
+}
+
+static bool IsWanted(const struct DayRing* ring, int number) {
+	for (unsigned int i = 0; i < ring->wantedCount; i++) {
+		if (ring->wanted[i] == number) {
+			return true;
+		}
+	}
+	return false;
+}
+
+// Picks the most important day that isn't there yet and a slot for it.
+static struct DaySlot* NextDay(struct DayRing* ring) {
+	for (unsigned int w = 0; w < ring->wantedCount; w++) {
+		if (FindSlot(ring, ring->wanted[w])) {
+			continue;
+		}
+		for (int i = 0; i < DAY_RING_SLOTS; i++) {
+			struct DaySlot* slot = &ring->slots[i];
+			if (slot->state == DAY_SLOT_EMPTY) {
+				slot->number = ring->wanted[w];
+				return slot;
+			}
+		}
+		return NULL;
+	}
+	return NULL;
+}
+
+static void* Work(ALLEGRO_THREAD* thread, void* arg) {
+	struct DayRing* ring = arg;
+	al_lock_mutex(ring->mutex);
+	while (!ring->quit) {
+		struct DaySlot* slot = NextDay(ring);
+		if (!slot) {
+			al_wait_cond(ring->cond, ring->mutex);
+			continue;
+		}
+		slot->state = DAY_SLOT_GENERATING;
+		slot->epoch = ring->epoch;
+		uint64_t seed = DaySeed(ring->seed, slot->number);
+		al_unlock_mutex(ring->mutex);
+
+		// the graph and params never change, so nothing else needs the lock
+		double start = al_get_time();
+		struct DgzDay day;
+		DGZ(ring->graph, &ring->params, seed, &day);
+		IndexDgzDay(&day);
+		double time = al_get_time() - start;
+
+		al_lock_mutex(ring->mutex);
+		if ((slot->epoch != ring->epoch) || !IsWanted(ring, slot->number)) {
+			// the seed changed or the clocks moved on in the meantime
+			slot->state = DAY_SLOT_EMPTY;
+			al_unlock_mutex(ring->mutex);
+			FreeDgzDay(&day);
+			al_lock_mutex(ring->mutex);
+			continue;
+		}
+		slot->day = day;
+		slot->generationTime = time;
+		slot->state = DAY_SLOT_READY;
+		al_broadcast_cond(ring->cond);
+	}
+	al_unlock_mutex(ring->mutex);
+	return NULL;
+}
+
+struct DayRing* CreateDayRing(const struct PathGraph* graph, const struct DgzParams* params, uint64_t seed) {
+	struct DayRing* ring = calloc(1, sizeof(struct DayRing));
+	ring->graph = graph;
+	ring->params = *params;
+	ring->seed = seed;
+	ring->mutex = al_create_mutex();
+	ring->cond = al_create_cond();
+	ring->thread = al_create_thread(Work, ring);
+	al_start_thread(ring->thread);
+	return ring;
+}
+
+void DestroyDayRing(struct DayRing* ring) {
+	al_lock_mutex(ring->mutex);
+	ring->quit = true;
+	al_broadcast_cond(ring->cond);
+	al_unlock_mutex(ring->mutex);
+	al_join_thread(ring->thread, NULL);
+	al_destroy_thread(ring->thread);
+	for (int i = 0; i < DAY_RING_SLOTS; i++) {
+		if (ring->slots[i].state == DAY_SLOT_READY) {
+			FreeDgzDay(&ring->slots[i].day);
+		}
+	}
+	al_destroy_cond(ring->cond);
+	al_destroy_mutex(ring->mutex);
+	free(ring);
+}
+
+// Takes the days that have to go out of their slots, so that they can be freed without the lock.
+static unsigned int Evict(struct DayRing* ring, bool all, struct DgzDay* evicted) {
+	unsigned int count = 0;
+	for (int i = 0; i < DAY_RING_SLOTS; i++) {
+		struct DaySlot* slot = &ring->slots[i];
+		if ((slot->state == DAY_SLOT_READY) && (all || !IsWanted(ring, slot->number))) {
+			evicted[count++] = slot->day;
+			slot->day = (struct DgzDay){0};
+			slot->state = DAY_SLOT_EMPTY;
+		}
+	}
+	return count;
+}
+
+void ResetDayRing(struct DayRing* ring, uint64_t seed) {
+	struct DgzDay evicted[DAY_RING_SLOTS];
+	al_lock_mutex(ring->mutex);
+	ring->seed = seed;
+	ring->epoch++;
+	unsigned int count = Evict(ring, true, evicted);
+	al_broadcast_cond(ring->cond);
+	al_unlock_mutex(ring->mutex);
+	for (unsigned int i = 0; i < count; i++) {
+		FreeDgzDay(&evicted[i]);
+	}
+}
+
+void WantDays(struct DayRing* ring, const int* days, unsigned int count) {
+	struct DgzDay evicted[DAY_RING_SLOTS];
+	if (count > DAY_RING_SLOTS - 1) {
+		count = DAY_RING_SLOTS - 1; // one slot is left for the day the worker may be busy with
+	}
+	al_lock_mutex(ring->mutex);
+	bool changed = count != ring->wantedCount;
+	for (unsigned int i = 0; i < count; i++) {
+		changed |= ring->wanted[i] != days[i];
+		ring->wanted[i] = days[i];
+	}
+	ring->wantedCount = count;
+	unsigned int evictedCount = 0;
+	if (changed) {
+		evictedCount = Evict(ring, false, evicted);
+		al_broadcast_cond(ring->cond);
+	}
+	al_unlock_mutex(ring->mutex);
+	for (unsigned int i = 0; i < evictedCount; i++) {
+		FreeDgzDay(&evicted[i]);
+	}
+}
+
+const struct DaySlot* GetDay(struct DayRing* ring, int number) {
+	al_lock_mutex(ring->mutex);
+	const struct DaySlot* slot = FindSlot(ring, number);
+	if (slot && (slot->state != DAY_SLOT_READY)) {
+		slot = NULL;
+	}
+	al_unlock_mutex(ring->mutex);
+	return slot;
+}
+
+const struct DaySlot* WaitForDay(struct DayRing* ring, int number) {
+	al_lock_mutex(ring->mutex);
+	const struct DaySlot* slot;
+	while (!(slot = FindSlot(ring, number)) || (slot->state != DAY_SLOT_READY)) {
+		al_wait_cond(ring->cond, ring->mutex);
+	}
+	al_unlock_mutex(ring->mutex);
+	return slot;
+}
@@ -0,0 +1,75 @@
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DAYRING_H
+#define DAYRING_H
+
+#include "dgz.h"
+#include <allegro5/allegro.h>
+
+// The day before, the current one and the next one for up to four views, plus one that's being
+// generated but isn't wanted anymore. That's all the memory days can ever take.
+#define DAY_RING_SLOTS 13
+
+enum DAY_SLOT_STATE {
+	DAY_SLOT_EMPTY,
+	DAY_SLOT_GENERATING, // belongs to the worker
+	DAY_SLOT_READY // belongs to the main thread, which is the only one that can free it
+};
+
+struct DaySlot {
+	struct DgzDay day;
+	int number;
+	enum DAY_SLOT_STATE state;
+	unsigned int epoch; // of the seed it was generated with
+	double generationTime; // in seconds
+};
+
+// Days of the park, generated on a worker thread ahead of the clocks. Day 0 is generated from the
+// seed itself and the other ones from a hash of it, so everyone with the same seed gets the same days.
+struct DayRing {
+	const struct PathGraph* graph;
+	struct DgzParams params;
+	uint64_t seed;
+	unsigned int epoch; // bumped with every new seed
+
+	struct DaySlot slots[DAY_RING_SLOTS];
+	int wanted[DAY_RING_SLOTS]; // most important first
+	unsigned int wantedCount;
+
+	ALLEGRO_THREAD* thread;
+	ALLEGRO_MUTEX* mutex;
+	ALLEGRO_COND* cond;
+	bool quit;
+};
+
+uint64_t DaySeed(uint64_t seed, int number);
+
+struct DayRing* CreateDayRing(const struct PathGraph* graph, const struct DgzParams* params, uint64_t seed);
+void DestroyDayRing(struct DayRing* ring);
+// Throws all the days away; they get generated again from the new seed.
+void ResetDayRing(struct DayRing* ring, uint64_t seed);
+// Makes the worker generate the wanted days (most important first) and frees the ones that aren't
+// wanted anymore. Only ever waits for the worker to update its bookkeeping.
+void WantDays(struct DayRing* ring, const int* days, unsigned int count);
+// The day with the given number, or NULL when it isn't there yet. Stays valid until the next
+// WantDays or ResetDayRing that doesn't want it.
+const struct DaySlot* GetDay(struct DayRing* ring, int number);
+// Blocks until the day is there. For loading and benchmarking; the day has to be wanted.
+const struct DaySlot* WaitForDay(struct DayRing* ring, int number);
+
+#endif
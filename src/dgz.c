@@ -0,0 +1,949 @@
+/*! \file dgz.c
+ *  \brief Generator of the animals walking around the park.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "dgz.h"
+#include "match.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+const int AnimalTypeZIndex[ANIMAL_TYPES] = {
+	[ANIMAL_OWCA] = 0,
+	[ANIMAL_OSTRONOS] = 2,
+	[ANIMAL_DZIK] = 1,
+};
+
+#define BENCH_PATH_Y 493 // in the full size park; the sitting sprites are placed relative to it
+
+// The top of the sitting sprites, relative to the bench path.
+static const int SittingY[ANIMAL_TYPES] = {
+	[ANIMAL_OWCA] = 310 - BENCH_PATH_Y,
+	[ANIMAL_OSTRONOS] = 350 - BENCH_PATH_Y,
+	[ANIMAL_DZIK] = 310 - BENCH_PATH_Y,
+};
+
+const struct DgzParams DefaultDgzParams = {
+	.ticksPerAnimal = 16,
+	.benchingTime = 32,
+	.minBenchingTime = 5,
+	.nightSuppression = 0.5,
+	.density = 1,
+	.spacing = 4, // about the width of a sprite
+};
+
+#define BENCH_LEFT_TAKEN 1
+#define BENCH_RIGHT_TAKEN 2
+
+// How likely an animal is to head for each kind of destination...
+static const double ArrivingDestinations[DESTINATIONS] = {
+	[DESTINATION_EXIT] = 0.7,
+	[DESTINATION_BENCH] = 0.1,
+	[DESTINATION_LANDMARK] = 0.2,
+};
+// ...once it got to one that wasn't an exit...
+static const double OnwardDestinations[DESTINATIONS] = {
+	[DESTINATION_EXIT] = 0.9,
+	[DESTINATION_BENCH] = 0.03,
+	[DESTINATION_LANDMARK] = 0.07,
+};
+// ...and once it found the bench full.
+static const double ElsewhereDestinations[DESTINATIONS] = {
+	[DESTINATION_EXIT] = 0.9,
+	[DESTINATION_LANDMARK] = 0.1,
+};
+
+struct Generator {
+	const struct PathGraph* graph;
+	struct DgzDay* day;
+	unsigned int allocated;
+	int curId;
+
+	// Walks are visited only when they end, so a day costs the same no matter how crowded it gets.
+	// Lists of walks ending at a given tick are linked through next and kept in spawning order.
+	int* next;
+	int *first, *last;
+	int* lanes; // the last walk along every path, for both directions
+	int spacing;
+	struct Path** destinations; // where the animal on every walk is heading to
+	int ticks;
+	unsigned int pending; // walks in the lists that haven't ended yet
+
+	// sitting animals need attention on every tick
+	unsigned int* seated;
+	unsigned int seatedCount, seatedAllocated;
+	unsigned char* benches; // BENCH_*_TAKEN for every path
+};
+
+// Where a copy of the park goes.
+struct Placement {
+	double x, y, scale;
+};
+
+double NightValue(double time) {
+	double night = 0;
+	if ((time > 0.25) && (time < 0.5)) {
+		night = (time - 0.25) * 4;
+		if (night < 0.5) {
+			night = fmin(night * 5, 1.0);
+		} else {
+			night = 1.0 - fmax((night - 0.5) * 2, 0.0);
+		}
+	}
+	return night;
+}
+
+static struct Path* InitPath(const struct Placement* at, int px1, int py1, int px2, int py2, int successorsLeft, int successorsRight, int zIndex) {
+	double x1 = at->x + px1 * at->scale, y1 = at->y + py1 * at->scale;
+	double x2 = at->x + px2 * at->scale, y2 = at->y + py2 * at->scale;
+	struct Path* path = calloc(1, sizeof(struct Path) + sizeof(struct Path*) * (successorsLeft + successorsRight));
+	path->a = (float)(y2 - y1) / (float)(x2 - x1);
+	path->b = y1 - path->a * x1;
+	path->start = x1;
+	path->stop = x2;
+	// measured along the line, like the animals walk it; smaller copies of the park don't make the walks shorter
+	double ya = path->a * x1 + path->b, yb = path->a * x2 + path->b;
+	path->length = sqrt(pow(x2 - x1, 2) + pow(yb - ya, 2)) / at->scale;
+	path->bench = false;
+	path->zIndex = zIndex;
+	path->successorsLeft = successorsLeft;
+	path->successorsRight = successorsRight;
+	return path;
+}
+
+// Keeps the walk at least spacing ticks behind the one that went the same way along the path
+// before it, by holding it back at the start of the path and slowing it down to follow. Both
+// move at a constant speed, so being far enough behind at both ends keeps them apart all the way.
+// A path that gets more animals than it fits can't do that without the queue growing forever,
+// so the waiting and slowing down are limited and the animals overlap past that.
+static void KeepDistance(struct Generator* gen, unsigned int i) {
+	struct Animal* animal = &gen->day->animals[i];
+	int duration = animal->time.despawn - animal->time.spawn;
+	if (animal->path->bench || !duration || !gen->spacing) {
+		// sitting, or never seen
+		return;
+	}
+	int* lane = &gen->lanes[animal->path->index * 2 + animal->reverse];
+	int ahead = *lane;
+	*lane = i;
+	if (ahead < 0) {
+		return;
+	}
+	const struct Animal* leader = &gen->day->animals[ahead];
+	int depart = leader->time.depart + gen->spacing;
+	if (depart > animal->time.spawn + gen->spacing * 2) {
+		depart = animal->time.spawn + gen->spacing * 2;
+	}
+	if (depart > animal->time.depart) {
+		animal->time.depart = depart;
+	}
+	int despawn = leader->time.despawn + gen->spacing;
+	if (despawn > animal->time.depart + duration * 2) {
+		despawn = animal->time.depart + duration * 2; // no slower than half the speed
+	}
+	animal->time.despawn = animal->time.depart + duration;
+	if (despawn > animal->time.despawn) {
+		animal->time.despawn = despawn;
+	}
+}
+
+static struct Animal* SpawnAnimal(struct Generator* gen, int tick, struct Path* path, enum ANIMAL_TYPE type, bool reverse, double speed) {
+	struct Animal* animal = &gen->day->animals[gen->day->count];
+	animal->time.spawn = tick;
+	animal->time.depart = tick;
+	animal->speed = speed;
+	animal->time.despawn = tick + (path->length / (38.8) * animal->speed);
+	if (path->bench) {
+		animal->time.despawn++;
+	}
+	animal->state = ANIMAL_WALKING;
+	animal->type = type;
+	animal->path = path;
+	animal->reverse = reverse;
+	animal->id = gen->curId++;
+	KeepDistance(gen, gen->day->count);
+
+	gen->day->count++;
+	if (gen->day->count == gen->allocated) {
+		gen->allocated *= 2;
+		gen->day->animals = realloc(gen->day->animals, gen->allocated * sizeof(struct Animal));
+		gen->next = realloc(gen->next, gen->allocated * sizeof(int));
+		gen->destinations = realloc(gen->destinations, gen->allocated * sizeof(struct Path*));
+		animal = &gen->day->animals[gen->day->count - 1];
+	}
+
+	return animal;
+}
+
+// Has to be called once the state of a freshly spawned animal is known.
+static void Schedule(struct Generator* gen, unsigned int i) {
+	struct Animal* animal = &gen->day->animals[i];
+	if (animal->state != ANIMAL_WALKING) {
+		if (gen->seatedCount == gen->seatedAllocated) {
+			gen->seatedAllocated = gen->seatedAllocated ? gen->seatedAllocated * 2 : 16;
+			gen->seated = realloc(gen->seated, gen->seatedAllocated * sizeof(unsigned int));
+		}
+		gen->seated[gen->seatedCount++] = i;
+		return;
+	}
+	int tick = animal->time.despawn;
+	if (tick >= gen->ticks) {
+		int ticks = gen->ticks;
+		while (tick >= gen->ticks) {
+			gen->ticks *= 2;
+		}
+		gen->first = realloc(gen->first, gen->ticks * sizeof(int));
+		gen->last = realloc(gen->last, gen->ticks * sizeof(int));
+		for (int j = ticks; j < gen->ticks; j++) {
+			gen->first[j] = gen->last[j] = -1;
+		}
+	}
+	gen->next[i] = -1;
+	if (gen->last[tick] >= 0) {
+		gen->next[gen->last[tick]] = i;
+	} else {
+		gen->first[tick] = i;
+	}
+	gen->last[tick] = i;
+	gen->pending++;
+}
+
+static void CreatePark(struct Path** paths, struct Path** entrances, const struct Placement* at) {
+	paths[0] = InitPath(at, 1545, 299, 1643, 392, 1, 0, -1);
+	paths[1] = InitPath(at, 28, 561, 686, 487, 0, 3, 1);
+	paths[2] = InitPath(at, 686, 487, 1194, 493, 3, 2, 1);
+	paths[3] = InitPath(at, 1194, 493, 1195, 493, 2, 2, 0);
+	paths[4] = InitPath(at, 1195, 493, 1414, 494, 2, 3, 1);
+	paths[5] = InitPath(at, 1414, 494, 1900, 432, 3, 0, 1);
+	paths[6] = InitPath(at, 393, 1027, 615, 738, 0, 1, 4);
+	paths[7] = InitPath(at, 615, 738, 840, 622, 1, 2, 4);
+	paths[8] = InitPath(at, 1185, 807, 1603, 999, 3, 0, 3);
+	paths[9] = InitPath(at, 840, 622, 1185, 807, 2, 3, 3);
+	paths[10] = InitPath(at, 686, 487, 840, 622, 3, 2, 3);
+	paths[11] = InitPath(at, 329, 225, 686, 487, 1, 3, 0);
+	paths[12] = InitPath(at, 260, 312, 329, 225, 0, 1, -1);
+	paths[13] = InitPath(at, 951, 1025, 1185, 807, 0, 3, 4);
+	paths[14] = InitPath(at, 1185, 807, 1414, 494, 3, 3, 2);
+	paths[15] = InitPath(at, 1414, 494, 1545, 299, 3, 1, 0);
+
+	paths[3]->bench = true;
+	paths[9]->landmark = true;
+	paths[14]->landmark = true;
+
+	// path 0 left
+	paths[0]->successors[0] = paths[15];
+	// no right on path 0
+
+	// no left on path 1
+	// path 1 right
+	paths[1]->successors[0] = paths[11];
+	paths[1]->successors[1] = paths[2];
+	paths[1]->successors[2] = paths[10];
+
+	// path 2 left
+	paths[2]->successors[0] = paths[1];
+	paths[2]->successors[1] = paths[11];
+	paths[2]->successors[2] = paths[10];
+	// path 2 right
+	paths[2]->successors[3] = paths[3];
+	paths[2]->successors[4] = paths[4];
+
+	// path 3 left
+	paths[3]->successors[0] = paths[2];
+	paths[3]->successors[1] = paths[4];
+	// path 3 right
+	paths[3]->successors[2] = paths[2];
+	paths[3]->successors[3] = paths[4];
+
+	// path 4 left
+	paths[4]->successors[0] = paths[2];
+	paths[4]->successors[1] = paths[3];
+	// path 4 right
+	paths[4]->successors[2] = paths[14];
+	paths[4]->successors[3] = paths[15];
+	paths[4]->successors[4] = paths[5];
+
+	// path 5 left
+	paths[5]->successors[0] = paths[4];
+	paths[5]->successors[1] = paths[14];
+	paths[5]->successors[2] = paths[15];
+	// no right on path 5
+
+	// no left on path 6
+	// path 6 right
+	paths[6]->successors[0] = paths[7];
+
+	// path 7 left
+	paths[7]->successors[0] = paths[6];
+	// path 7 right
+	paths[7]->successors[1] = paths[9];
+	paths[7]->successors[2] = paths[10];
+
+	// path 8 left
+	paths[8]->successors[0] = paths[9];
+	paths[8]->successors[1] = paths[13];
+	paths[8]->successors[2] = paths[14];
+	// no right on path 8
+
+	// path 9 left
+	paths[9]->successors[0] = paths[7];
+	paths[9]->successors[1] = paths[10];
+	// path 9 right
+	paths[9]->successors[2] = paths[8];
+	paths[9]->successors[3] = paths[13];
+	paths[9]->successors[4] = paths[14];
+
+	// path 10 left
+	paths[10]->successors[0] = paths[1];
+	paths[10]->successors[1] = paths[11];
+	paths[10]->successors[2] = paths[2];
+	// path 10 right
+	paths[10]->successors[3] = paths[7];
+	paths[10]->successors[4] = paths[9];
+
+	// path 11 left
+	paths[11]->successors[0] = paths[12];
+	// path 11 right
+	paths[11]->successors[1] = paths[1];
+	paths[11]->successors[2] = paths[2];
+	paths[11]->successors[3] = paths[10];
+
+	// no left on path 12
+	// path 12 right
+	paths[12]->successors[0] = paths[11];
+
+	// no left on path 13
+	// path 13 right
+	paths[13]->successors[0] = paths[9];
+	paths[13]->successors[1] = paths[14];
+	paths[13]->successors[2] = paths[8];
+
+	// path 14 left
+	paths[14]->successors[0] = paths[9];
+	paths[14]->successors[1] = paths[13];
+	paths[14]->successors[2] = paths[8];
+	// path 14 right
+	paths[14]->successors[3] = paths[4];
+	paths[14]->successors[4] = paths[15];
+	paths[14]->successors[5] = paths[5];
+
+	// path 15 left
+	paths[15]->successors[0] = paths[4];
+	paths[15]->successors[1] = paths[14];
+	paths[15]->successors[2] = paths[5];
+	// path 15 right
+	paths[15]->successors[3] = paths[0];
+
+	entrances[0] = paths[1];
+	entrances[1] = paths[12];
+	entrances[2] = paths[6];
+	entrances[3] = paths[13];
+	entrances[4] = paths[8];
+	entrances[5] = paths[0];
+	entrances[6] = paths[5];
+}
+
+// Which end of the path an animal walks towards, and so which successors it picks from.
+static unsigned int RouteState(const struct Path* path, bool reverse) {
+	return (path->index % DGZ_PATHS) * 2 + (reverse ? 0 : 1);
+}
+
+// Whether an animal coming from the other path arrives at the beginning of this one.
+static bool ArrivesAtStart(const struct Path* path, const struct Path* from) {
+	for (unsigned int j = 0; j < path->successorsLeft; j++) {
+		if (path->successors[j] == from) {
+			return true;
+		}
+	}
+	return false;
+}
+
+// Shortest ways from every path end to every destination in the first copy of the park, found by
+// relaxing the walks until nothing changes; the park is small enough for that to be instant.
+static void ComputeRoutes(struct PathGraph* graph) {
+	double cost[DGZ_PATHS * 2];
+	for (unsigned int target = 0; target < DGZ_PATHS; target++) {
+		for (int s = 0; s < DGZ_PATHS * 2; s++) {
+			cost[s] = INFINITY;
+			graph->routes[s][target] = DGZ_NO_ROUTE;
+		}
+		bool changed = true;
+		while (changed) {
+			changed = false;
+			for (int s = 0; s < DGZ_PATHS * 2; s++) {
+				const struct Path* path = graph->paths[s / 2];
+				bool reverse = !(s % 2);
+				unsigned int first = reverse ? 0 : path->successorsLeft;
+				unsigned int count = reverse ? path->successorsLeft : path->successorsRight;
+				for (unsigned int k = 0; k < count; k++) {
+					const struct Path* next = path->successors[first + k];
+					double c = 0;
+					if (next->index != target) {
+						if (next->bench) {
+							continue; // walking onto a bench means sitting on it
+						}
+						c = next->length + cost[RouteState(next, !ArrivesAtStart(next, path))];
+					}
+					if (c < cost[s]) {
+						cost[s] = c;
+						graph->routes[s][target] = k;
+						changed = true;
+					}
+				}
+			}
+		}
+	}
+}
+
+void CreateDgzPaths(struct PathGraph* graph, int tiles) {
+	*graph = (struct PathGraph){0};
+	graph->count = DGZ_PATHS * tiles * tiles;
+	graph->paths = calloc(graph->count, sizeof(struct Path*));
+	graph->entrancesCount = DGZ_ENTRANCES * tiles * tiles;
+	graph->entrances = calloc(graph->entrancesCount, sizeof(struct Path*));
+	for (int i = 0; i < tiles * tiles; i++) {
+		struct Placement at = {.x = (i % tiles) * 1920.0 / tiles, .y = (i / tiles) * 1080.0 / tiles, .scale = 1.0 / tiles};
+		CreatePark(graph->paths + i * DGZ_PATHS, graph->entrances + i * DGZ_ENTRANCES, &at);
+	}
+	for (unsigned int i = 0; i < graph->count; i++) {
+		graph->paths[i]->index = i;
+	}
+	for (int i = 0; i < DGZ_ENTRANCES; i++) {
+		graph->destinations[DESTINATION_EXIT][graph->destinationsCount[DESTINATION_EXIT]++] = graph->entrances[i]->index;
+	}
+	for (int i = 0; i < DGZ_PATHS; i++) {
+		if (graph->paths[i]->bench) {
+			graph->destinations[DESTINATION_BENCH][graph->destinationsCount[DESTINATION_BENCH]++] = i;
+		}
+		if (graph->paths[i]->landmark) {
+			graph->destinations[DESTINATION_LANDMARK][graph->destinationsCount[DESTINATION_LANDMARK]++] = i;
+		}
+	}
+	ComputeRoutes(graph);
+}
+
+void DestroyDgzPaths(struct PathGraph* graph) {
+	for (unsigned int i = 0; i < graph->count; i++) {
+		free(graph->paths[i]);
+	}
+	free(graph->paths);
+	free(graph->entrances);
+	*graph = (struct PathGraph){0};
+}
+
+// Picks a destination of a random kind in the animal's copy of the park, other than the path it's on.
+static struct Path* ChooseDestination(const struct PathGraph* graph, uint64_t* rng, const struct Path* from, const double weights[DESTINATIONS]) {
+	double roll = SplitMix(rng) / (double)UINT32_MAX;
+	enum DESTINATION kind = DESTINATION_EXIT;
+	for (int k = 0; k < DESTINATIONS; k++) {
+		if (roll < weights[k]) {
+			kind = k;
+			break;
+		}
+		roll -= weights[k];
+	}
+	unsigned int local = from->index % DGZ_PATHS;
+	if ((graph->destinationsCount[kind] == 0) || ((graph->destinationsCount[kind] == 1) && (graph->destinations[kind][0] == local))) {
+		kind = DESTINATION_EXIT;
+	}
+	unsigned int count = graph->destinationsCount[kind];
+	unsigned int pick = SplitMix(rng) % count;
+	if (graph->destinations[kind][pick] == local) {
+		pick = (pick + 1) % count;
+	}
+	return graph->paths[from->index - local + graph->destinations[kind][pick]];
+}
+
+// The successor on the shortest way to the destination. When there's no way there, the animal
+// wanders off somewhere that isn't a bench.
+static struct Path* Route(const struct PathGraph* graph, const struct Animal* animal, const struct Path* destination, uint64_t* rng) {
+	const struct Path* path = animal->path;
+	unsigned int first = animal->reverse ? 0 : path->successorsLeft;
+	unsigned int count = animal->reverse ? path->successorsLeft : path->successorsRight;
+	unsigned int hop = graph->routes[RouteState(path, animal->reverse)][destination->index % DGZ_PATHS];
+	if (hop == DGZ_NO_ROUTE) {
+		hop = SplitMix(rng) % count;
+		for (unsigned int k = 0; (k < count) && path->successors[first + hop]->bench; k++) {
+			hop = (hop + 1) % count;
+		}
+	}
+	return path->successors[first + hop];
+}
+
+static void Visit(struct Generator* gen, const struct DgzParams* params, uint64_t* rng, int tick, unsigned int i) {
+	struct DgzDay* day = gen->day;
+	struct Animal* animal = &day->animals[i];
+	if ((animal->time.spawn <= tick) && (animal->time.despawn >= tick)) {
+		if (animal->state != ANIMAL_WALKING) {
+			animal->time.despawn = tick + 1;
+			if ((animal->time.spawn + params->minBenchingTime) <= tick) {
+				if ((SplitMix(rng) / (double)UINT32_MAX) <= (1 / params->benchingTime)) {
+					animal->time.despawn = tick;
+				}
+			}
+		}
+	}
+	if (animal->time.despawn == tick) {
+		int pathsNr = animal->reverse ? animal->path->successorsLeft : animal->path->successorsRight;
+		int id = animal->id;
+		if (pathsNr) {
+			struct Path* destination = gen->destinations[i];
+			if (animal->path == destination) {
+				// got there; off to somewhere else
+				destination = ChooseDestination(gen->graph, rng, animal->path, OnwardDestinations);
+			}
+			struct Path* newpath = Route(gen->graph, animal, destination, rng);
+			enum ANIMAL_STATE newstate = ANIMAL_WALKING;
+
+			if (newpath->bench) {
+				unsigned char* bench = &gen->benches[newpath->index];
+				bool benchLeftTaken = *bench & BENCH_LEFT_TAKEN;
+				bool benchRightTaken = *bench & BENCH_RIGHT_TAKEN;
+				// it's a bench!
+				if (benchLeftTaken && benchRightTaken) {
+					// both sits are taken though, no luck :( the way anywhere else doesn't lead over the bench
+					destination = ChooseDestination(gen->graph, rng, animal->path, ElsewhereDestinations);
+					newpath = Route(gen->graph, animal, destination, rng);
+				} else {
+					// the bench has free sit!
+					bool desiredLeft = SplitMix(rng) / (double)UINT32_MAX < 0.5;
+					if (desiredLeft && benchLeftTaken) {
+						desiredLeft = false;
+					}
+					if (!desiredLeft && benchRightTaken) {
+						desiredLeft = true;
+					}
+					newstate = desiredLeft ? ANIMAL_BENCH_LEFT : ANIMAL_BENCH_RIGHT;
+					if (!benchLeftTaken && !benchRightTaken) {
+						if (SplitMix(rng) / (double)UINT32_MAX < 0.1) {
+							// let's take the whole bench for myself, hah!
+							newstate = ANIMAL_BENCH_CENTER;
+							*bench |= BENCH_LEFT_TAKEN | BENCH_RIGHT_TAKEN;
+						}
+					}
+					*bench |= desiredLeft ? BENCH_LEFT_TAKEN : BENCH_RIGHT_TAKEN;
+				}
+			}
+
+			// arriving at the beginning of newpath means walking it forward
+			bool left = ArrivesAtStart(newpath, animal->path);
+			struct Animal* newanimal = SpawnAnimal(gen, tick, newpath, day->animals[i].type, !left, day->animals[i].speed);
+			newanimal->state = newstate;
+			newanimal->id = id;
+			gen->destinations[day->count - 1] = destination;
+			Schedule(gen, day->count - 1);
+		}
+	}
+}
+
+// How far left of the bench path a sitting animal's sprite starts.
+static int SittingOffset(enum ANIMAL_STATE state) {
+	switch (state) {
+		case ANIMAL_BENCH_CENTER:
+			return 40;
+		case ANIMAL_BENCH_RIGHT:
+			return -5;
+		default:
+			return 85;
+	}
+}
+
+static void InitSegment(const struct Animal* animal, unsigned int walk, struct Segment* segment) {
+	const struct Path* path = animal->path;
+	bool walking = animal->state == ANIMAL_WALKING;
+	*segment = (struct Segment){
+		.spawn = animal->time.spawn,
+		.despawn = animal->time.despawn,
+		.depart = animal->time.depart,
+		.x0 = animal->reverse ? path->stop : path->start,
+		.x1 = animal->reverse ? path->start : path->stop,
+		.angle = walking ? atan(path->a) : 0,
+		.wobble = walking ? 1 / 5.0 : 0,
+		.sitX = walking ? 0 : -SittingOffset(animal->state),
+		.sitY = walking ? 0 : SittingY[animal->type],
+		.id = animal->id,
+		.walk = walk,
+	};
+	segment->y0 = path->a * segment->x0 + path->b;
+	segment->y1 = path->a * segment->x1 + path->b;
+}
+
+// Groups the walks by animal. They're generated in time order, and so are the segments then.
+static void TraceTrajectories(struct DgzDay* day, int ids) {
+	int* trajectory = malloc((ids + 1) * sizeof(int));
+	for (int i = 0; i < ids; i++) {
+		trajectory[i] = -1;
+	}
+	day->segmentsCount = 0;
+	day->trajectoriesCount = 0;
+	unsigned int* counts = calloc(ids + 1, sizeof(unsigned int));
+	for (unsigned int i = 0; i < day->count; i++) {
+		const struct Animal* animal = &day->animals[i];
+		// the walks that end right away are never seen
+		if (animal->time.despawn > animal->time.spawn) {
+			counts[animal->id]++;
+			day->segmentsCount++;
+		}
+	}
+	for (int id = 0; id < ids; id++) {
+		if (counts[id]) {
+			trajectory[id] = day->trajectoriesCount++;
+		}
+	}
+
+	day->trajectories = malloc((day->trajectoriesCount + 1) * sizeof(struct Trajectory));
+	day->segments = malloc((day->segmentsCount + 1) * sizeof(struct Segment));
+	unsigned int first = 0;
+	for (int id = 0; id < ids; id++) {
+		if (counts[id]) {
+			day->trajectories[trajectory[id]] = (struct Trajectory){.id = id, .first = first};
+			first += counts[id];
+		}
+	}
+	for (unsigned int i = 0; i < day->count; i++) {
+		const struct Animal* animal = &day->animals[i];
+		if (animal->time.despawn > animal->time.spawn) {
+			struct Trajectory* t = &day->trajectories[trajectory[animal->id]];
+			InitSegment(animal, i, &day->segments[t->first + t->count++]);
+		}
+	}
+	free(counts);
+	free(trajectory);
+}
+
+void DGZ(const struct PathGraph* graph, const struct DgzParams* params, uint64_t seed, struct DgzDay* day) {
+	// a visitor takes a handful of walks, so crowded days can mostly skip growing the arrays
+	double arrivals = TICKS_PER_DAY / params->ticksPerAnimal * params->density;
+	struct Generator gen = {
+		.graph = graph,
+		.day = day,
+		.spacing = params->spacing,
+		.allocated = fmax(512, arrivals * 4),
+		.ticks = TICKS_PER_DAY * 2,
+	};
+	*day = (struct DgzDay){0};
+	day->animals = calloc(gen.allocated, sizeof(struct Animal));
+	gen.next = calloc(gen.allocated, sizeof(int));
+	gen.destinations = calloc(gen.allocated, sizeof(struct Path*));
+	gen.lanes = malloc(graph->count * 2 * sizeof(int));
+	for (unsigned int i = 0; i < graph->count * 2; i++) {
+		gen.lanes[i] = -1;
+	}
+	gen.first = malloc(gen.ticks * sizeof(int));
+	gen.last = malloc(gen.ticks * sizeof(int));
+	for (int i = 0; i < gen.ticks; i++) {
+		gen.first[i] = gen.last[i] = -1;
+	}
+	gen.benches = calloc(graph->count, sizeof(unsigned char));
+
+	// splitmix64 is counter based: every number is a hash of the seed and how many came before it
+	uint64_t rng = seed;
+
+	int tick = 0;
+	bool animalsLeft = false;
+	while ((tick < TICKS_PER_DAY) || (animalsLeft)) {
+		double night = NightValue(tick / (double)TICKS_PER_DAY);
+		double probability = (1 / (float)params->ticksPerAnimal) * pow(1 - params->nightSuppression * night, 2) * params->density;
+
+		// one draw per tick as long as fewer than one animal arrives on average
+		double left = probability;
+		do {
+			if (((SplitMix(&rng) / (float)UINT32_MAX) <= fmin(left, 1.0)) && (tick < TICKS_PER_DAY)) {
+				// spawn an animal on entrance
+				struct Path* path = graph->entrances[SplitMix(&rng) % graph->entrancesCount];
+				SpawnAnimal(&gen, tick, path, SplitMix(&rng) % ANIMAL_TYPES, path->successorsLeft ? true : false, 0.8 + (SplitMix(&rng) / (float)UINT32_MAX) * 0.4);
+				gen.destinations[day->count - 1] = ChooseDestination(graph, &rng, path, ArrivingDestinations);
+				Schedule(&gen, day->count - 1);
+			}
+			left -= 1;
+		} while (left > 0);
+
+		animalsLeft = gen.pending || gen.seatedCount;
+		for (unsigned int i = 0; i < gen.seatedCount; i++) {
+			const struct Animal* animal = &day->animals[gen.seated[i]];
+			unsigned char* bench = &gen.benches[animal->path->index];
+			switch (animal->state) {
+				case ANIMAL_BENCH_CENTER:
+					*bench |= BENCH_LEFT_TAKEN | BENCH_RIGHT_TAKEN;
+					break;
+				case ANIMAL_BENCH_LEFT:
+					*bench |= BENCH_LEFT_TAKEN;
+					break;
+				case ANIMAL_BENCH_RIGHT:
+					*bench |= BENCH_RIGHT_TAKEN;
+					break;
+				case ANIMAL_WALKING:
+					break;
+			}
+		}
+
+		// The sitting animals and the walks ending now, in the order they were spawned in. Walks
+		// spawned on the way get appended, so they're visited too when they end right away.
+		int walk = -1;
+		unsigned int seat = 0;
+		for (;;) {
+			int candidate = (walk < 0) ? gen.first[tick] : gen.next[walk];
+			unsigned int i;
+			if ((candidate >= 0) && ((seat == gen.seatedCount) || ((unsigned int)candidate < gen.seated[seat]))) {
+				i = walk = candidate;
+				gen.pending--;
+			} else if (seat < gen.seatedCount) {
+				i = gen.seated[seat++];
+			} else {
+				break;
+			}
+			Visit(&gen, params, &rng, tick, i);
+		}
+
+		// only benches that someone sits on can have their flags set
+		unsigned int seated = 0;
+		for (unsigned int i = 0; i < gen.seatedCount; i++) {
+			const struct Animal* animal = &day->animals[gen.seated[i]];
+			gen.benches[animal->path->index] = 0;
+			if (animal->time.despawn > tick) {
+				gen.seated[seated++] = gen.seated[i];
+			}
+		}
+		gen.seatedCount = seated;
+		tick++;
+	}
+
+	free(gen.next);
+	free(gen.destinations);
+	free(gen.lanes);
+	free(gen.first);
+	free(gen.last);
+	free(gen.seated);
+	free(gen.benches);
+	day->animals = realloc(day->animals, day->count * sizeof(struct Animal));
+	TraceTrajectories(day, gen.curId);
+}
+
+void FreeDgzDay(struct DgzDay* day) {
+	free(day->animals);
+	free(day->segments);
+	free(day->trajectories);
+	free(day->visible);
+	*day = (struct DgzDay){0};
+}
+
+static void PlaceOnSegment(const struct DgzDay* day, const struct Segment* segment, double time, struct AnimalPose* pose) {
+	float progress = fmax(((time * TICKS_PER_DAY) - segment->depart) / (double)(segment->despawn - segment->depart), 0);
+	pose->animal = &day->animals[segment->walk];
+	pose->segment = segment;
+	pose->x = segment->x0 + (segment->x1 - segment->x0) * progress;
+	pose->y = segment->y0 + (segment->y1 - segment->y0) * progress;
+	pose->angle = segment->angle + segment->wobble * sin(time * 6000 + segment->id);
+}
+
+static bool PoseSegment(const struct DgzDay* day, const struct Segment* segment, double time, enum DGZ_PART part, struct AnimalPose* pose) {
+	int tick = time * TICKS_PER_DAY;
+	if ((segment->spawn > tick) || (segment->despawn <= tick) || (part == DGZ_OVERNIGHT)) {
+		if (part == DGZ_TODAY) {
+			return false;
+		}
+		// walks that started before midnight go on in the morning
+		time += 1;
+		tick += TICKS_PER_DAY;
+		if ((segment->spawn > tick) || (segment->despawn <= tick)) {
+			return false;
+		}
+	}
+	PlaceOnSegment(day, segment, time, pose);
+	return true;
+}
+
+const struct Trajectory* FindTrajectory(const struct DgzDay* day, int id) {
+	unsigned int lo = 0, hi = day->trajectoriesCount;
+	while (lo < hi) {
+		unsigned int mid = lo + (hi - lo) / 2;
+		if (day->trajectories[mid].id < id) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	return ((lo < day->trajectoriesCount) && (day->trajectories[lo].id == id)) ? &day->trajectories[lo] : NULL;
+}
+
+bool PoseTrajectory(const struct DgzDay* day, const struct Trajectory* trajectory, double time, struct AnimalPose* pose) {
+	const struct Segment* segments = &day->segments[trajectory->first];
+	int tick = time * TICKS_PER_DAY;
+	for (int retick = 0; retick < 2; retick++) {
+		if (retick) {
+			time += 1;
+			tick += TICKS_PER_DAY; // wrapping
+		}
+		// the walks follow each other, so the last one started by now is the only one it can be on
+		unsigned int lo = 0, hi = trajectory->count;
+		while (lo < hi) {
+			unsigned int mid = lo + (hi - lo) / 2;
+			if (segments[mid].spawn <= tick) {
+				lo = mid + 1;
+			} else {
+				hi = mid;
+			}
+		}
+		if (lo && (segments[lo - 1].despawn > tick)) {
+			PlaceOnSegment(day, &segments[lo - 1], time, pose);
+			return true;
+		}
+	}
+	return false;
+}
+
+int DgzBucket(double time) {
+	int bucket = (int)(time * TICKS_PER_DAY) / DGZ_BUCKET_TICKS;
+	return (bucket < DGZ_BUCKETS) ? bucket : DGZ_BUCKETS - 1;
+}
+
+unsigned int PoseDayPart(const struct DgzDay* day, double time, enum DGZ_PART part, struct AnimalPose* poses) {
+	unsigned int count = 0;
+	if (day->visible) {
+		int bucket = DgzBucket(time);
+		for (unsigned int i = day->offsets[bucket]; i < day->offsets[bucket + 1]; i++) {
+			count += PoseSegment(day, &day->segments[day->visible[i]], time, part, &poses[count]);
+		}
+		return count;
+	}
+	for (unsigned int i = 0; i < day->segmentsCount; i++) {
+		count += PoseSegment(day, &day->segments[i], time, part, &poses[count]);
+	}
+	return count;
+}
+
+unsigned int PoseAnimals(const struct DgzDay* day, double time, struct AnimalPose* poses) {
+	return PoseDayPart(day, time, DGZ_WHOLE, poses);
+}
+
+unsigned int PoseConsecutiveDays(const struct DgzDay* before, const struct DgzDay* day, double time, struct AnimalPose* poses) {
+	unsigned int overnight = PoseDayPart(before, time, DGZ_OVERNIGHT, poses);
+	unsigned int count = overnight + PoseDayPart(day, time, DGZ_TODAY, &poses[overnight]);
+	if (overnight && day->visible) {
+		// both parts are in order already, but not with each other
+		SortAnimalPoses(poses, count);
+	}
+	return count;
+}
+
+static int ComparePoses(const void* a, const void* b) {
+	const struct Animal* first = ((const struct AnimalPose*)a)->animal;
+	const struct Animal* second = ((const struct AnimalPose*)b)->animal;
+	int ret = first->path->zIndex - second->path->zIndex;
+	if (ret == 0) {
+		ret = AnimalTypeZIndex[first->type] - AnimalTypeZIndex[second->type];
+	}
+	if (ret == 0) {
+		ret = first->id - second->id;
+	}
+	if (ret == 0) {
+		// the same id on two consecutive days; any order will do as long as it stays the same
+		ret = (first > second) - (first < second);
+	}
+	return ret;
+}
+
+void SortAnimalPoses(struct AnimalPose* poses, unsigned int count) {
+	qsort(poses, count, sizeof(struct AnimalPose), ComparePoses);
+}
+
+static int CompareWalks(const void* a, const void* b) {
+	const struct Animal* first = *(const struct Animal* const*)a;
+	const struct Animal* second = *(const struct Animal* const*)b;
+	int ret = first->path->zIndex - second->path->zIndex;
+	if (ret == 0) {
+		ret = AnimalTypeZIndex[first->type] - AnimalTypeZIndex[second->type];
+	}
+	if (ret == 0) {
+		ret = first->id - second->id;
+	}
+	if (ret == 0) {
+		// same animal; only walks that end right away can overlap, and they're never visible
+		ret = first->time.spawn - second->time.spawn;
+	}
+	if (ret == 0) {
+		ret = first->time.despawn - second->time.despawn;
+	}
+	return ret;
+}
+
+// How many buckets, starting at first, a segment can be seen in. Walks past midnight show up in the morning.
+static int BucketSpan(const struct Segment* segment, int* first) {
+	*first = segment->spawn / DGZ_BUCKET_TICKS;
+	int count = (segment->despawn - 1) / DGZ_BUCKET_TICKS - *first + 1;
+	return (count < DGZ_BUCKETS) ? count : DGZ_BUCKETS;
+}
+
+void IndexDgzDay(struct DgzDay* day) {
+	// the walks get sorted through pointers, so that the segments can be told where theirs went
+	const struct Animal** order = malloc((day->count + 1) * sizeof(struct Animal*));
+	for (unsigned int i = 0; i < day->count; i++) {
+		order[i] = &day->animals[i];
+	}
+	qsort(order, day->count, sizeof(struct Animal*), CompareWalks);
+	struct Animal* animals = malloc((day->count + 1) * sizeof(struct Animal));
+	unsigned int* moved = malloc((day->count + 1) * sizeof(unsigned int));
+	for (unsigned int i = 0; i < day->count; i++) {
+		animals[i] = *order[i];
+		moved[order[i] - day->animals] = i;
+	}
+	free(order);
+	free(day->animals);
+	day->animals = animals;
+	for (unsigned int s = 0; s < day->segmentsCount; s++) {
+		day->segments[s].walk = moved[day->segments[s].walk];
+	}
+
+	// from now on, which segment every walk has, if any
+	unsigned int* segmentOf = moved;
+	for (unsigned int i = 0; i < day->count; i++) {
+		segmentOf[i] = UINT32_MAX;
+	}
+	for (unsigned int s = 0; s < day->segmentsCount; s++) {
+		segmentOf[day->segments[s].walk] = s;
+	}
+
+	// counting sort by bucket keeps the back to front order within each bucket
+	unsigned int fill[DGZ_BUCKETS + 1] = {0};
+	for (unsigned int i = 0; i < day->count; i++) {
+		if (segmentOf[i] == UINT32_MAX) {
+			continue;
+		}
+		int first, count = BucketSpan(&day->segments[segmentOf[i]], &first);
+		for (int j = 0; j < count; j++) {
+			fill[(first + j) % DGZ_BUCKETS + 1]++;
+		}
+	}
+	for (int b = 0; b < DGZ_BUCKETS; b++) {
+		fill[b + 1] += fill[b];
+	}
+	memcpy(day->offsets, fill, sizeof(day->offsets));
+	free(day->visible);
+	day->visible = malloc((fill[DGZ_BUCKETS] + 1) * sizeof(unsigned int));
+	for (unsigned int i = 0; i < day->count; i++) {
+		if (segmentOf[i] == UINT32_MAX) {
+			continue;
+		}
+		int first, count = BucketSpan(&day->segments[segmentOf[i]], &first);
+		for (int j = 0; j < count; j++) {
+			day->visible[fill[(first + j) % DGZ_BUCKETS]++] = segmentOf[i];
+		}
+	}
+	free(segmentOf);
+}
@@ -0,0 +1,193 @@
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DGZ_H
+#define DGZ_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// "tick" is the smallest unit of operation
+// (one minute in-game, one second in real life)
+#define TICKS_PER_DAY (24 * 60)
+#define DGZ_PATHS 16 // in one park
+#define DGZ_ENTRANCES 7
+
+enum ANIMAL_TYPE {
+	ANIMAL_OWCA,
+	ANIMAL_OSTRONOS,
+	ANIMAL_DZIK,
+	ANIMAL_TYPES
+};
+
+enum ANIMAL_STATE {
+	ANIMAL_WALKING,
+	ANIMAL_BENCH_LEFT,
+	ANIMAL_BENCH_RIGHT,
+	ANIMAL_BENCH_CENTER
+};
+
+struct Path {
+	double a, b;
+	double start, stop;
+	double length; // how far it is to walk, in the full size park
+	bool bench;
+	bool landmark; // worth a detour
+	int zIndex;
+	unsigned int index; // in the graph
+	unsigned int successorsLeft;
+	unsigned int successorsRight;
+	struct Path* successors[];
+};
+
+// One walk along one path. An animal that keeps going gets a new entry with the same id.
+struct Animal {
+	struct {
+		int spawn, despawn;
+		int depart; // it waits at the start of the path until then
+	} time;
+	enum ANIMAL_STATE state;
+	bool reverse;
+	struct Path* path;
+	enum ANIMAL_TYPE type;
+	double speed;
+	int id;
+};
+
+// Where a visible animal is at some moment. Sitting animals get put on the bench when drawn.
+struct AnimalPose {
+	const struct Animal* animal;
+	const struct Segment* segment; // the walk it's on
+	float x, y;
+	float angle;
+};
+
+// A walk with everything needed to place the animal precomputed, so that posing it is a lerp.
+struct Segment {
+	int spawn, despawn;
+	int depart; // waiting at x0, y0 until then
+	float x0, y0, x1, y1; // where the walk starts and ends
+	float angle; // of the path; animals on the bench sit straight
+	float wobble; // amplitude of the sway while walking, 0 on the bench
+	float sitX, sitY; // top left corner of the sitting sprite, relative to the pose; 0 while walking
+	int id;
+	unsigned int walk; // in the day's animals
+};
+
+// All the walks of one animal, in time order.
+struct Trajectory {
+	int id;
+	unsigned int first, count; // in the day's segments
+};
+
+// Draw order between animals on the same path.
+extern const int AnimalTypeZIndex[ANIMAL_TYPES];
+
+struct DgzParams {
+	double ticksPerAnimal; // average time between two arrivals during the day
+	double benchingTime; // average time spent on the bench
+	int minBenchingTime;
+	double nightSuppression; // how much fewer animals arrive at night
+	double density; // multiplies the arrivals; more than one animal can arrive per tick
+	int spacing; // how many ticks an animal keeps behind the one ahead of it on the same path, 0 lets them walk through each other
+};
+
+extern const struct DgzParams DefaultDgzParams;
+
+#define DGZ_BUCKET_TICKS 8
+#define DGZ_BUCKETS (TICKS_PER_DAY / DGZ_BUCKET_TICKS)
+
+struct DgzDay {
+	struct Animal* animals;
+	unsigned int count;
+	// The walks that can be seen at all, grouped by animal, and the animals ordered by id.
+	struct Segment* segments;
+	unsigned int segmentsCount;
+	struct Trajectory* trajectories;
+	unsigned int trajectoriesCount;
+	// Filled by IndexDgzDay: for every DGZ_BUCKET_TICKS of the day, which segments can be
+	// visible, starting at visible[offsets[bucket]].
+	unsigned int* visible;
+	unsigned int offsets[DGZ_BUCKETS + 1];
+};
+
+enum DESTINATION {
+	DESTINATION_EXIT,
+	DESTINATION_BENCH,
+	DESTINATION_LANDMARK,
+	DESTINATIONS
+};
+
+#define DGZ_NO_ROUTE 0xFF
+
+// The park is made of DGZ_PATHS paths. For stress testing, it can be repeated on a grid of smaller
+// copies that all fit on the screen; each copy has its own entrances and bench.
+struct PathGraph {
+	struct Path** paths;
+	unsigned int count;
+	struct Path** entrances;
+	unsigned int entrancesCount;
+
+	// Every copy is laid out the same, so paths are numbered within their copy here.
+	unsigned char destinations[DESTINATIONS][DGZ_PATHS];
+	unsigned int destinationsCount[DESTINATIONS];
+	// For a path and the end it's walked towards (path * 2 + 1 when walking forward), and for
+	// a destination: which successor on that end is on the shortest way there, or DGZ_NO_ROUTE.
+	// Benches are only on the way to themselves.
+	unsigned char routes[DGZ_PATHS * 2][DGZ_PATHS];
+};
+
+void CreateDgzPaths(struct PathGraph* graph, int tiles);
+void DestroyDgzPaths(struct PathGraph* graph);
+
+// Dynamiczny Generator Zwierzątek™. The day depends only on the params and the seed, and the paths
+// are only read, so any number of days can be generated at once.
+void DGZ(const struct PathGraph* graph, const struct DgzParams* params, uint64_t seed, struct DgzDay* day);
+void FreeDgzDay(struct DgzDay* day);
+// Orders the walks back to front and indexes them by time, so that PoseAnimals only looks at
+// the walks around and returns them the way SortAnimalPoses would.
+void IndexDgzDay(struct DgzDay* day);
+
+// Which bucket of an indexed day covers the time (0..1).
+int DgzBucket(double time);
+// Fills poses (as long as the day) with the animals visible at time (0..1) and returns how many there are.
+// The day loops, so the walks that go on past its midnight show up in its own morning.
+unsigned int PoseAnimals(const struct DgzDay* day, double time, struct AnimalPose* poses);
+
+// Which walks of a day get posed.
+enum DGZ_PART {
+	DGZ_WHOLE, // looping, like PoseAnimals
+	DGZ_TODAY, // only until the midnight
+	DGZ_OVERNIGHT // only the ones going on past the midnight, at the time of the next day
+};
+
+unsigned int PoseDayPart(const struct DgzDay* day, double time, enum DGZ_PART part, struct AnimalPose* poses);
+// The animals of a day that follows another one: its own walks and the ones left over from the day
+// before. poses has to be as long as both days; they come back to front when the days are indexed.
+unsigned int PoseConsecutiveDays(const struct DgzDay* before, const struct DgzDay* day, double time, struct AnimalPose* poses);
+// The trajectory of the animal with the given id, or NULL.
+const struct Trajectory* FindTrajectory(const struct DgzDay* day, int id);
+// Places the animal at time (0..1) by looking up the walk it's on, and returns false when it's
+// not in the park then.
+bool PoseTrajectory(const struct DgzDay* day, const struct Trajectory* trajectory, double time, struct AnimalPose* pose);
+// Back to front: by path, then by animal type, then by id.
+void SortAnimalPoses(struct AnimalPose* poses, unsigned int count);
+
+// 0 during the day, 1 in the middle of the night
+double NightValue(double time);
+
+#endif
@@ -0,0 +1,139 @@
+/*! \file emitters.c
+ *  \brief Ambient particles as closed-form functions of the time of day.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "emitters.h"
+#include "match.h"
+#include <math.h>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+const char* TrajectoryNames[TRAJECTORY_TYPES] = {"linear", "wave"};
+
+static double RandomUnit(uint64_t* rng) {
+	return SplitMix(rng) / (double)UINT32_MAX;
+}
+
+static double RandomSpread(uint64_t* rng, double spread) {
+	return (RandomUnit(rng) * 2 - 1) * spread;
+}
+
+// When (relative to the spawn time) a particle at p moving by v is between lo and hi.
+static void AxisInterval(double p, double v, double lo, double hi, double* from, double* to) {
+	if (v == 0) {
+		bool inside = (p >= lo) && (p <= hi);
+		*from = inside ? -INFINITY : INFINITY;
+		*to = inside ? INFINITY : -INFINITY;
+		return;
+	}
+	double a = (lo - p) / v, b = (hi - p) / v;
+	*from = fmax(*from, fmin(a, b));
+	*to = fmin(*to, fmax(a, b));
+}
+
+static void FindVisibility(struct Particle* particle, float radius) {
+	double margin = radius + fabs(particle->wave);
+	double from = -INFINITY, to = INFINITY;
+	AxisInterval(particle->x, particle->vx, -margin, 1920 + margin, &from, &to);
+	double yFrom = -INFINITY, yTo = INFINITY;
+	AxisInterval(particle->y, particle->vy, -margin, 1080 + margin, &yFrom, &yTo);
+	from = fmax(from, yFrom);
+	to = fmin(to, yTo);
+	if (from >= to) {
+		particle->from = particle->to = 0;
+		return;
+	}
+	// the time of day repeats, so a particle that's slower than that only shows up for one day
+	if (isinf(from)) {
+		from = isinf(to) ? 0 : to - 1;
+	}
+	to = fmin(to, from + 1);
+
+	// keep the window starting within the day; the motion doesn't care which day it happens on
+	double day = floor(particle->spawn + from);
+	particle->spawn -= day;
+	particle->from = particle->spawn + from;
+	particle->to = particle->spawn + to;
+}
+
+void SpawnParticles(const struct Emitter* emitter, unsigned int index, struct Particle* particles) {
+	uint64_t rng = emitter->seed ^ ((uint64_t)index << 32);
+	for (unsigned int i = 0; i < emitter->count; i++) {
+		struct Particle* particle = &particles[i];
+		*particle = (struct Particle){
+			.spawn = emitter->start + RandomUnit(&rng) * (emitter->end - emitter->start),
+			.x = emitter->x + RandomSpread(&rng, emitter->spreadX),
+			.y = emitter->y + RandomSpread(&rng, emitter->spreadY),
+			.vx = emitter->vx + RandomSpread(&rng, emitter->spreadVX),
+			.vy = emitter->vy + RandomSpread(&rng, emitter->spreadVY),
+			.angle = emitter->angle,
+			.spin = emitter->spin + RandomSpread(&rng, emitter->spreadSpin),
+			.wobble = emitter->wobble,
+			.wobbleSpeed = emitter->wobbleSpeed,
+			.wave = (emitter->trajectory == TRAJECTORY_WAVE) ? emitter->wave : 0,
+			.waveSpeed = emitter->waveSpeed,
+			.frameRate = emitter->frameRate,
+			.emitter = index,
+		};
+		if (emitter->scatter) {
+			particle->phase = RandomUnit(&rng) * 2 * M_PI;
+			particle->angle += RandomUnit(&rng) * 2 * M_PI;
+			particle->frameOffset = SplitMix(&rng) % 1024;
+		}
+		FindVisibility(particle, emitter->radius);
+	}
+}
+
+static bool PoseParticle(const struct Particle* particle, double time, struct ParticlePose* pose) {
+	double day = time;
+	if (day < particle->from) {
+		// windows that started before midnight go on in the morning
+		day += 1.0;
+	}
+	if ((day < particle->from) || (day >= particle->to)) {
+		return false;
+	}
+	double t = day - particle->spawn;
+	double x = particle->x + particle->vx * t;
+	double y = particle->y + particle->vy * t;
+	if (particle->wave) {
+		double speed = hypot(particle->vx, particle->vy);
+		double offset = particle->wave * sin(particle->waveSpeed * day + particle->phase);
+		if (speed > 0) {
+			x -= particle->vy / speed * offset;
+			y += particle->vx / speed * offset;
+		}
+	}
+	pose->particle = particle;
+	pose->x = x;
+	pose->y = y;
+	pose->angle = particle->angle + particle->spin * day + particle->wobble * sin(particle->wobbleSpeed * day + particle->phase);
+	pose->frame = (unsigned int)floor(day * particle->frameRate) + (unsigned int)particle->frameOffset;
+	return true;
+}
+
+unsigned int PoseParticles(const struct Particle* particles, unsigned int count, double time, struct ParticlePose* poses) {
+	unsigned int visible = 0;
+	for (unsigned int i = 0; i < count; i++) {
+		visible += PoseParticle(&particles[i], time, &poses[visible]);
+	}
+	return visible;
+}
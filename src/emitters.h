@@ -0,0 +1,72 @@
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef EMITTERS_H
+#define EMITTERS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Particles never get simulated: where one is, how it's turned and which frame it shows are all
+// functions of the time of day (0..1), so the clock can go back and forth freely.
+
+enum TRAJECTORY {
+	TRAJECTORY_LINEAR, // straight through the screen
+	TRAJECTORY_WAVE, // swaying across the direction of flight
+	TRAJECTORY_TYPES
+};
+
+extern const char* TrajectoryNames[TRAJECTORY_TYPES];
+
+struct Emitter {
+	enum TRAJECTORY trajectory;
+	unsigned int count;
+	double start, end; // every particle passes its origin at some point of this window
+	float x, y, spreadX, spreadY; // the origin, in 1920x1080 coordinates
+	float vx, vy, spreadVX, spreadVY; // in pixels per day
+	float angle, spin, spreadSpin; // spin in radians per day
+	float wobble, wobbleSpeed; // angle sways by wobble * sin(wobbleSpeed * time)
+	float wave, waveSpeed; // TRAJECTORY_WAVE only, in pixels
+	float frameRate; // in frames per day
+	bool scatter; // random phases and frames, so that a swarm doesn't move in lockstep
+	float radius; // of the sprite, for telling when it's off the screen
+	uint64_t seed;
+};
+
+struct Particle {
+	float x, y, vx, vy; // at x, y at the time spawn
+	float spawn, from, to; // on the screen between from and to, which is less than a day later
+	float phase;
+	float angle, spin, wobble, wobbleSpeed;
+	float wave, waveSpeed;
+	float frameRate, frameOffset;
+	unsigned int emitter;
+};
+
+struct ParticlePose {
+	const struct Particle* particle;
+	float x, y;
+	float angle;
+	unsigned int frame; // to be taken modulo the frame count of the emitter
+};
+
+// Fills particles (emitter->count of them) for the emitter with the given index.
+void SpawnParticles(const struct Emitter* emitter, unsigned int index, struct Particle* particles);
+// Fills poses with the particles that are on the screen at time (0..1) and returns how many there are.
+unsigned int PoseParticles(const struct Particle* particles, unsigned int count, double time, struct ParticlePose* poses);
+
+#endif
@@ -22,6 +22,7 @@
 #include <libsuperderpy.h>
 #include <math.h>
 
+#define RESOURCE_OWNER "dosowisko"
 #define NEXT_GAMESTATE "holypangolin"
 #define SKIP_GAMESTATE "game"
 
@@ -180,9 +181,9 @@ void* Gamestate_Load(struct Game* game, void (*progress)(struct Game*)) {
 	al_set_new_bitmap_flags(flags ^ ALLEGRO_MAG_LINEAR);
 
 	data->timeline = TM_Init(game, "main");
-	data->bitmap = CreateNotPreservedBitmap(320, 180);
-	data->checkerboard = al_create_bitmap(320, 180);
-	data->pixelator = CreateNotPreservedBitmap(320, 180);
+	data->bitmap = TrackBitmap(game, RESOURCE_OWNER, CreateNotPreservedBitmap(320, 180));
+	data->checkerboard = TrackBitmap(game, RESOURCE_OWNER, al_create_bitmap(320, 180));
+	data->pixelator = TrackBitmap(game, RESOURCE_OWNER, CreateNotPreservedBitmap(320, 180));
 
 	al_set_target_bitmap(data->checkerboard);
 	al_lock_bitmap(data->checkerboard, ALLEGRO_PIXEL_FORMAT_ANY, ALLEGRO_LOCK_WRITEONLY);
@@ -199,22 +200,22 @@ void* Gamestate_Load(struct Game* game, void (*progress)(struct Game*)) {
 	al_set_target_backbuffer(game->display);
 	(*progress)(game);
 
-	data->font = al_load_ttf_font(GetDataFilePath(game, "fonts/DejaVuSansMono.ttf"),
-	  (int)(180 * 0.1666 / 8) * 8, 0);
+	data->font = TrackFont(game, RESOURCE_OWNER, al_load_ttf_font(GetDataFilePath(game, "fonts/DejaVuSansMono.ttf"),
+	  (int)(180 * 0.1666 / 8) * 8, 0));
 	(*progress)(game);
-	data->sample = al_load_sample(GetDataFilePath(game, "dosowisko.flac"));
+	data->sample = TrackSample(game, RESOURCE_OWNER, al_load_sample(GetDataFilePath(game, "dosowisko.flac")));
 	data->sound = al_create_sample_instance(data->sample);
 	al_attach_sample_instance_to_mixer(data->sound, game->audio.music);
 	al_set_sample_instance_playmode(data->sound, ALLEGRO_PLAYMODE_ONCE);
 	(*progress)(game);
 
-	data->kbd_sample = al_load_sample(GetDataFilePath(game, "kbd.flac"));
+	data->kbd_sample = TrackSample(game, RESOURCE_OWNER, al_load_sample(GetDataFilePath(game, "kbd.flac")));
 	data->kbd = al_create_sample_instance(data->kbd_sample);
 	al_attach_sample_instance_to_mixer(data->kbd, game->audio.fx);
 	al_set_sample_instance_playmode(data->kbd, ALLEGRO_PLAYMODE_ONCE);
 	(*progress)(game);
 
-	data->key_sample = al_load_sample(GetDataFilePath(game, "key.flac"));
+	data->key_sample = TrackSample(game, RESOURCE_OWNER, al_load_sample(GetDataFilePath(game, "key.flac")));
 	data->key = al_create_sample_instance(data->key_sample);
 	al_attach_sample_instance_to_mixer(data->key, game->audio.fx);
 	al_set_sample_instance_playmode(data->key, ALLEGRO_PLAYMODE_ONCE);
@@ -232,23 +233,27 @@ void Gamestate_Stop(struct Game* game, struct GamestateResources* data) {
 }
 
 void Gamestate_Unload(struct Game* game, struct GamestateResources* data) {
-	al_destroy_font(data->font);
+	PrintResourceReport(game, RESOURCE_OWNER);
+	DestroyTrackedFont(game, data->font);
 	al_destroy_sample_instance(data->sound);
-	al_destroy_sample(data->sample);
+	DestroyTrackedSample(game, data->sample);
 	al_destroy_sample_instance(data->kbd);
-	al_destroy_sample(data->kbd_sample);
+	DestroyTrackedSample(game, data->kbd_sample);
 	al_destroy_sample_instance(data->key);
-	al_destroy_sample(data->key_sample);
-	al_destroy_bitmap(data->bitmap);
-	al_destroy_bitmap(data->checkerboard);
-	al_destroy_bitmap(data->pixelator);
+	DestroyTrackedSample(game, data->key_sample);
+	DestroyTrackedBitmap(game, data->bitmap);
+	DestroyTrackedBitmap(game, data->checkerboard);
+	DestroyTrackedBitmap(game, data->pixelator);
 	TM_Destroy(data->timeline);
+	ReportResourceLeaks(game, RESOURCE_OWNER);
 	free(data);
 }
 
 void Gamestate_Reload(struct Game* game, struct GamestateResources* data) {
-	data->bitmap = CreateNotPreservedBitmap(320, 180);
-	data->pixelator = CreateNotPreservedBitmap(320, 180);
+	DestroyTrackedBitmap(game, data->bitmap);
+	DestroyTrackedBitmap(game, data->pixelator);
+	data->bitmap = TrackBitmap(game, RESOURCE_OWNER, CreateNotPreservedBitmap(320, 180));
+	data->pixelator = TrackBitmap(game, RESOURCE_OWNER, CreateNotPreservedBitmap(320, 180));
 }
 
 void Gamestate_Pause(struct Game* game, struct GamestateResources* data) {
@@ -19,51 +19,47 @@
  */
 
 #include "../common.h"
+#include "../animalbuffer.h"
+#include "../audioramp.h"
+#include "../dayring.h"
+#include "../dgz.h"
+#include "../gputimer.h"
+#include "../inputlatency.h"
+#include "../matchthread.h"
+#include "../particles.h"
+#include "../sfx.h"
+#include "../spectate.h"
+#include "../stats.h"
 #include <libsuperderpy.h>
 #include <math.h>
 
+#define RESOURCE_OWNER "game"
+
 struct AnimalRes {
 	ALLEGRO_BITMAP *bitmap, *bitmap_sitting;
-	int benchPos;
-	int zIndex;
 };
 
-enum ANIMAL_STATE {
-	ANIMAL_WALKING,
-	ANIMAL_BENCH_LEFT,
-	ANIMAL_BENCH_RIGHT,
-	ANIMAL_BENCH_CENTER
+enum VHS_VARIANT {
+	VHS_FULL,
+	VHS_LIGHT,
+	VHS_PASSTHROUGH,
+	VHS_VARIANTS
 };
 
-struct Path {
-	double a, b;
-	double start, stop;
-	bool bench;
-	int zIndex;
-	unsigned int successorsLeft;
-	unsigned int successorsRight;
-	struct Path* successors[];
-};
+#define MAX_VIEWS 4
 
-struct Animal {
-	struct {
-		int spawn, despawn;
-	} time;
-	enum ANIMAL_STATE state;
-	bool reverse;
-	struct Path* path;
-	struct AnimalRes* type;
-	double speed;
-	int id;
+enum GPU_PASS {
+	PASS_COMPOSITE,
+	PASS_VIEWS, // followed by the scene and VHS passes of every view
+	PASSES = PASS_VIEWS + MAX_VIEWS * 2
 };
+_Static_assert(PASSES <= GPU_TIMER_MAX_PASSES, "every view needs its GPU timers");
 
-struct DrawCommand {
-	struct Animal* animal;
-	ALLEGRO_BITMAP* bitmap;
-	float cx, cy;
-	float x, y;
-	float angle;
-	int flags;
+// A vertical strip of the screen, showing the same strip of the park at a time of its own.
+struct View {
+	int player; // whose clock it follows
+	double lag; // behind that clock, in days
+	float xScanline2, timeOffset; // so that the views don't glitch in sync
 };
 
 struct GamestateResources {
@@ -72,765 +68,795 @@ struct GamestateResources {
 	int counter;
 
 	ALLEGRO_FONT *big, *small, *scorefont;
-	ALLEGRO_SHADER* shader;
-	ALLEGRO_BITMAP *bg, *bg2, *fg, *fg2, *target, *frame, *scene, *bee1, *bee2, *bee3, *title, *key1, *key2, *arrow1, *arrow2;
+	ALLEGRO_SHADER* shaders[VHS_VARIANTS];
+	ALLEGRO_BITMAP* noise;
+	enum VHS_VARIANT vhsQuality; // the most expensive variant that's allowed
+	ALLEGRO_BITMAP *bg, *bg2, *fg, *fg2, *target, *frame, *scene, *title, *key1, *key2, *arrow1, *arrow2;
 
 	ALLEGRO_SAMPLE *yay1s, *yay2s, *yay3s, *balls;
-	ALLEGRO_SAMPLE_INSTANCE *yay1, *yay2, *yay3, *ballsound;
+	struct SfxPool* sfx;
 
 	ALLEGRO_AUDIO_STREAM *day1, *day2, *night1, *night2, *rewind, *music;
+	struct {
+		struct AudioRamp *day1, *day2, *night1, *night2, *rewind;
+	} ramps;
 
 	ALLEGRO_BITMAP *clock1, *clock2, *clockball1, *clockball2, *hand1, *hand2, *ball, *trees, *tree, *scores, *scorebmp;
 
-	struct AnimalRes dzik, ostronos, owca, leaf;
-
-	float fade_left, fade_right;
-	bool forward_left, forward_right;
-	bool backward_left, backward_right;
-	bool lastbackward_left, lastbackward_right;
+	// pre-downscaled variants of the full screen layers, used at low render scales
+	ALLEGRO_BITMAP *bg_half, *bg2_half, *fg_half, *fg2_half, *trees_half;
 
-	double time_left, time_right;
+	struct AnimalRes dzik, ostronos, owca;
+	struct AnimalRes* animalTypes[ANIMAL_TYPES];
 
-	bool left_buttons, right_buttons;
+	struct View views[MAX_VIEWS];
+	int viewCount; // [nowandthen] viewports
 
-	float dx, dy;
+	struct MatchState match; // a copy of the newest snapshot when the match has its own thread
+	struct MatchThread* matchThread; // NULL when the match is stepped in Gamestate_Logic
+	struct Netplay* netplay;
+	struct SpectateServer* spectateServer;
+	struct SpectateClient* spectateClient;
+	uint64_t dgzSeed;
+	unsigned char keys[MATCH_PLAYERS]; // currently held
+	unsigned char pressed[MATCH_PLAYERS]; // since the last tick
+	double pressedAt[MATCH_PLAYERS], releasedAt[MATCH_PLAYERS]; // when the clock keys last went down and up
+	double lastTick; // when the match was last stepped here
+	struct InputLatency* latency; // NULL unless [nowandthen] input_latency
+	bool latencyMarker; // [nowandthen] latency_marker, for a photodiode
 
-	int score;
-	int delay;
-
-	float ballx, bally, ballrot;
-
-	int cooldown;
+	bool left_buttons, right_buttons;
 
-	bool started;
+	struct {
+		bool enabled;
+		double idleFps;
+		int idleTicks;
+		bool invalidated;
+		double lastRender;
 
-	bool scoreleft;
-	bool lastleft;
+		int frames, renders;
+		double drawTime, reportTime;
+	} pacing;
 
-	int shakeleft;
-	int shakeright;
+	struct {
+		double scale; // of the scene, relative to 1920x1080
+		double min, max;
+		bool dynamic;
+		double targetFps;
+		double cost; // of drawing the views, smoothed; not the frame time, which vsync stretches
+		double nextAdjust, lastIncrease, increaseDelay;
+	} render;
 
-	int leftscore, rightscore;
+	struct GpuTimers* gpuTimers;
+	ALLEGRO_BITMAP* output; // replaces the backbuffer when rendering offscreen
 
-	struct Animal* animals;
-	struct DrawCommand* drawCommandBuffer;
-	unsigned int animalsCount;
-	unsigned int animalsAllocated;
+	struct {
+		bool enabled;
+		int passes[VHS_VARIANTS];
+		double time[VHS_VARIANTS];
+		double reportTime;
+	} vhsProfile;
 
-	int curId;
+	struct {
+		struct DayRing* ring;
+		bool rolling; // [nowandthen] rolling_days; otherwise day 0 loops forever
+		bool wait; // for the benchmark, which has to draw the same frames every time
+		int number[MAX_VIEWS]; // which day each view is on
+		double lastTime[MAX_VIEWS];
+		// the day before and the current one for every view, as of the last sync, or NULL when not there yet
+		const struct DaySlot* shown[MAX_VIEWS][2];
+	} days;
+	struct AnimalBuffer* animalBuffer; // NULL when drawing the poses one by one
+	struct ParticleSystem* particles;
+	struct AnimalPose* poses; // filled when drawing
+	unsigned int posesCount;
+	struct DgzParams dgzParams;
+
+	struct PathGraph paths;
 
-	struct Path* paths[16];
+	struct {
+		bool enabled; // [nowandthen] crowd_stress
+		int frames, views, slow;
+		unsigned int posed;
+		double pose, submit, worstView; // CPU time spent on the animals
+		double frameTime, worstFrame, lastFrame;
+		double reportTime;
+	} stress;
 };
 
-// "tick" is the smallest unit of operation
-// (one minute in-game, one second in real life)
-#define TICKS_PER_DAY (24 * 60)
-#define AVG_TICKS_PER_ANIMAL 16
-#define AVG_BENCHING_TIME 32
-#define MIN_BENCHING_TIME 5
-#define AT_NIGHT_SUPPRESSION 0.5
-#define SCREENSHAKE 20
-
-int Gamestate_ProgressCount = 42; // number of loading steps as reported by Gamestate_Load
+#define IDLE_GRACE_TICKS 30
+#define RENDER_SCALE_STEP 0.0625
+#define AUDIO_RAMP_TIME (1.0 / 60) // one logic tick
+#define HALF_LAYER_SCALE 0.75
+// How far sideways the VHS shader can sample: the distortions and the color bleed, as a fraction
+// of the width, plus the analog jitter, in target pixels.
+#define VHS_REACH 0.125
+#define VHS_JITTER 14
+#define LATENCY_MARKER_SIZE 48 // in the corner, for a photodiode to sit on
+
+static const char* vhsVariantNames[VHS_VARIANTS] = {"full", "light", "passthrough"};
+static const char* passNames[PASSES] = {"composite", "scene-0", "vhs-0", "scene-1", "vhs-1", "scene-2", "vhs-2", "scene-3", "vhs-3"};
+static const char* vhsVariantDefines[VHS_VARIANTS] = {"#define VHS_FULL\n", "#define VHS_LIGHT\n", "#define VHS_PASSTHROUGH\n"};
+
+int Gamestate_ProgressCount = 39; // number of loading steps as reported by Gamestate_Load
+
+static void RegenerateAnimals(struct Game* game, struct GamestateResources* data, uint64_t seed);
+static void SyncDays(struct Game* game, struct GamestateResources* data);
+static void RunRenderBenchmark(struct Game* game, struct GamestateResources* data);
+
+static unsigned char PeekInput(struct GamestateResources* data, int player) {
+	// a press shorter than a tick still counts
+	return data->keys[player] | data->pressed[player];
+}
 
-static bool IsBetween(float val, float lim1, float lim2) {
-	return ((val >= lim1) && (val <= lim2)) || ((val >= lim2) && (val <= lim1));
+static unsigned char TakeInput(struct GamestateResources* data, int player) {
+	unsigned char input = PeekInput(data, player);
+	data->pressed[player] = 0;
+	return input;
 }
 
-static double NightValue(double time) {
-	double night = 0;
-	if ((time > 0.25) && (time < 0.5)) {
-		night = (time - 0.25) * 4;
-		if (night < 0.5) {
-			night = fmin(night * 5, 1.0);
-		} else {
-			night = 1.0 - fmax((night - 0.5) * 2, 0.0);
-		}
+static void PressKey(struct GamestateResources* data, int player, unsigned char key, double timestamp) {
+	if (data->matchThread) {
+		PressMatchInput(data->matchThread, player, key, timestamp);
+		return;
 	}
-	return night;
+	data->keys[player] |= key;
+	data->pressed[player] |= key;
+	data->pressedAt[player] = timestamp;
 }
 
-static bool CheckCollision(struct Game* game, struct GamestateResources* data, int Px, int Py, int Pw, double angle, double speed) {
-	//	PrintConsole(game, "sizeof %d", sizeof(paths.successors)/sizeof(paths.successors[0]));
-	if (data->cooldown) {
-		return false;
+static void ReleaseKey(struct GamestateResources* data, int player, unsigned char key, double timestamp) {
+	if (data->matchThread) {
+		ReleaseMatchInput(data->matchThread, player, key, timestamp);
+		return;
 	}
+	data->keys[player] &= ~key;
+	data->releasedAt[player] = timestamp;
+}
 
-	float m = data->ballx, n = data->bally, r = 42;
-	//	float angle = data->time_right * 4 * ALLEGRO_PI * 24;
-	float a = tan(angle);
-	//	int Px = 1672, Py = 879, Pw = 138;
-	float b = Py - a * Px;
-	float x1 = (sqrt(-a * a * m * m + a * a * r * r - 2 * a * b * m + 2 * a * m * n - b * b + 2 * b * n - n * n + r * r) - a * b + a * n + m) / (a * a + 1);
-	float x2 = (-sqrt(-a * a * m * m + a * a * r * r - 2 * a * b * m + 2 * a * m * n - b * b + 2 * b * n - n * n + r * r) - a * b + a * n + m) / (a * a + 1);
-	float y1 = a * x1 + b;
-	float y2 = a * x2 + b;
-
-	int xlim = Px + cos(angle) * Pw;
-
-	//al_draw_line(xlim, 0, xlim, 1080, al_map_rgb(0,255,255), 1);
-
-	if ((!isnan(x1)) && (IsBetween(x1, Px, xlim))) {
-		//al_draw_filled_circle(x1, y1, 10, al_map_rgb(0,255,255));
-		data->dx = -data->dx * (1.03 + speed / 6.0);
-		//data->ballx += data->dx * 4;
-
-		data->dy = ((n - y1) / fabs(n - y1)) * 5.0;
-		data->dy *= 1.0 + ((speed / 8.0) + (rand() / (float)RAND_MAX) / 12.0) / 4.0;
-
-		//PrintConsole(game, "dx %f, dy %f", data->dx, data->dy);
-
-		data->cooldown = 10;
-		al_set_sample_instance_speed(data->ballsound, 0.9 + (rand() / (float)RAND_MAX) * 0.2);
-		al_play_sample_instance(data->ballsound);
-
-		return true;
+static void HandleMatchEvents(struct Game* game, struct GamestateResources* data, struct MatchEvents* events) {
+	if (data->spectateServer) {
+		NoteSpectateEvents(data->spectateServer, events);
 	}
-	if ((!isnan(x2)) && (IsBetween(x2, Px, xlim))) {
-		//al_draw_filled_circle(x2, y2, 10, al_map_rgb(0,255,255));
-		data->dx = -data->dx * (1.03 + speed / 6.0);
-		//data->ballx += data->dx * 4;
-
-		data->dy = ((n - y2) / fabs(n - y2)) * 5.0;
-		data->dy *= 1.0 + ((speed / 8.0) + (rand() / (float)RAND_MAX) / 12.0) / 4.0;
-
-		//PrintConsole(game, "dx %f, dy %f", data->dx, data->dy);
+	if (events->flags & EVENT_STARTED) {
+		al_rewind_audio_stream(data->music);
+		al_set_audio_stream_playing(data->music, true);
+	}
+	if (events->flags & EVENT_HIT) {
+		PlaySfx(data->sfx, data->balls, 2.2, events->hitSpeed);
+	}
+	if (events->flags & EVENT_POINT) {
+		PrintConsole(game, "POINT FOR %s %d", events->pointLeft ? "LEFT" : "RIGHT", events->score);
+		ALLEGRO_SAMPLE* yays[3] = {data->yay1s, data->yay2s, data->yay3s};
+		PlaySfx(data->sfx, yays[events->yay], 2.2, 1.0);
+
+		ALLEGRO_BITMAP* target = al_get_target_bitmap();
+		al_set_target_bitmap(data->scorebmp);
+		al_clear_to_color(al_map_rgba(0, 0, 0, 0));
+
+		al_draw_textf(data->scorefont, al_map_rgb(0, 0, 0), 1920 / 2 - 6, 450 - 6, ALLEGRO_ALIGN_CENTER, "%d", events->score);
+		al_draw_textf(data->scorefont, al_map_rgb(0, 0, 0), 1920 / 2 + 6, 450 + 6, ALLEGRO_ALIGN_CENTER, "%d", events->score);
+		al_draw_textf(data->scorefont, al_map_rgb(0, 0, 0), 1920 / 2 - 6, 450 + 6, ALLEGRO_ALIGN_CENTER, "%d", events->score);
+		al_draw_textf(data->scorefont, al_map_rgb(0, 0, 0), 1920 / 2 + 6, 450 - 6, ALLEGRO_ALIGN_CENTER, "%d", events->score);
+		al_draw_textf(data->scorefont, al_map_rgb(0, 0, 0), 1920 / 2 + 0, 450 + 6, ALLEGRO_ALIGN_CENTER, "%d", events->score);
+		al_draw_textf(data->scorefont, al_map_rgb(0, 0, 0), 1920 / 2 + 0, 450 - 6, ALLEGRO_ALIGN_CENTER, "%d", events->score);
+		al_draw_textf(data->scorefont, al_map_rgb(0, 0, 0), 1920 / 2 + 6, 450 + 0, ALLEGRO_ALIGN_CENTER, "%d", events->score);
+		al_draw_textf(data->scorefont, al_map_rgb(0, 0, 0), 1920 / 2 - 6, 450 + 0, ALLEGRO_ALIGN_CENTER, "%d", events->score);
+		al_draw_textf(data->scorefont, al_map_rgb(255, 255, 255), 1920 / 2, 450, ALLEGRO_ALIGN_CENTER, "%d", events->score);
+
+		al_set_target_bitmap(target);
+	}
+	if (events->flags & EVENT_FINISHED) {
+		al_set_audio_stream_playing(data->music, false);
+	}
+	if (events->flags & EVENT_SCORE_SIDE) {
+		PrintConsole(game, data->match.scoreleft ? "score left" : "score right");
+	}
+}
 
-		data->cooldown = 10;
+static double ViewTime(struct GamestateResources* data, int view) {
+	double time = data->match.time[data->views[view].player] - data->views[view].lag;
+	return (time < 0) ? time + 1 : time;
+}
 
-		al_play_sample_instance(data->ballsound);
-		return true;
+// Counts the days as the views go past midnight, either way.
+static void FollowClocks(struct GamestateResources* data) {
+	for (int view = 0; view < data->viewCount; view++) {
+		double time = ViewTime(data, view);
+		if (data->days.rolling) {
+			if (time < data->days.lastTime[view] - 0.5) {
+				data->days.number[view]++;
+			} else if (time > data->days.lastTime[view] + 0.5) {
+				data->days.number[view]--;
+			}
+		}
+		data->days.lastTime[view] = time;
 	}
-	return false;
 }
 
 void Gamestate_Logic(struct Game* game, struct GamestateResources* data) {
 	// Called 60 times per second. Here you should do all your game logic.
-	data->counter++;
-
-	al_set_audio_stream_gain(data->rewind, fmax(data->fade_left, data->fade_right) * 2);
-	al_set_audio_stream_speed(data->rewind, fmax(0.01, fmax(data->fade_left, data->fade_right)));
-
-	data->ballrot += 0.02 + fabs(data->dx) * 0.0025 + fabs(data->dy) * 0.0025;
-
-	if (data->delay >= 0) {
-		data->delay--;
+	if (game->data->benchmark.frames) {
+		RunRenderBenchmark(game, data);
+		return;
 	}
-	if (data->shakeleft > 0) {
-		data->shakeleft--;
-	}
-	if (data->shakeright > 0) {
-		data->shakeright--;
+	data->counter++;
+	if (data->latency) {
+		NoteLatencyFlip(game, data->latency, al_get_time(), 0);
 	}
 
-	if ((data->bally > (1080 + 42)) || (data->ballx < -42) || (data->ballx > (1920 + 42))) {
-		if (data->delay == -1) {
-			if (data->scoreleft) {
-				PrintConsole(game, "POINT FOR LEFT %d", data->score);
-				data->leftscore++;
-				data->shakeright = SCREENSHAKE;
-			} else {
-				PrintConsole(game, "POINT FOR RIGHT %d", data->score);
-				data->rightscore++;
-				data->shakeleft = SCREENSHAKE;
+	double lastTime = data->match.time[0];
+	struct MatchEvents events;
+	if (data->spectateClient) {
+		// keep moving between frames, and take whatever the server says when a frame arrives;
+		// only the server knows what really happened, so the prediction stays silent
+		struct MatchEvents predicted;
+		StepMatch(&data->match, data->match.lastInput, &predicted);
+		memset(&events, 0, sizeof(events));
+		struct SpectateFrame* frame = ReceiveSpectate(data->spectateClient, al_get_time());
+		if (frame) {
+			data->match = frame->state;
+			TakeSpectateEvents(data->spectateClient, frame, &events);
+			if (frame->seed != data->dgzSeed) {
+				RegenerateAnimals(game, data, frame->seed);
+			}
+		}
+	} else if (data->netplay) {
+		// the local player can use either set of keys
+		// a tap stays latched while the tick waits for the peer
+		unsigned char input = PeekInput(data, 0) | PeekInput(data, 1);
+		if (AdvanceNetplay(game, data->netplay, &data->match, input, &events)) {
+			TakeInput(data, 0);
+			TakeInput(data, 1);
+		}
+		if (data->netplay->connected && (data->netplay->seed != data->dgzSeed)) {
+			RegenerateAnimals(game, data, data->netplay->seed);
+		}
+	} else if (data->matchThread) {
+		// the match goes on by itself; take whatever it got to and everything that happened on the way
+		const struct MatchSnapshot* snapshot = TakeMatchSnapshot(data->matchThread);
+		data->match = snapshot->match;
+		while (TakeMatchEvents(data->matchThread, snapshot->tick, &events)) {
+			HandleMatchEvents(game, data, &events);
+		}
+		events.flags = 0;
+		if (data->latency) {
+			for (int i = 0; i < MATCH_PLAYERS; i++) {
+				NoteLatencyTick(data->latency, i, snapshot->taken[i], snapshot->takenAt[i]);
 			}
-			ALLEGRO_SAMPLE_INSTANCE* yays[3] = {data->yay1, data->yay2, data->yay3};
-			al_play_sample_instance(yays[rand() % 3]);
-
-			ALLEGRO_BITMAP* target = al_get_target_bitmap();
-			al_set_target_bitmap(data->scorebmp);
-			al_clear_to_color(al_map_rgba(0, 0, 0, 0));
-
-			al_draw_textf(data->scorefont, al_map_rgb(0, 0, 0), 1920 / 2 - 6, 450 - 6, ALLEGRO_ALIGN_CENTER, "%d", data->score);
-			al_draw_textf(data->scorefont, al_map_rgb(0, 0, 0), 1920 / 2 + 6, 450 + 6, ALLEGRO_ALIGN_CENTER, "%d", data->score);
-			al_draw_textf(data->scorefont, al_map_rgb(0, 0, 0), 1920 / 2 - 6, 450 + 6, ALLEGRO_ALIGN_CENTER, "%d", data->score);
-			al_draw_textf(data->scorefont, al_map_rgb(0, 0, 0), 1920 / 2 + 6, 450 - 6, ALLEGRO_ALIGN_CENTER, "%d", data->score);
-			al_draw_textf(data->scorefont, al_map_rgb(0, 0, 0), 1920 / 2 + 0, 450 + 6, ALLEGRO_ALIGN_CENTER, "%d", data->score);
-			al_draw_textf(data->scorefont, al_map_rgb(0, 0, 0), 1920 / 2 + 0, 450 - 6, ALLEGRO_ALIGN_CENTER, "%d", data->score);
-			al_draw_textf(data->scorefont, al_map_rgb(0, 0, 0), 1920 / 2 + 6, 450 + 0, ALLEGRO_ALIGN_CENTER, "%d", data->score);
-			al_draw_textf(data->scorefont, al_map_rgb(0, 0, 0), 1920 / 2 - 6, 450 + 0, ALLEGRO_ALIGN_CENTER, "%d", data->score);
-			al_draw_textf(data->scorefont, al_map_rgb(255, 255, 255), 1920 / 2, 450, ALLEGRO_ALIGN_CENTER, "%d", data->score);
-
-			al_set_target_bitmap(target);
-
-			data->delay = 120;
-		} else if (data->delay == 60) {
-			data->dx = 12 * (((rand() % 2) * 2) - 1);
-			data->dy = 4;
-			data->ballx = 1920 / 2 - 10;
-			data->bally = 1080 / 2 - 100;
-			data->started = true;
-			data->scoreleft = (data->dx < 0);
-			data->lastleft = data->scoreleft;
-			data->score = 0;
 		}
+	} else {
+		unsigned char inputs[MATCH_PLAYERS] = {TakeInput(data, 0), TakeInput(data, 1)};
+		double now = al_get_time();
+		struct InputPhases phases[MATCH_PLAYERS];
+		for (int i = 0; i < MATCH_PLAYERS; i++) {
+			phases[i] = (struct InputPhases){.pressed = TickPhase(data->pressedAt[i], data->lastTick, now), .released = TickPhase(data->releasedAt[i], data->lastTick, now), .held = data->keys[i]};
+			if (data->latency) {
+				NoteLatencyTick(data->latency, i, data->pressedAt[i], now);
+			}
+		}
+		data->lastTick = now;
+		StepMatchWithPhases(&data->match, &DefaultMatchRules, inputs, phases, &events);
 	}
-
-	if ((data->leftscore >= 10) || (data->rightscore >= 10)) {
-		data->started = false;
-		al_set_audio_stream_playing(data->music, false);
+	HandleMatchEvents(game, data, &events);
+	if (data->spectateServer) {
+		BroadcastSpectate(data->spectateServer, &data->match, data->dgzSeed, al_get_time());
 	}
-
-	double night = NightValue(data->time_left);
-	al_set_audio_stream_gain(data->day1, 1.0 - night);
-	al_set_audio_stream_gain(data->night1, night);
-	al_set_audio_stream_speed(data->day1, 1.0 + data->fade_left);
-	al_set_audio_stream_speed(data->night1, 1.0 + data->fade_left);
-
-	night = NightValue(data->time_right);
-	al_set_audio_stream_gain(data->day2, 1.0 - night);
-	al_set_audio_stream_gain(data->night2, night);
-	al_set_audio_stream_speed(data->day2, 1.0 + data->fade_right);
-	al_set_audio_stream_speed(data->night2, 1.0 + data->fade_right);
-
-	if (data->started) {
-		data->ballx += data->dx;
-		data->bally += data->dy;
-
-		data->dy += 0.1;
-		//		data->dx += 0.005 * ((data->dx > 0) ? -1 : 1);
+	FollowClocks(data);
+	SyncDays(game, data);
+
+	RampAudioGain(data->ramps.rewind, fmax(data->match.fade[0], data->match.fade[1]) * 2, AUDIO_RAMP_TIME);
+	SetAudioSpeed(data->ramps.rewind, fmax(0.01, fmax(data->match.fade[0], data->match.fade[1])));
+	UpdateAudioVoice(data->ramps.rewind, AUDIO_RAMP_TIME);
+
+	double night = NightValue(data->match.time[0]);
+	RampAudioGain(data->ramps.day1, 1.0 - night, AUDIO_RAMP_TIME);
+	RampAudioGain(data->ramps.night1, night, AUDIO_RAMP_TIME);
+	SetAudioSpeed(data->ramps.day1, 1.0 + data->match.fade[0]);
+	SetAudioSpeed(data->ramps.night1, 1.0 + data->match.fade[0]);
+	UpdateAudioVoice(data->ramps.day1, AUDIO_RAMP_TIME);
+	UpdateAudioVoice(data->ramps.night1, AUDIO_RAMP_TIME);
+
+	night = NightValue(data->match.time[1]);
+	RampAudioGain(data->ramps.day2, 1.0 - night, AUDIO_RAMP_TIME);
+	RampAudioGain(data->ramps.night2, night, AUDIO_RAMP_TIME);
+	SetAudioSpeed(data->ramps.day2, 1.0 + data->match.fade[1]);
+	SetAudioSpeed(data->ramps.night2, 1.0 + data->match.fade[1]);
+	UpdateAudioVoice(data->ramps.day2, AUDIO_RAMP_TIME);
+	UpdateAudioVoice(data->ramps.night2, AUDIO_RAMP_TIME);
+
+	if (game->config.debug && (data->match.time[0] < lastTime - 0.5)) {
+		// the left clock went past midnight
+		struct AudioRamp* ramps[] = {data->ramps.day1, data->ramps.day2, data->ramps.night1, data->ramps.night2, data->ramps.rewind};
+		PrintAudioVoiceStats(game, ramps, sizeof(ramps) / sizeof(ramps[0]));
 	}
 
-	float x1 = data->ballx, y1 = data->bally;
-	if (data->scoreleft) {
-		float x2 = 223, y2 = 875;
-		if ((sqrt(pow(x2 - x1, 2) + pow(y2 - y1, 2))) <= (42 + 150)) {
-			PrintConsole(game, "score right");
-			data->scoreleft = false;
-		}
+	struct MatchState* match = &data->match;
+	if (!match->started && !match->fade[0] && !match->fade[1] && (match->delay == -1) && !match->shake[0] && !match->shake[1]) {
+		data->pacing.idleTicks++;
 	} else {
-		float x2 = 1672, y2 = 879;
-		if ((sqrt(pow(x2 - x1, 2) + pow(y2 - y1, 2))) <= (42 + 150)) {
-			PrintConsole(game, "score left");
-			data->scoreleft = true;
-		}
+		data->pacing.idleTicks = 0;
 	}
+}
 
-	data->time_left += 1.0 / 24.0 / 60.0 / 60.0;
-	data->time_right += 1.0 / 24.0 / 60.0 / 60.0;
-
-	data->time_left += (1.0 / 24.0 / 60.0) * (data->lastbackward_left ? -data->fade_left : data->fade_left);
-	data->time_right += (1.0 / 24.0 / 60.0) * (data->lastbackward_right ? -data->fade_right : data->fade_right);
-
-	if (data->time_left > 1) {
-		data->time_left -= 1;
-	}
-	if (data->time_right > 1) {
-		data->time_right -= 1;
+static void UploadShownDays(struct Game* game, struct GamestateResources* data) {
+	if (!data->animalBuffer) {
+		return;
 	}
-	if (data->time_left < 0) {
-		data->time_left += 1;
+	for (int i = 0; i < ANIMAL_BUFFER_DAYS; i++) {
+		const struct DgzDay* day = data->animalBuffer->days[i].day;
+		bool shown = false;
+		for (int view = 0; view < data->viewCount; view++) {
+			for (int j = 0; j < 2; j++) {
+				shown |= data->days.shown[view][j] && (day == &data->days.shown[view][j]->day);
+			}
+		}
+		if (!shown) {
+			ForgetAnimals(data->animalBuffer, day);
+		}
 	}
-	if (data->time_right < 0) {
-		data->time_right += 1;
+	for (int view = 0; view < data->viewCount; view++) {
+		for (int j = 0; j < 2; j++) {
+			if (data->days.shown[view][j] && !UploadAnimals(game, data->animalBuffer, &data->days.shown[view][j]->day)) {
+				DestroyAnimalBuffer(game, data->animalBuffer);
+				data->animalBuffer = NULL;
+				return;
+			}
+		}
 	}
+}
 
-	if (data->cooldown) {
-		data->cooldown--;
+// Keeps the days around the views generated and picks the ones they draw. Days are only
+// ever freed in here, so whatever the views got stays there until the next tick.
+static void SyncDays(struct Game* game, struct GamestateResources* data) {
+	// the current days first, then the ones before them for the mornings, then the next ones
+	int wanted[MAX_VIEWS * 3];
+	unsigned int count = 0;
+	static const int offsets[3] = {0, -1, 1};
+	for (int o = 0; o < (data->days.rolling ? 3 : 1); o++) {
+		for (int view = 0; view < data->viewCount; view++) {
+			int number = data->days.number[view] + offsets[o];
+			bool duplicate = false;
+			for (unsigned int i = 0; i < count; i++) {
+				duplicate |= wanted[i] == number;
+			}
+			if (!duplicate) {
+				wanted[count++] = number;
+			}
+		}
 	}
 
-	bool left = false;
-	left = left || CheckCollision(game, data, 1672, 879, 115, data->time_right * 4 * ALLEGRO_PI, data->fade_right);
-	left = left || CheckCollision(game, data, 1672, 879, 138, data->time_right * 4 * ALLEGRO_PI * 24, data->fade_right / 10.0);
-
-	bool right = false;
-	right = right || CheckCollision(game, data, 223, 875, 115, data->time_left * 4 * ALLEGRO_PI, data->fade_left);
-	right = right || CheckCollision(game, data, 223, 875, 138, data->time_left * 4 * ALLEGRO_PI * 24, data->fade_left / 10.0);
-
-	if (right && data->lastleft) {
-		data->score++;
-		data->lastleft = false;
-	} else if (left && !data->lastleft) {
-		data->score++;
-		data->lastleft = true;
+	// the uploads of the days that are going away have to go first, before their slots get reused
+	for (int view = 0; view < data->viewCount; view++) {
+		for (int j = 0; j < 2; j++) {
+			const struct DaySlot* slot = data->days.shown[view][j];
+			bool stays = false;
+			for (unsigned int i = 0; slot && (i < count); i++) {
+				stays |= wanted[i] == slot->number;
+			}
+			if (slot && !stays && data->animalBuffer) {
+				ForgetAnimals(data->animalBuffer, &slot->day);
+			}
+		}
 	}
-
-	if (data->backward_left || data->forward_left) {
-		data->fade_left += 0.025;
-		if (data->fade_left > 1) {
-			data->fade_left = 1;
+	WantDays(data->days.ring, wanted, count);
+
+	unsigned int poses = 0;
+	for (int view = 0; view < data->viewCount; view++) {
+		const struct DaySlot* previous = data->days.shown[view][1];
+		int number = data->days.number[view];
+		const struct DaySlot* day = data->days.wait ? WaitForDay(data->days.ring, number) : GetDay(data->days.ring, number);
+		const struct DaySlot* before = NULL;
+		if (data->days.rolling) {
+			before = data->days.wait ? WaitForDay(data->days.ring, number - 1) : GetDay(data->days.ring, number - 1);
 		}
-	} else {
-		data->fade_left -= 0.04;
-		if (data->fade_left < 0) {
-			data->fade_left = 0;
+		data->days.shown[view][0] = before;
+		data->days.shown[view][1] = day;
+		bool announced = false;
+		for (int other = 0; other < view; other++) {
+			announced |= day == data->days.shown[other][1];
 		}
-	}
-
-	if (data->backward_right || data->forward_right) {
-		data->fade_right += 0.025;
-		if (data->fade_right > 1) {
-			data->fade_right = 1;
+		if (day && (day != previous) && !announced) {
+			PrintConsole(game, "DGZ: day %d has %u animal walks, generated in %.2f ms", day->number, day->day.count, day->generationTime * 1000.0);
 		}
-	} else {
-		data->fade_right -= 0.04;
-		if (data->fade_right < 0) {
-			data->fade_right = 0;
+		unsigned int needed = (day ? day->day.segmentsCount : 0) + (before ? before->day.segmentsCount : 0);
+		if (needed > poses) {
+			poses = needed;
 		}
 	}
+	if (poses > data->posesCount) {
+		data->poses = realloc(data->poses, poses * sizeof(struct AnimalPose));
+		data->posesCount = poses;
+	}
+	UploadShownDays(game, data);
 }
 
-static struct Path* InitPath(int x1, int y1, int x2, int y2, int successorsLeft, int successorsRight, int zIndex) {
-	struct Path* path = calloc(1, sizeof(struct Path) + sizeof(struct Path*) * (successorsLeft + successorsRight));
-	path->a = (y2 - y1) / (float)(x2 - x1);
-	path->b = y1 - path->a * x1;
-	path->start = x1;
-	path->stop = x2;
-	path->bench = false;
-	path->zIndex = zIndex;
-	path->successorsLeft = successorsLeft;
-	path->successorsRight = successorsRight;
-	return path;
+static void ResetClocks(struct GamestateResources* data) {
+	for (int view = 0; view < data->viewCount; view++) {
+		// a view that lags behind past midnight starts on the day before
+		data->days.number[view] = (data->match.time[data->views[view].player] < data->views[view].lag) ? -1 : 0;
+		data->days.lastTime[view] = ViewTime(data, view);
+	}
 }
 
-static struct Animal* SpawnAnimal(struct Game* game, struct GamestateResources* data, int tick, struct Path* path, struct AnimalRes* type, bool reverse, double speed) {
-	struct Animal* animal = &data->animals[data->animalsCount]; //malloc(sizeof(struct Animal));
-	animal->time.spawn = tick;
-	double x1 = path->start;
-	double x2 = path->stop;
-	double y1 = path->a * x1 + path->b;
-	double y2 = path->a * x2 + path->b;
-	double length = sqrt(pow(x2 - x1, 2) + pow(y2 - y1, 2));
-	animal->speed = speed;
-	animal->time.despawn = tick + (length / (38.8) * animal->speed);
-	if (path->bench) {
-		animal->time.despawn++;
-	}
-	animal->state = ANIMAL_WALKING;
-	animal->type = type;
-	animal->path = path;
-	animal->reverse = reverse;
-	animal->id = data->curId++;
-
-	data->animalsCount++;
-	if (data->animalsCount == data->animalsAllocated) {
-		data->animalsAllocated *= 2;
-		PrintConsole(game, "Reallocating animals table to %d", data->animalsAllocated);
-		data->animals = realloc(data->animals, data->animalsAllocated * sizeof(struct Animal));
-		animal = &data->animals[data->animalsCount - 1];
-	}
-
-	return animal;
+static void RegenerateAnimals(struct Game* game, struct GamestateResources* data, uint64_t seed) {
+	// seeded, so that spectators and peers end up with the same animals
+	for (int view = 0; view < data->viewCount; view++) {
+		for (int j = 0; j < 2; j++) {
+			if (data->days.shown[view][j] && data->animalBuffer) {
+				ForgetAnimals(data->animalBuffer, &data->days.shown[view][j]->day);
+			}
+			data->days.shown[view][j] = NULL;
+		}
+	}
+	data->dgzSeed = seed;
+	ResetDayRing(data->days.ring, seed);
+	SyncDays(game, data);
+	data->pacing.invalidated = true;
 }
 
-static void CreatePaths(struct Game* game, struct GamestateResources* data) {
-	data->paths[0] = InitPath(1545, 299, 1643, 392, 1, 0, -1);
-	data->paths[1] = InitPath(28, 561, 686, 487, 0, 3, 1);
-	data->paths[2] = InitPath(686, 487, 1194, 493, 3, 2, 1);
-	data->paths[3] = InitPath(1194, 493, 1195, 493, 2, 2, 0);
-	data->paths[4] = InitPath(1195, 493, 1414, 494, 2, 3, 1);
-	data->paths[5] = InitPath(1414, 494, 1900, 432, 3, 0, 1);
-	data->paths[6] = InitPath(393, 1027, 615, 738, 0, 1, 4);
-	data->paths[7] = InitPath(615, 738, 840, 622, 1, 2, 4);
-	data->paths[8] = InitPath(1185, 807, 1603, 999, 3, 0, 3);
-	data->paths[9] = InitPath(840, 622, 1185, 807, 2, 3, 3);
-	data->paths[10] = InitPath(686, 487, 840, 622, 3, 2, 3);
-	data->paths[11] = InitPath(329, 225, 686, 487, 1, 3, 0);
-	data->paths[12] = InitPath(260, 312, 329, 225, 0, 1, -1);
-	data->paths[13] = InitPath(951, 1025, 1185, 807, 0, 3, 4);
-	data->paths[14] = InitPath(1185, 807, 1414, 494, 3, 3, 2);
-	data->paths[15] = InitPath(1414, 494, 1545, 299, 3, 1, 0);
-
-	data->paths[3]->bench = true;
-
-	// path 0 left
-	data->paths[0]->successors[0] = data->paths[15];
-	// no right on path 0
-
-	// no left on path 1
-	// path 1 right
-	data->paths[1]->successors[0] = data->paths[11];
-	data->paths[1]->successors[1] = data->paths[2];
-	data->paths[1]->successors[2] = data->paths[10];
-
-	// path 2 left
-	data->paths[2]->successors[0] = data->paths[1];
-	data->paths[2]->successors[1] = data->paths[11];
-	data->paths[2]->successors[2] = data->paths[10];
-	// path 2 right
-	data->paths[2]->successors[3] = data->paths[3];
-	data->paths[2]->successors[4] = data->paths[4];
-
-	// path 3 left
-	data->paths[3]->successors[0] = data->paths[2];
-	data->paths[3]->successors[1] = data->paths[4];
-	// path 3 right
-	data->paths[3]->successors[2] = data->paths[2];
-	data->paths[3]->successors[3] = data->paths[4];
-
-	// path 4 left
-	data->paths[4]->successors[0] = data->paths[2];
-	data->paths[4]->successors[1] = data->paths[3];
-	// path 4 right
-	data->paths[4]->successors[2] = data->paths[14];
-	data->paths[4]->successors[3] = data->paths[15];
-	data->paths[4]->successors[4] = data->paths[5];
-
-	// path 5 left
-	data->paths[5]->successors[0] = data->paths[4];
-	data->paths[5]->successors[1] = data->paths[14];
-	data->paths[5]->successors[2] = data->paths[15];
-	// no right on path 5
-
-	// no left on path 6
-	// path 6 right
-	data->paths[6]->successors[0] = data->paths[7];
-
-	// path 7 left
-	data->paths[7]->successors[0] = data->paths[6];
-	// path 7 right
-	data->paths[7]->successors[1] = data->paths[9];
-	data->paths[7]->successors[2] = data->paths[10];
-
-	// path 8 left
-	data->paths[8]->successors[0] = data->paths[9];
-	data->paths[8]->successors[1] = data->paths[13];
-	data->paths[8]->successors[2] = data->paths[14];
-	// no right on path 8
-
-	// path 9 left
-	data->paths[9]->successors[0] = data->paths[7];
-	data->paths[9]->successors[1] = data->paths[10];
-	// path 9 right
-	data->paths[9]->successors[2] = data->paths[8];
-	data->paths[9]->successors[3] = data->paths[13];
-	data->paths[9]->successors[4] = data->paths[14];
-
-	// path 10 left
-	data->paths[10]->successors[0] = data->paths[1];
-	data->paths[10]->successors[1] = data->paths[11];
-	data->paths[10]->successors[2] = data->paths[2];
-	// path 10 right
-	data->paths[10]->successors[3] = data->paths[7];
-	data->paths[10]->successors[4] = data->paths[9];
-
-	// path 11 left
-	data->paths[11]->successors[0] = data->paths[12];
-	// path 11 right
-	data->paths[11]->successors[1] = data->paths[1];
-	data->paths[11]->successors[2] = data->paths[2];
-	data->paths[11]->successors[3] = data->paths[10];
-
-	// no left on path 12
-	// path 12 right
-	data->paths[12]->successors[0] = data->paths[11];
-
-	// no left on path 13
-	// path 13 right
-	data->paths[13]->successors[0] = data->paths[9];
-	data->paths[13]->successors[1] = data->paths[14];
-	data->paths[13]->successors[2] = data->paths[8];
-
-	// path 14 left
-	data->paths[14]->successors[0] = data->paths[9];
-	data->paths[14]->successors[1] = data->paths[13];
-	data->paths[14]->successors[2] = data->paths[8];
-	// path 14 right
-	data->paths[14]->successors[3] = data->paths[4];
-	data->paths[14]->successors[4] = data->paths[15];
-	data->paths[14]->successors[5] = data->paths[5];
-
-	// path 15 left
-	data->paths[15]->successors[0] = data->paths[4];
-	data->paths[15]->successors[1] = data->paths[14];
-	data->paths[15]->successors[2] = data->paths[5];
-	// path 15 right
-	data->paths[15]->successors[3] = data->paths[0];
+static void DrawLayer(struct GamestateResources* data, ALLEGRO_BITMAP* full, ALLEGRO_BITMAP* half, ALLEGRO_COLOR tint) {
+	if (half && (data->render.scale <= HALF_LAYER_SCALE)) {
+		al_draw_tinted_scaled_bitmap(half, tint, 0, 0, al_get_bitmap_width(half), al_get_bitmap_height(half),
+		  0, 0, al_get_bitmap_width(full), al_get_bitmap_height(full), 0);
+	} else {
+		al_draw_tinted_bitmap(full, tint, 0, 0, 0);
+	}
 }
 
-static void DGZ(struct Game* game, struct GamestateResources* data) { // Dynamiczny Generator Zwierzątek™
-
-	struct Path* entrances[] = {
-		data->paths[1],
-		data->paths[12],
-		data->paths[6],
-		data->paths[13],
-		data->paths[8],
-		data->paths[0],
-		data->paths[5],
-	};
-
-	struct AnimalRes* animalTypes[] = {&data->owca, &data->ostronos, &data->dzik};
-
-	data->animalsAllocated = 512;
-	data->animalsCount = 0;
-	data->curId = 0;
-	data->animals = calloc(data->animalsAllocated, sizeof(struct Animal));
-
-	int tick = 0;
-	bool animalsLeft = false;
-	while ((tick < TICKS_PER_DAY) || (animalsLeft)) {
-		double night = NightValue(tick / (double)TICKS_PER_DAY);
-		double probability = (1 / (float)AVG_TICKS_PER_ANIMAL) * pow(1 - AT_NIGHT_SUPPRESSION * night, 2);
-		animalsLeft = false;
-
-		if (((rand() / (float)RAND_MAX) <= probability) && (tick < TICKS_PER_DAY)) {
-			// spawn an animal on entrance
-			struct Path* path = entrances[rand() % (sizeof entrances / sizeof entrances[0])];
-			SpawnAnimal(game, data, tick, path, animalTypes[rand() % (sizeof animalTypes / sizeof animalTypes[0])], path->successorsLeft ? true : false, 0.8 + (rand() / (float)RAND_MAX) * 0.4);
-		}
-
-		bool benchLeftTaken = false;
-		bool benchRightTaken = false;
-
-		for (int retick = 0; retick < 2; retick++) {
-			if (retick) {
-				tick += TICKS_PER_DAY; // wrapping
-			}
-			for (unsigned int i = 0; i < data->animalsCount; i++) {
-				struct Animal* animal = &data->animals[i];
-				if ((animal->time.spawn <= tick) && (animal->time.despawn >= tick)) {
-					animalsLeft = true;
-					switch (animal->state) {
-						case ANIMAL_BENCH_CENTER:
-							benchLeftTaken = true;
-							benchRightTaken = true;
-							break;
-						case ANIMAL_BENCH_LEFT:
-							benchLeftTaken = true;
-							break;
-						case ANIMAL_BENCH_RIGHT:
-							benchRightTaken = true;
-							break;
-						case ANIMAL_WALKING:
-							break;
-					}
-				}
-			}
-			if (retick) {
-				tick -= TICKS_PER_DAY; // wrapping
+static void DrawPoses(struct GamestateResources* data, unsigned int count, double night) {
+	bool negative = true;
+	for (unsigned int i = 0; i < count; i++) {
+		const struct AnimalPose* pose = &data->poses[i];
+		const struct Animal* animal = pose->animal;
+		if (animal->path->zIndex >= 0) {
+			if (negative) {
+				DrawLayer(data, data->fg, data->fg_half, al_map_rgb(255, 255, 255));
+				DrawLayer(data, data->fg2, data->fg2_half, al_map_rgba_f(night, night, night, night));
 			}
+			negative = false;
 		}
-
-		for (unsigned int i = 0; i < data->animalsCount; i++) {
-			struct Animal* animal = &data->animals[i];
-			if ((animal->time.spawn <= tick) && (animal->time.despawn >= tick)) {
-				if (animal->state != ANIMAL_WALKING) {
-					animal->time.despawn = tick + 1;
-					if ((animal->time.spawn + MIN_BENCHING_TIME) <= tick) {
-						if ((rand() / (double)RAND_MAX) <= (1 / (double)AVG_BENCHING_TIME)) {
-							animal->time.despawn = tick;
-						}
-					}
-				}
-			}
-			if (animal->time.despawn == tick) {
-				int pathsNr = animal->reverse ? animal->path->successorsLeft : animal->path->successorsRight;
-				int startNr = animal->reverse ? 0 : animal->path->successorsLeft;
-				int id = animal->id;
-				if (pathsNr) {
-					struct Path* newpath = animal->path->successors[startNr + (rand() % pathsNr)];
-					enum ANIMAL_STATE newstate = ANIMAL_WALKING;
-
-					if (newpath->bench) {
-						// it's a bench!
-						if (benchLeftTaken && benchRightTaken) {
-							// both sits are taken though, no luck :(
-							while (newpath->bench) {
-								newpath = animal->path->successors[startNr + (rand() % pathsNr)];
-							}
-						} else {
-							// the bench has free sit!
-							bool desiredLeft = rand() / (double)RAND_MAX < 0.5;
-							if (desiredLeft && benchLeftTaken) {
-								desiredLeft = false;
-							}
-							if (!desiredLeft && benchRightTaken) {
-								desiredLeft = true;
-							}
-							newstate = desiredLeft ? ANIMAL_BENCH_LEFT : ANIMAL_BENCH_RIGHT;
-							if (!benchLeftTaken && !benchRightTaken) {
-								if (rand() / (double)RAND_MAX < 0.1) {
-									// let's take the whole bench for myself, hah!
-									newstate = ANIMAL_BENCH_CENTER;
-									benchLeftTaken = true;
-									benchRightTaken = true;
-								}
-							}
-							if (desiredLeft) {
-								benchLeftTaken = true;
-							} else {
-								benchRightTaken = true;
-							}
-						}
-					}
-
-					// check if we're arriving at beginning or ending of newpath
-					bool left = false;
-					for (unsigned int j = 0; j < newpath->successorsLeft; j++) {
-						// either we find the old path as left successor to the new one (so we arrive at it's beginning)
-						// or not (so we arrive at its end)
-						if (newpath->successors[j] == animal->path) {
-							left = true;
-							break;
-						}
-					}
-					struct Animal* newanimal = SpawnAnimal(game, data, tick, newpath, data->animals[i].type, !left, data->animals[i].speed);
-					newanimal->state = newstate;
-					newanimal->id = id;
-				}
-			}
+		struct AnimalRes* type = data->animalTypes[animal->type];
+		if (animal->state == ANIMAL_WALKING) {
+			al_draw_rotated_bitmap(type->bitmap, al_get_bitmap_width(type->bitmap) / 2, al_get_bitmap_height(type->bitmap) * 0.75,
+			  pose->x, pose->y, pose->angle, animal->reverse ? ALLEGRO_FLIP_HORIZONTAL : 0);
+		} else {
+			al_draw_bitmap(type->bitmap_sitting, pose->x + pose->segment->sitX, pose->y + pose->segment->sitY, (animal->state == ANIMAL_BENCH_RIGHT) ? ALLEGRO_FLIP_HORIZONTAL : 0);
 		}
-		tick++;
 	}
-
-	data->animalsAllocated = data->animalsCount;
-	data->animals = realloc(data->animals, data->animalsAllocated * sizeof(struct Animal));
-
-	PrintConsole(game, "DGZ: generated %d animals", data->animalsCount);
+	if (negative) {
+		DrawLayer(data, data->fg, data->fg_half, al_map_rgb(255, 255, 255));
+		DrawLayer(data, data->fg2, data->fg2_half, al_map_rgba_f(night, night, night, night));
+	}
 }
 
-static void GuardedDraw(ALLEGRO_BITMAP* bitmap, float cx, float cy, float dx, float dy, float angle, int flags) {
-	if ((dx > 1920 * -0.5) || (dx < 1920 * 1.5) || (dy > 1080 * -0.5) || (dy < 1080 * 1.5)) {
-		al_draw_rotated_bitmap(bitmap, cx, cy, dx, dy, angle, flags);
-	}
+// The columns of a bitmap of given width that the view covers, plus the margin on both sides.
+static void GetViewStrip(struct GamestateResources* data, int view, int width, int margin, int* start, int* stop) {
+	*start = round(width * view / (double)data->viewCount) - margin;
+	*stop = round(width * (view + 1) / (double)data->viewCount) + margin;
+	*start = (*start < 0) ? 0 : *start;
+	*stop = (*stop > width) ? width : *stop;
 }
 
-static int zIndexCmp(const void* a, const void* b) {
-	int ret = ((struct DrawCommand const*)a)->animal->path->zIndex - ((struct DrawCommand const*)b)->animal->path->zIndex;
-	if (ret == 0) {
-		ret = ((struct DrawCommand const*)a)->animal->type->zIndex - ((struct DrawCommand const*)b)->animal->type->zIndex;
-	}
-	if (ret == 0) {
-		ret = ((struct DrawCommand const*)a)->animal->id - ((struct DrawCommand const*)b)->animal->id;
-	}
-	return ret;
+static int GetViewMargin(struct GamestateResources* data, int width) {
+	return ceil(width * (VHS_REACH + VHS_JITTER / (double)al_get_bitmap_width(data->target)));
 }
 
-static void DrawScene(struct Game* game, struct GamestateResources* data, double time) {
+static void DrawScene(struct Game* game, struct GamestateResources* data, int view) {
+	double time = ViewTime(data, view);
 	al_set_target_bitmap(data->scene);
+
+	// Only the view's own strip gets drawn, along with as much around it as the VHS shader may
+	// look at. Everything else about the park is shared between the views.
+	int width = al_get_bitmap_width(data->scene), start, stop;
+	GetViewStrip(data, view, width, GetViewMargin(data, width), &start, &stop);
+	al_set_clipping_rectangle(start, 0, stop - start, al_get_bitmap_height(data->scene));
 	al_clear_to_color(al_map_rgba(0, 0, 0, 0));
-	al_draw_bitmap(data->bg, 0, 0, 0);
 
-	double night = NightValue(time);
-	al_draw_tinted_bitmap(data->bg2, al_map_rgba_f(night, night, night, night), 0, 0, 0);
+	// everything is drawn in 1920x1080 coordinates, scaled down to the current render size
+	ALLEGRO_TRANSFORM transform;
+	al_identity_transform(&transform);
+	al_scale_transform(&transform, al_get_bitmap_width(data->scene) / 1920.0, al_get_bitmap_height(data->scene) / 1080.0);
+	al_use_transform(&transform);
 
-	int tick = time * TICKS_PER_DAY;
+	DrawLayer(data, data->bg, data->bg_half, al_map_rgb(255, 255, 255));
 
-	int bufPos = 0;
+	double night = NightValue(time);
+	DrawLayer(data, data->bg2, data->bg2_half, al_map_rgba_f(night, night, night, night));
 
-	//	PrintConsole(game, "clock is ticking: %f = %d; animals %d", time, tick, data->animalsCount);
-	for (unsigned int i = 0; i < data->animalsCount; i++) {
-		//		PrintConsole(game, "animal %d exists from tick %d to %d", i, data->animals[i]->time.spawn, data->animals[i]->time.despawn);
-		for (int retick = 0; retick < 2; retick++) {
-			if (retick) {
-				time += 1;
-				tick += TICKS_PER_DAY; // wrapping
-			}
-			if ((data->animals[i].time.spawn <= tick) && (data->animals[i].time.despawn > tick)) {
-				//PrintConsole(game, "got it");
-				double progress = ((time * TICKS_PER_DAY) - data->animals[i].time.spawn) / (double)(data->animals[i].time.despawn - data->animals[i].time.spawn);
-				struct Path* path = data->animals[i].path;
-				double x;
-				if (!data->animals[i].reverse) {
-					x = path->start + (path->stop - path->start) * progress;
-				} else {
-					x = path->stop - (path->stop - path->start) * progress;
-				}
-				double y = path->a * x + path->b;
-
-				if (data->animals[i].state == ANIMAL_WALKING) {
-					struct DrawCommand cmd = {&data->animals[i], data->animals[i].type->bitmap,
-						al_get_bitmap_width(data->animals[i].type->bitmap) / 2, al_get_bitmap_height(data->animals[i].type->bitmap) * 0.75,
-						x, y, atan(path->a) + (sin(time * 6000 + data->animals[i].id) / 5.0), data->animals[i].reverse ? ALLEGRO_FLIP_HORIZONTAL : 0};
-					memcpy(&data->drawCommandBuffer[bufPos], &cmd, sizeof(cmd));
-					bufPos++;
-				} else {
-					int offset = 85;
-					if (data->animals[i].state == ANIMAL_BENCH_CENTER) {
-						offset = 40;
-					} else if (data->animals[i].state == ANIMAL_BENCH_RIGHT) {
-						offset = -5;
-					}
-					struct DrawCommand cmd = {&data->animals[i], data->animals[i].type->bitmap_sitting, 0, 0,
-						x - offset, data->animals[i].type->benchPos, 0, (data->animals[i].state == ANIMAL_BENCH_RIGHT) ? ALLEGRO_FLIP_HORIZONTAL : 0};
-					memcpy(&data->drawCommandBuffer[bufPos], &cmd, sizeof(cmd));
-					bufPos++;
-				}
-			}
-			if (retick) {
-				time -= 1;
-				tick -= TICKS_PER_DAY; // wrapping
-			}
-		}
-	}
+	int tick = time * TICKS_PER_DAY;
 
-	qsort(data->drawCommandBuffer, bufPos, sizeof(struct DrawCommand), zIndexCmp);
-	bool negative = true;
-	for (int i = 0; i < bufPos; i++) {
-		if (data->drawCommandBuffer[i].animal->path->zIndex >= 0) {
-			if (negative) {
-				al_draw_bitmap(data->fg, 0, 0, 0);
-				al_draw_tinted_bitmap(data->fg2, al_map_rgba_f(night, night, night, night), 0, 0, 0);
-			}
-			negative = false;
+	// The walks left over from the day before come from its own data, so the animals crossing
+	// midnight keep going. A day that's not there yet has no animals, and one without the day
+	// before it loops instead.
+	const struct DgzDay* before = data->days.shown[view][0] ? &data->days.shown[view][0]->day : NULL;
+	const struct DgzDay* day = data->days.shown[view][1] ? &data->days.shown[view][1]->day : NULL;
+	enum DGZ_PART part = before ? DGZ_TODAY : DGZ_WHOLE;
+
+	// the days are indexed, so either way the animals come sorted back to front already
+	double poseStart = al_get_time();
+	unsigned int count = 0;
+	double submitStart = poseStart;
+
+	if (data->animalBuffer) {
+		// with both days on the GPU, the ones left over from the day before go behind the others on the same layer
+		count = DrawAnimals(data->animalBuffer, day ? before : NULL, time, DGZ_OVERNIGHT, false);
+		count += DrawAnimals(data->animalBuffer, day, time, part, false);
+		DrawLayer(data, data->fg, data->fg_half, al_map_rgb(255, 255, 255));
+		DrawLayer(data, data->fg2, data->fg2_half, al_map_rgba_f(night, night, night, night));
+		count += DrawAnimals(data->animalBuffer, day ? before : NULL, time, DGZ_OVERNIGHT, true);
+		count += DrawAnimals(data->animalBuffer, day, time, part, true);
+	} else {
+		if (day && before) {
+			count = PoseConsecutiveDays(before, day, time, data->poses);
+		} else if (day) {
+			count = PoseAnimals(day, time, data->poses);
 		}
-		al_draw_rotated_bitmap(data->drawCommandBuffer[i].bitmap, data->drawCommandBuffer[i].cx, data->drawCommandBuffer[i].cy, data->drawCommandBuffer[i].x, data->drawCommandBuffer[i].y, data->drawCommandBuffer[i].angle, data->drawCommandBuffer[i].flags);
-		//al_draw_textf(data->small, al_map_rgb(255, 255, 255), data->drawCommandBuffer[i].x, data->drawCommandBuffer[i].y, ALLEGRO_ALIGN_CENTER, "%d", data->drawCommandBuffer[i].animal->path->zIndex);
+		submitStart = al_get_time();
+		DrawPoses(data, count, night);
 	}
-	if (negative) {
-		al_draw_bitmap(data->fg, 0, 0, 0);
-		al_draw_tinted_bitmap(data->fg2, al_map_rgba_f(night, night, night, night), 0, 0, 0);
+	if (data->stress.enabled) {
+		double end = al_get_time();
+		data->stress.views++;
+		data->stress.posed += count;
+		data->stress.pose += submitStart - poseStart;
+		data->stress.submit += end - submitStart;
+		data->stress.worstView = fmax(data->stress.worstView, end - poseStart);
 	}
 
-	al_draw_bitmap(data->trees, 0, 0, 0);
+	DrawLayer(data, data->trees, data->trees_half, al_map_rgb(255, 255, 255));
 	al_draw_rotated_bitmap(data->tree, 295, 512, 378 + 295, 456 + 512, (sin(time * 800) * 2 - 1) / 100.0, 0);
 
 	/*
-	for (unsigned int i = 0; i < (sizeof(data->paths) / sizeof(struct Path*)); i++) {
-		al_draw_line(data->paths[i]->start, data->paths[i]->a * data->paths[i]->start + data->paths[i]->b,
-			data->paths[i]->stop, data->paths[i]->a * data->paths[i]->stop + data->paths[i]->b,
+	for (unsigned int i = 0; i < data->paths.count; i++) {
+		struct Path* path = data->paths.paths[i];
+		al_draw_line(path->start, path->a * path->start + path->b,
+			path->stop, path->a * path->stop + path->b,
 			al_map_rgb(i * 15, 0, 255), 10);
-		al_draw_textf(data->small, al_map_rgb(255, 255, 255), (data->paths[i]->start + data->paths[i]->stop) / 2,
-			data->paths[i]->a * (data->paths[i]->start + data->paths[i]->stop) / 2 + data->paths[i]->b - 20,
+		al_draw_textf(data->small, al_map_rgb(255, 255, 255), (path->start + path->stop) / 2,
+			path->a * (path->start + path->stop) / 2 + path->b - 20,
 			ALLEGRO_ALIGN_CENTER, "%d", i);
 	}
 	*/
 
-	ALLEGRO_BITMAP* beeframes[4] = {data->bee1, data->bee2, data->bee3, data->bee2};
-	ALLEGRO_BITMAP* bee = beeframes[(int)(time * 20000) % 4];
+	DrawParticles(data->particles, time);
 
-	GuardedDraw(bee, al_get_bitmap_width(data->bee1) / 2, al_get_bitmap_height(data->bee1) / 2,
-	  (time - 0.2) * 200 * 1920, 650, sin(time * 12000) / 6.0, 0);
+	// at the outer edge of the view's half of the screen
+	if (view * 2 < data->viewCount) {
+		al_draw_textf(game->_priv.font_console, al_map_rgb(0, 0, 0), 1920 * view / data->viewCount + 10, 1030, ALLEGRO_ALIGN_LEFT, "%f (%d)", time, tick);
+	} else {
+		al_draw_textf(game->_priv.font_console, al_map_rgb(0, 0, 0), 1920 * (view + 1) / data->viewCount - 10, 1030, ALLEGRO_ALIGN_RIGHT, "(%d) %f", tick, time);
+	}
 
-	GuardedDraw(bee, al_get_bitmap_width(data->bee1) / 2, al_get_bitmap_height(data->bee1) / 2,
-	  (time - 0.7) * 200 * 1920, 250, sin(time * 12000) / 6.0, 0);
+	al_draw_filled_rectangle(0, 0, 1920, 1080, al_map_rgba_f(0, 0, 0, night * 0.333));
 
-	GuardedDraw(bee, al_get_bitmap_width(data->bee1) / 2, al_get_bitmap_height(data->bee1) / 2,
-	  (time - 0.9) * 200 * 1920, 750, sin(time * 12000) / 6.0, 0);
+	al_identity_transform(&transform);
+	al_use_transform(&transform);
+	al_reset_clipping_rectangle();
+}
 
-	GuardedDraw(data->leaf.bitmap, al_get_bitmap_width(data->leaf.bitmap) / 2, al_get_bitmap_height(data->leaf.bitmap) / 2,
-	  (0.3 - time) * 50 * 1920, (0.3 - time) * 50 * 1080, time * 800, ALLEGRO_FLIP_VERTICAL);
+// The players split the screen between them, the left one first. When there are more views than
+// players, each player's further views trail their clock by [nowandthen] viewport_lag hours more.
+static void SetupViews(struct Game* game, struct GamestateResources* data) {
+	int count = strtol(GetConfigOptionDefault(game, "nowandthen", "viewports", "2"), NULL, 10);
+	data->viewCount = (count < MATCH_PLAYERS) ? MATCH_PLAYERS : ((count > MAX_VIEWS) ? MAX_VIEWS : count);
+	double lag = fmin(fmax(strtod(GetConfigOptionDefault(game, "nowandthen", "viewport_lag", "6"), NULL), 0.0), 23.0) / 24.0;
+	for (int view = 0; view < data->viewCount; view++) {
+		int player = view * MATCH_PLAYERS / data->viewCount;
+		int first = (player * data->viewCount + MATCH_PLAYERS - 1) / MATCH_PLAYERS;
+		data->views[view] = (struct View){
+			.player = player,
+			.lag = fmod((view - first) * lag, 1.0),
+			.xScanline2 = 0.2 - 0.025 * view,
+			.timeOffset = 100 * view,
+		};
+	}
+}
 
-	GuardedDraw(data->leaf.bitmap, al_get_bitmap_width(data->leaf.bitmap) / 2, al_get_bitmap_height(data->leaf.bitmap) / 2,
-	  (time - 0.8) * 120 * 1920 + 1920 / 2, (time - 0.8) * -80 * 1080 + 1080 / 2, time * 1000, ALLEGRO_FLIP_HORIZONTAL);
+static int NextPowerOfTwo(int x) {
+	int result = 1;
+	while (result < x) {
+		result *= 2;
+	}
+	return result;
+}
 
-	GuardedDraw(data->leaf.bitmap, al_get_bitmap_width(data->leaf.bitmap) / 2, al_get_bitmap_height(data->leaf.bitmap) / 2,
-	  (time - 0.4) * 70 * 1920, (time - 0.4) * 80 * 1080, time * 1200, 0);
+static void CreateRenderTargets(struct Game* game, struct GamestateResources* data) {
+	// The shader output never exceeds the original half resolution, which is part of the look.
+	double targetScale = fmin(data->render.scale, 0.5);
+	data->scene = TrackBitmap(game, RESOURCE_OWNER, CreateNotPreservedBitmap(round(1920 * data->render.scale), round(1080 * data->render.scale)));
+	data->target = TrackBitmap(game, RESOURCE_OWNER, CreateNotPreservedBitmap(round(1920 * targetScale / data->viewCount) * data->viewCount, round(1080 * targetScale)));
+	data->pacing.invalidated = true;
+}
 
-	al_draw_textf(game->_priv.font_console, al_map_rgb(0, 0, 0), 10, 1030, ALLEGRO_ALIGN_LEFT, "%f (%d)", time, tick);
-	al_draw_textf(game->_priv.font_console, al_map_rgb(0, 0, 0), 1910, 1030, ALLEGRO_ALIGN_RIGHT, "(%d) %f", tick, time);
+static void SetRenderScale(struct Game* game, struct GamestateResources* data, double scale) {
+	scale = round(fmax(data->render.min, fmin(data->render.max, scale)) / RENDER_SCALE_STEP) * RENDER_SCALE_STEP;
+	if (scale == data->render.scale) {
+		return;
+	}
+	PrintConsole(game, "Render scale: %.3f -> %.3f (render cost %.2f ms)", data->render.scale, scale, data->render.cost * 1000.0);
+	data->render.scale = scale;
+	DestroyTrackedBitmap(game, data->scene);
+	DestroyTrackedBitmap(game, data->target);
+	CreateRenderTargets(game, data);
+}
 
-	al_draw_filled_rectangle(0, 0, 1920, 1080, al_map_rgba_f(0, 0, 0, night * 0.333));
+// Takes what the frame that drew the views cost: the GPU time of its passes when the timers work,
+// and the CPU time of the draw otherwise.
+static void UpdateRenderScale(struct Game* game, struct GamestateResources* data, double now, double cost) {
+	if (!data->render.dynamic || (cost > 0.25)) {
+		// hitches like loading or window dragging are not the renderer's fault
+		return;
+	}
+	data->render.cost = data->render.cost * 0.95 + cost * 0.05;
+	if (now < data->render.nextAdjust) {
+		return;
+	}
+
+	double budget = 1.0 / data->render.targetFps;
+	int refresh = al_get_display_refresh_rate(game->display);
+	if (refresh > 0) {
+		// no point in drawing faster than the display shows
+		budget = fmax(budget, 1.0 / refresh);
+	}
+	if (data->render.cost > budget * 1.1) {
+		if (now - data->render.lastIncrease < 5.0) {
+			// the last increase didn't fit, so be more careful with the next one
+			data->render.increaseDelay = fmin(data->render.increaseDelay * 2, 60.0);
+		}
+		SetRenderScale(game, data, data->render.scale - RENDER_SCALE_STEP);
+		data->render.nextAdjust = now + 1.0;
+	} else if ((data->render.cost < budget * 1.02) && (data->render.scale < data->render.max)) {
+		SetRenderScale(game, data, data->render.scale + RENDER_SCALE_STEP);
+		data->render.lastIncrease = now;
+		data->render.nextAdjust = now + data->render.increaseDelay;
+	}
 }
 
-void Gamestate_Draw(struct Game* game, struct GamestateResources* data) {
-	// Called as soon as possible, but no sooner than next Gamestate_Logic call.
-	// Draw everything to the screen here.
+static ALLEGRO_BITMAP* CreateHalfSizeBitmap(struct Game* game, ALLEGRO_BITMAP* bitmap) {
+	int width = al_get_bitmap_width(bitmap), height = al_get_bitmap_height(bitmap);
+	ALLEGRO_BITMAP* half = TrackBitmap(game, RESOURCE_OWNER, al_create_bitmap(width / 2, height / 2));
+	ALLEGRO_BITMAP* target = al_get_target_bitmap();
+	al_set_target_bitmap(half);
+	al_clear_to_color(al_map_rgba(0, 0, 0, 0));
+	al_draw_scaled_bitmap(bitmap, 0, 0, width, height, 0, 0, width / 2, height / 2, 0);
+	al_set_target_bitmap(target);
+	return half;
+}
+
+static void SyncBitmap(ALLEGRO_BITMAP* bitmap) {
+	// Reading a pixel back waits until the GPU is done with everything queued before.
+	// It stalls the pipeline, so it's only used when profiling.
+	ALLEGRO_BITMAP* target = al_get_target_bitmap();
+	al_lock_bitmap_region(bitmap, 0, 0, 1, 1, ALLEGRO_PIXEL_FORMAT_ANY, ALLEGRO_LOCK_READONLY);
+	al_unlock_bitmap(bitmap);
+	al_set_target_bitmap(target);
+}
 
-	DrawScene(game, data, data->time_left);
+static ALLEGRO_SHADER* CreateVHSShader(struct Game* game, enum VHS_VARIANT variant) {
+	ALLEGRO_SHADER* shader = al_create_shader(ALLEGRO_SHADER_GLSL);
+	PrintConsole(game, "VERTEX: %d", al_attach_shader_source_file(shader, ALLEGRO_VERTEX_SHADER, GetDataFilePath(game, "shaders/vertex.glsl")));
+	const char* log;
+	if ((log = al_get_shader_log(shader)) && (log[0])) {
+		PrintConsole(game, "%s", log);
+	}
 
+	// the variant is selected by prepending a define to the source
+	char* source = NULL;
+	ALLEGRO_FILE* file = al_fopen(GetDataFilePath(game, "shaders/vhs.glsl"), "r");
+	if (file) {
+		size_t length = strlen(vhsVariantDefines[variant]);
+		int64_t size = al_fsize(file);
+		source = malloc(length + size + 1);
+		strcpy(source, vhsVariantDefines[variant]);
+		source[length + al_fread(file, source + length, size)] = 0;
+		al_fclose(file);
+	}
+	PrintConsole(game, "PIXEL (%s): %d", vhsVariantNames[variant], source && al_attach_shader_source(shader, ALLEGRO_PIXEL_SHADER, source));
+	free(source);
+	if ((log = al_get_shader_log(shader)) && (log[0])) {
+		PrintConsole(game, "%s", log);
+	}
+	al_build_shader(shader);
+	if ((log = al_get_shader_log(shader)) && (log[0])) {
+		PrintConsole(game, "%s", log);
+	}
+	return shader;
+}
+
+static void CreateVHSShaders(struct Game* game, struct GamestateResources* data) {
+	for (int i = 0; i < VHS_VARIANTS; i++) {
+		data->shaders[i] = CreateVHSShader(game, i);
+	}
+}
+
+static void CreateAnimalRenderer(struct Game* game, struct GamestateResources* data) {
+	data->animalBuffer = NULL;
+	if (!strtol(GetConfigOptionDefault(game, "nowandthen", "gpu_animals", "1"), NULL, 10)) {
+		return;
+	}
+	struct AnimalSprites sprites;
+	for (int i = 0; i < ANIMAL_TYPES; i++) {
+		sprites.walking[i] = data->animalTypes[i]->bitmap;
+		sprites.sitting[i] = data->animalTypes[i]->bitmap_sitting;
+	}
+	data->animalBuffer = CreateAnimalBuffer(game, &sprites);
+	UploadShownDays(game, data);
+}
+
+static void DestroyAnimalRenderer(struct Game* game, struct GamestateResources* data) {
+	if (data->animalBuffer) {
+		DestroyAnimalBuffer(game, data->animalBuffer);
+	}
+	data->animalBuffer = NULL;
+}
+
+static void CreateParticleRenderer(struct Game* game, struct GamestateResources* data) {
+	if (strtol(GetConfigOptionDefault(game, "nowandthen", "gpu_particles", "1"), NULL, 10)) {
+		CreateParticleBuffer(game, data->particles);
+	}
+}
+
+static void DestroyVHSShaders(struct Game* game, struct GamestateResources* data) {
+	for (int i = 0; i < VHS_VARIANTS; i++) {
+		al_destroy_shader(data->shaders[i]);
+	}
+}
+
+static ALLEGRO_BITMAP* CreateNoiseBitmap(struct Game* game) {
+	int flags = al_get_new_bitmap_flags();
+	al_set_new_bitmap_flags(flags & ~(ALLEGRO_MIN_LINEAR | ALLEGRO_MAG_LINEAR | ALLEGRO_MIPMAP));
+	ALLEGRO_BITMAP* noise = TrackBitmap(game, RESOURCE_OWNER, al_create_bitmap(256, 256));
+	al_set_new_bitmap_flags(flags);
+
+	ALLEGRO_BITMAP* target = al_get_target_bitmap();
+	al_set_target_bitmap(noise);
+	al_lock_bitmap(noise, ALLEGRO_PIXEL_FORMAT_ANY, ALLEGRO_LOCK_WRITEONLY);
+	for (int x = 0; x < 256; x++) {
+		for (int y = 0; y < 256; y++) {
+			unsigned char value = rand() % 256;
+			al_put_pixel(x, y, al_map_rgb(value, value, value));
+		}
+	}
+	al_unlock_bitmap(noise);
+	al_set_target_bitmap(target);
+	return noise;
+}
+
+static void DrawView(struct Game* game, struct GamestateResources* data, int view) {
+	const struct View* v = &data->views[view];
+	float fade = data->match.fade[v->player];
+	GpuTimerBegin(data->gpuTimers, PASS_VIEWS + view * 2);
+	DrawScene(game, data, view);
+	GpuTimerEnd(data->gpuTimers, PASS_VIEWS + view * 2);
+
+	// Each view only shows its own strip of the target, so the rest is clipped away
+	// and all of them survive until the next refresh.
+	int width = al_get_bitmap_width(data->target), height = al_get_bitmap_height(data->target), stripStart, stripStop;
+	GetViewStrip(data, view, width, 0, &stripStart, &stripStop);
 	al_set_target_bitmap(data->target);
+	al_set_clipping_rectangle(stripStart, 0, stripStop - stripStart, height);
 	al_clear_to_color(al_map_rgba(0, 0, 0, 0));
-	al_use_shader(data->shader);
 
-	float fade = data->fade_left;
+	// The light variant is exact at zero fade, as the grain and bleed terms it skips are multiplied by it.
+	enum VHS_VARIANT variant = (fade > 0) ? VHS_FULL : VHS_LIGHT;
+	if (variant < data->vhsQuality) {
+		variant = data->vhsQuality;
+	}
+	al_use_shader(data->shaders[variant]);
+
+	double shaderTime = data->counter / 60.0 + v->timeOffset;
+	float xScanlineSize = 0.5 * fade + 0.05;
+	al_set_shader_float("actualXLine", fmod(0.2 + ((1.0 + sin(0.34 * shaderTime)) / 2.0 + (1.0 + sin(shaderTime)) / 3.0 + (1.0 + cos(2.1 * shaderTime)) / 3.0 + (1.0 + cos(0.027 * shaderTime)) / 2.0) / 3.5, 1.0));
+	al_set_shader_float("actualXLineWidth", 2.0 * xScanlineSize * ((1.0 + sin(1.2 * shaderTime)) / 2.0 + (1.0 + cos(3.91 * shaderTime)) / 3.0 + (1.0 + cos(0.014 * shaderTime)) / 2.0) / 3.5);
+	al_set_shader_float("actualYLine", fmod(1.0 + shaderTime, 1.0));
+	al_set_shader_sampler("noiseTex", data->noise, 1);
 
 	al_set_shader_bool("autoScan", true);
 	al_set_shader_float("xScanline", 0.2);
-	al_set_shader_float("xScanline2", 0.2);
+	al_set_shader_float("xScanline2", v->xScanline2);
 	al_set_shader_float("yScanline", 1.0);
-	al_set_shader_float("xScanlineSize", 0.5 * fade + 0.05);
+	al_set_shader_float("xScanlineSize", xScanlineSize);
 	al_set_shader_float("xScanlineSize2", 0.83);
 	al_set_shader_float("yScanlineAmount", -0.22 * fade);
 	al_set_shader_float("grainLevel", 0.0 * fade);
@@ -839,105 +865,180 @@ void Gamestate_Draw(struct Game* game, struct GamestateResources* data) {
 	al_set_shader_float("bleedAmount", fade * 0.5);
 	al_set_shader_float("bleedDistort", 0.666);
 	al_set_shader_float("bleedRange", 1.0);
-	al_set_shader_float("TIME", data->counter / 60.0); //data->blink_counter/3600.0);
-	float size[2] = {al_get_bitmap_width(data->target), al_get_bitmap_height(data->target)};
+	al_set_shader_float("TIME", shaderTime); //data->blink_counter/3600.0);
+	float size[2] = {width, height};
 	al_set_shader_float_vector("RENDERSIZE", 2, size, 1);
+	float padding[2] = {1.0, 1.0};
+#ifdef ALLEGRO_CFG_OPENGLES
+	padding[0] = NextPowerOfTwo(al_get_bitmap_width(data->scene)) / (float)al_get_bitmap_width(data->scene);
+	padding[1] = NextPowerOfTwo(al_get_bitmap_height(data->scene)) / (float)al_get_bitmap_height(data->scene);
+#endif
+	al_set_shader_float_vector("texturePadding", 2, padding, 1);
+	// the distortions can't pick anything up from outside of what DrawScene drew
+	int sceneWidth = al_get_bitmap_width(data->scene), sceneStart, sceneStop;
+	GetViewStrip(data, view, sceneWidth, GetViewMargin(data, sceneWidth), &sceneStart, &sceneStop);
+	float range[2] = {(sceneStart + 0.5) / sceneWidth, (sceneStop - 0.5) / sceneWidth};
+	al_set_shader_float_vector("sceneRange", 2, range, 1);
 	float colorl[4] = {0.8, 0.0, 0.4, 1.0};
 	al_set_shader_float_vector("colorBleedL", 4, colorl, 1);
 	float colorc[4] = {0.0, 0.5, 0.9, 1.0};
 	al_set_shader_float_vector("colorBleedC", 4, colorc, 1);
 	float colorr[4] = {0.8, 0.0, 0.4, 1.0};
 	al_set_shader_float_vector("colorBleedR", 4, colorr, 1);
-	al_draw_scaled_bitmap(data->scene, 0, 0, 1920, 1080, 0, 0, 1920 / 2, 1080 / 2, 0);
+	double start = 0;
+	if (data->vhsProfile.enabled) {
+		SyncBitmap(data->scene);
+		start = al_get_time();
+	}
+	GpuTimerBegin(data->gpuTimers, PASS_VIEWS + view * 2 + 1);
+	al_draw_scaled_bitmap(data->scene, 0, 0, al_get_bitmap_width(data->scene), al_get_bitmap_height(data->scene), 0, 0, width, height, 0);
+	GpuTimerEnd(data->gpuTimers, PASS_VIEWS + view * 2 + 1);
+	if (data->vhsProfile.enabled) {
+		SyncBitmap(data->target);
+		data->vhsProfile.time[variant] += al_get_time() - start;
+		data->vhsProfile.passes[variant]++;
+	}
 	al_use_shader(NULL);
+	al_reset_clipping_rectangle();
+}
 
-	al_set_target_backbuffer(game->display);
-
-	al_draw_tinted_scaled_rotated_bitmap_region(data->target, 0, 0, 1920 / 4, 1080 / 2, al_map_rgb_f(1, 1, 1), 0, 0, (data->shakeleft ? ((rand() % 20) - 10) : 0), (data->shakeleft ? ((rand() % 20) - 10) : 0), 2, 2, 0, 0);
+static void ReportVHSProfile(struct Game* game, struct GamestateResources* data, double now) {
+	if (!data->vhsProfile.enabled || (now - data->vhsProfile.reportTime < 10.0)) {
+		return;
+	}
+	for (int i = 0; i < VHS_VARIANTS; i++) {
+		if (data->vhsProfile.passes[i]) {
+			PrintConsole(game, "VHS %s: %d passes, %.3f ms per pass", vhsVariantNames[i], data->vhsProfile.passes[i], data->vhsProfile.time[i] * 1000.0 / data->vhsProfile.passes[i]);
+		}
+		data->vhsProfile.passes[i] = 0;
+		data->vhsProfile.time[i] = 0;
+	}
+	data->vhsProfile.reportTime = now;
+}
 
-	// right
+static void ReportCrowdStress(struct Game* game, struct GamestateResources* data, double now) {
+	if (!data->stress.enabled) {
+		return;
+	}
+	if (data->stress.lastFrame) {
+		double frame = now - data->stress.lastFrame;
+		data->stress.frames++;
+		data->stress.frameTime += frame;
+		data->stress.worstFrame = fmax(data->stress.worstFrame, frame);
+		if (frame > 1.2 / 60.0) {
+			data->stress.slow++;
+		}
+	}
+	data->stress.lastFrame = now;
+	if ((now - data->stress.reportTime < 10.0) || !data->stress.frames || !data->stress.views) {
+		return;
+	}
+	const struct DaySlot* day = data->days.shown[0][1];
+	PrintConsole(game, "Crowd: %u walks, %.0f posed per view; pose %.3f ms, submit %.3f ms per view (worst %.3f ms)", day ? day->day.count : 0,
+		data->stress.posed / (double)data->stress.views, data->stress.pose * 1000.0 / data->stress.views, data->stress.submit * 1000.0 / data->stress.views, data->stress.worstView * 1000.0);
+	PrintConsole(game, "Crowd: %d frames, %.2f ms avg, %.2f ms worst, %d slower than 60 Hz", data->stress.frames,
+		data->stress.frameTime * 1000.0 / data->stress.frames, data->stress.worstFrame * 1000.0, data->stress.slow);
+	data->stress.frames = data->stress.views = data->stress.slow = 0;
+	data->stress.posed = 0;
+	data->stress.pose = data->stress.submit = data->stress.worstView = 0;
+	data->stress.frameTime = data->stress.worstFrame = 0;
+	data->stress.reportTime = now;
+}
 
-	DrawScene(game, data, data->time_right);
+static bool IsIdle(struct GamestateResources* data) {
+	return data->pacing.enabled && (data->pacing.idleTicks > IDLE_GRACE_TICKS);
+}
 
-	al_set_target_bitmap(data->target);
-	al_clear_to_color(al_map_rgba(0, 0, 0, 0));
-	al_use_shader(data->shader);
+void Gamestate_Draw(struct Game* game, struct GamestateResources* data) {
+	// Called as soon as possible, but no sooner than next Gamestate_Logic call.
+	// Draw everything to the screen here.
 
-	fade = data->fade_right;
+	double now = al_get_time();
+	data->pacing.frames++;
+	bool showsPress = false;
+	if (data->latency) {
+		NoteLatencyFlip(game, data->latency, now, 0);
+		showsPress = BeginLatencyFrame(data->latency, now);
+	}
 
-	al_set_shader_bool("autoScan", true);
-	al_set_shader_float("xScanline", 0.2);
-	al_set_shader_float("xScanline2", 0.175);
-	al_set_shader_float("yScanline", 1.0);
-	al_set_shader_float("xScanlineSize", 0.5 * fade + 0.05);
-	al_set_shader_float("xScanlineSize2", 0.83);
-	al_set_shader_float("yScanlineAmount", -0.22 * fade);
-	al_set_shader_float("grainLevel", 0.0 * fade);
-	al_set_shader_float("scanFollowAmount", fade);
-	al_set_shader_float("analogDistort", 6.66 * fade + 0.1);
-	al_set_shader_float("bleedAmount", fade * 0.5);
-	al_set_shader_float("bleedDistort", 0.666);
-	al_set_shader_float("bleedRange", 1.0);
-	al_set_shader_float("TIME", data->counter / 60.0 + 100); //data->blink_counter/3600.0);
-	al_set_shader_float_vector("RENDERSIZE", 2, size, 1);
-	al_set_shader_float_vector("colorBleedL", 4, colorl, 1);
-	al_set_shader_float_vector("colorBleedC", 4, colorc, 1);
-	al_set_shader_float_vector("colorBleedR", 4, colorr, 1);
-	al_draw_scaled_bitmap(data->scene, 0, 0, 1920, 1080, 0, 0, 1920 / 2, 1080 / 2, 0);
-	al_use_shader(NULL);
+	GpuTimersNewFrame(game, data->gpuTimers);
+	bool rendered = false;
 
-	al_set_target_backbuffer(game->display);
+	// On the idle title screen only the clocks progress, slowly enough that the
+	// previous composite can be reused for a while.
+	if (data->pacing.invalidated || !IsIdle(data) || (now - data->pacing.lastRender >= 1.0 / data->pacing.idleFps)) {
+		for (int view = 0; view < data->viewCount; view++) {
+			DrawView(game, data, view);
+		}
+		data->pacing.lastRender = now;
+		data->pacing.invalidated = false;
+		data->pacing.renders++;
+		rendered = true;
+	}
 
-	al_draw_tinted_scaled_rotated_bitmap_region(data->target, 1920 / 4, 0, 1920 / 4, 1080 / 2, al_map_rgb_f(1, 1, 1), 0, 0, 1920 / 2 + (data->shakeright ? ((rand() % 20) - 10) : 0), (data->shakeright ? ((rand() % 20) - 10) : 0), 2, 2, 0, 0);
+	if (data->output) {
+		al_set_target_bitmap(data->output);
+	} else {
+		al_set_target_backbuffer(game->display);
+	}
+	GpuTimerBegin(data->gpuTimers, PASS_COMPOSITE);
+
+	int width = al_get_bitmap_width(data->target), height = al_get_bitmap_height(data->target);
+	float scale = 1920.0 / width;
+	for (int view = 0; view < data->viewCount; view++) {
+		int shake = data->match.shake[data->views[view].player], start, stop;
+		GetViewStrip(data, view, width, 0, &start, &stop);
+		al_draw_tinted_scaled_rotated_bitmap_region(data->target, start, 0, stop - start, height, al_map_rgb_f(1, 1, 1), 0, 0, start * scale + (shake ? ((rand() % 20) - 10) : 0), (shake ? ((rand() % 20) - 10) : 0), scale, scale, 0, 0);
+	}
 
 	//al_draw_scaled_bitmap(data->target, 0, 0, 1920 / 2, 1080 / 2, 0, 0, 1920, 1080, 0); // debug
 
 	al_draw_bitmap(data->frame, 0, 0, 0);
 
 	al_draw_bitmap(data->clock1, 30, 589, 0);
-	al_draw_rotated_bitmap(data->hand2, 7, 15, 223, 875, data->time_left * 4 * ALLEGRO_PI, 0);
-	al_draw_rotated_bitmap(data->hand1, 8, 14, 223, 875, data->time_left * 4 * ALLEGRO_PI * 24, 0);
+	al_draw_rotated_bitmap(data->hand2, 7, 15, 223, 875, data->match.time[0] * 4 * ALLEGRO_PI, 0);
+	al_draw_rotated_bitmap(data->hand1, 8, 14, 223, 875, data->match.time[0] * 4 * ALLEGRO_PI * 24, 0);
 	al_draw_bitmap(data->clockball1, 30, 589, 0);
 
 	al_draw_bitmap(data->clock2, 1491, 552, 0);
-	al_draw_rotated_bitmap(data->hand2, 7, 15, 1672, 879, data->time_right * 4 * ALLEGRO_PI, 0);
-	al_draw_rotated_bitmap(data->hand1, 8, 14, 1672, 879, data->time_right * 4 * ALLEGRO_PI * 24, 0);
+	al_draw_rotated_bitmap(data->hand2, 7, 15, 1672, 879, data->match.time[1] * 4 * ALLEGRO_PI, 0);
+	al_draw_rotated_bitmap(data->hand1, 8, 14, 1672, 879, data->match.time[1] * 4 * ALLEGRO_PI * 24, 0);
 	al_draw_bitmap(data->clockball2, 1491, 552, 0);
 
 	al_draw_bitmap(data->scores, 462, 960, 0);
 
-	al_draw_textf(data->small, al_map_rgb(0, 0, 0), 520, 990, ALLEGRO_ALIGN_LEFT, "Now: %d", data->leftscore);
-	al_draw_textf(data->small, al_map_rgb(0, 0, 0), 1122, 987, ALLEGRO_ALIGN_LEFT, "Then: %d", data->rightscore);
+	al_draw_textf(data->small, al_map_rgb(0, 0, 0), 520, 990, ALLEGRO_ALIGN_LEFT, "Now: %d", data->match.leftscore);
+	al_draw_textf(data->small, al_map_rgb(0, 0, 0), 1122, 987, ALLEGRO_ALIGN_LEFT, "Then: %d", data->match.rightscore);
 
 	al_draw_scaled_rotated_bitmap(data->ball, al_get_bitmap_width(data->ball) / 2, al_get_bitmap_height(data->ball) / 2,
-	  data->ballx, data->bally, 0.75, 0.75, data->ballrot, 0);
+	  data->match.ballx, data->match.bally, 0.75, 0.75, data->match.ballrot, 0);
 
 	/*
-	al_draw_line(223, 875, 223 + 115 * cos(data->time_left * 4 * ALLEGRO_PI), 875 + 115 * sin(data->time_left * 4 * ALLEGRO_PI), al_map_rgb(255,255,0), 5);
-	al_draw_line(223, 875, 223 + 138 * cos(data->time_left * 4 * ALLEGRO_PI * 24), 875 + 138 * sin(data->time_left * 4 * ALLEGRO_PI * 24), al_map_rgb(255,255,0), 5);
+	al_draw_line(223, 875, 223 + 115 * cos(data->match.time[0] * 4 * ALLEGRO_PI), 875 + 115 * sin(data->match.time[0] * 4 * ALLEGRO_PI), al_map_rgb(255,255,0), 5);
+	al_draw_line(223, 875, 223 + 138 * cos(data->match.time[0] * 4 * ALLEGRO_PI * 24), 875 + 138 * sin(data->match.time[0] * 4 * ALLEGRO_PI * 24), al_map_rgb(255,255,0), 5);
 
-	al_draw_line(1672, 879, 1672 + 115 * cos(data->time_right * 4 * ALLEGRO_PI), 879 + 115 * sin(data->time_right * 4 * ALLEGRO_PI), al_map_rgb(255,255,0), 5);
-	al_draw_line(1672, 879, 1672 + 138 * cos(data->time_right * 4 * ALLEGRO_PI * 24), 879 + 138 * sin(data->time_right * 4 * ALLEGRO_PI * 24), al_map_rgb(255,255,0), 5);
+	al_draw_line(1672, 879, 1672 + 115 * cos(data->match.time[1] * 4 * ALLEGRO_PI), 879 + 115 * sin(data->match.time[1] * 4 * ALLEGRO_PI), al_map_rgb(255,255,0), 5);
+	al_draw_line(1672, 879, 1672 + 138 * cos(data->match.time[1] * 4 * ALLEGRO_PI * 24), 879 + 138 * sin(data->match.time[1] * 4 * ALLEGRO_PI * 24), al_map_rgb(255,255,0), 5);
 
-	al_draw_circle(data->ballx, data->bally, 42, al_map_rgb(255,0,0), 5);
+	al_draw_circle(data->match.ballx, data->match.bally, 42, al_map_rgb(255,0,0), 5);
 */
 
 	//	PrintConsole(game, "%f %f", x1, x2);
 
-	if (data->delay != -1) {
-		float tint = sin(data->delay / 120.0 * ALLEGRO_PI);
-		if (data->delay > 60) {
+	if (data->match.delay != -1) {
+		float tint = sin(data->match.delay / 120.0 * ALLEGRO_PI);
+		if (data->match.delay > 60) {
 			tint = sqrt(tint);
 		}
-		float scale = sqrt(cos(data->delay / 120.0 * ALLEGRO_PI / 2));
+		float scale = sqrt(cos(data->match.delay / 120.0 * ALLEGRO_PI / 2));
 		al_draw_tinted_scaled_rotated_bitmap(data->scorebmp, al_map_rgba_f(tint, tint, tint, tint), 1920 / 2, 1080 / 2, 1920 / 2, 1080 / 2 - 160 + 40 * scale, 0.75 + scale / 2.0, 0.75 + scale / 2.0, 0, 0);
 	}
 
-	if (!data->started) {
+	if (!data->match.started) {
 		char* text = NULL;
-		if (data->leftscore == 10) {
+		if (data->match.leftscore == 10) {
 			text = "Now wins!";
-		} else if (data->rightscore == 10) {
+		} else if (data->match.rightscore == 10) {
 			text = "Then wins!";
 		} else {
 			//text = "Now and Then";
@@ -980,65 +1081,200 @@ void Gamestate_Draw(struct Game* game, struct GamestateResources* data) {
 		al_draw_scaled_rotated_bitmap(data->key1, 0, 0, 1920 - 20 - 156 / 2, 990, 0.25, 0.25, 0, 0);
 		al_draw_scaled_rotated_bitmap(data->arrow2, 0, 0, 1920 - 20 - 156 / 2 + 15, 990 + 25, 0.25, 0.25, 0, 0);
 	}
+
+	GpuTimerEnd(data->gpuTimers, PASS_COMPOSITE);
+
+	if (data->netplay && !data->netplay->connected) {
+		al_draw_text(data->small, al_map_rgb(255, 255, 255), 1920 / 2, 40, ALLEGRO_ALIGN_CENTER, "Waiting for the other player...");
+	}
+	if (data->spectateClient && !data->spectateClient->have) {
+		al_draw_text(data->small, al_map_rgb(255, 255, 255), 1920 / 2, 40, ALLEGRO_ALIGN_CENTER, "Waiting for the broadcast...");
+	}
+
+	DrawResourceOverlay(game, 10, 10);
+
+	if (data->latencyMarker) {
+		// goes white on the frame that first shows a key press
+		float marker = showsPress ? 1.0 : 0.0;
+		al_draw_filled_rectangle(0, 1080 - LATENCY_MARKER_SIZE, LATENCY_MARKER_SIZE, 1080, al_map_rgb_f(marker, marker, marker));
+	}
+
+	ReportVHSProfile(game, data, now);
+	ReportCrowdStress(game, data, now);
+
+	double drawTime = al_get_time() - now;
+	data->pacing.drawTime += drawTime;
+	if (rendered) {
+		// the reused composite of an idle frame says nothing about the scale
+		bool gpu = data->gpuTimers->available && (data->gpuTimers->lastFrame > 0);
+		UpdateRenderScale(game, data, now, gpu ? data->gpuTimers->lastFrame / 1000.0 : drawTime);
+	}
+	if (data->latency) {
+		EndLatencyFrame(data->latency, al_get_time());
+	}
+	if (game->config.debug && (now - data->pacing.reportTime >= 10.0)) {
+		PrintConsole(game, "Pacing: %d scene refreshes in %d frames, %.2f ms of CPU per frame", data->pacing.renders, data->pacing.frames, data->pacing.drawTime * 1000.0 / data->pacing.frames);
+		struct AudioRamp* ramps[] = {data->ramps.day1, data->ramps.day2, data->ramps.night1, data->ramps.night2, data->ramps.rewind};
+		PrintAudioRampStats(game, ramps, sizeof(ramps) / sizeof(ramps[0]), now - data->pacing.reportTime);
+		if (data->matchThread) {
+			PrintMatchThreadStats(game, data->matchThread, now - data->pacing.reportTime);
+		}
+		data->pacing.frames = 0;
+		data->pacing.renders = 0;
+		data->pacing.drawTime = 0;
+		data->pacing.reportTime = now;
+	}
+}
+
+static unsigned char ScriptedInput(struct GamestateResources* data, int frame, int player) {
+	if (!data->match.started) {
+		return (player == 0) ? INPUT_START : 0;
+	}
+	// both clocks keep getting wound back and forth, out of phase with each other
+	int phase = (frame + player * 75) % 300;
+	if (phase < 120) {
+		return INPUT_FORWARD;
+	}
+	if ((phase >= 150) && (phase < 270)) {
+		return INPUT_BACKWARD;
+	}
+	return 0;
+}
+
+static void RunRenderBenchmark(struct Game* game, struct GamestateResources* data) {
+	// Renders a scripted match at full 1920x1080 into an offscreen bitmap, as fast as the GPU
+	// allows. Seeds are fixed, so exported frames of two runs can be compared pixel by pixel.
+	struct BenchmarkOptions* options = &game->data->benchmark;
+	int frames = options->frames;
+	options->frames = 0;
+
+	srand(0);
+	InitMatch(&data->match, 0);
+	ResetClocks(data);
+	data->days.wait = true;
+	RegenerateAnimals(game, data, 0);
+	data->counter = 0;
+	data->render.dynamic = false;
+	EnableGpuTimers(game, data->gpuTimers);
+	data->gpuTimers->logInterval = 0;
+	ResetGpuTimers(data->gpuTimers);
+	data->output = TrackBitmap(game, RESOURCE_OWNER, CreateNotPreservedBitmap(1920, 1080));
+	PrintConsole(game, "Render benchmark: %d frames at render scale %.3f, VHS %s", frames, data->render.scale, vhsVariantNames[data->vhsQuality]);
+
+	double* times = calloc(frames, sizeof(double));
+	double total = 0, exportTime = 0;
+	int exported = 0;
+	for (int frame = 0; frame < frames; frame++) {
+		double start = al_get_time();
+		for (int i = 0; i < MATCH_PLAYERS; i++) {
+			data->keys[i] = ScriptedInput(data, frame, i);
+		}
+		Gamestate_Logic(game, data);
+		data->pacing.invalidated = true;
+		Gamestate_Draw(game, data);
+		SyncBitmap(data->output); // so the time covers the GPU work as well
+		times[frame] = al_get_time() - start;
+		total += times[frame];
+
+		if (options->exportEvery && (frame % options->exportEvery == 0)) {
+			start = al_get_time();
+			char filename[sizeof(options->exportDir) + 32];
+			snprintf(filename, sizeof(filename), "%s/frame%06d.png", options->exportDir, frame);
+			if (al_save_bitmap(filename, data->output)) {
+				exported++;
+			} else {
+				PrintConsole(game, "Render benchmark: can't save %s", filename);
+			}
+			exportTime += al_get_time() - start;
+		}
+	}
+
+	if (frames) {
+		qsort(times, frames, sizeof(double), CompareDoubles);
+		PrintConsole(game, "Render benchmark: %.1f fps, frame time avg %.3f ms, median %.3f ms, p99 %.3f ms, max %.3f ms",
+			frames / total, total * 1000.0 / frames, times[frames / 2] * 1000.0, times[(frames * 99) / 100] * 1000.0, times[frames - 1] * 1000.0);
+	}
+	PrintGpuTimers(game, data->gpuTimers);
+	if (options->exportEvery) {
+		PrintConsole(game, "Render benchmark: exported %d frames to %s in %.2f s", exported, options->exportDir, exportTime);
+	}
+	free(times);
+
+	al_set_target_backbuffer(game->display);
+	DestroyTrackedBitmap(game, data->output);
+	data->output = NULL;
+	data->days.wait = false;
+	UnloadCurrentGamestate(game);
 }
 
 void Gamestate_ProcessEvent(struct Game* game, struct GamestateResources* data, ALLEGRO_EVENT* ev) {
 	// Called for each event in Allegro event queue.
 	// Here you can handle user input, expiring timers etc.
+	if (data->latency) {
+		NoteLatencyFlip(game, data->latency, al_get_time(), ev->any.timestamp);
+	}
+
 	if ((ev->type == ALLEGRO_EVENT_KEY_DOWN) && (ev->keyboard.keycode == ALLEGRO_KEY_ESCAPE)) {
 		UnloadCurrentGamestate(game); // mark this gamestate to be stopped and unloaded
 		// When there are no active gamestates, the engine will quit.
 	}
 
-	if ((ev->type == ALLEGRO_EVENT_KEY_DOWN) && (ev->keyboard.keycode == ALLEGRO_KEY_RIGHT)) {
-		data->forward_right = true;
-		data->lastbackward_right = false;
-		data->right_buttons = false;
-	}
-	if ((ev->type == ALLEGRO_EVENT_KEY_UP) && (ev->keyboard.keycode == ALLEGRO_KEY_RIGHT)) {
-		data->forward_right = false;
-	}
-	if ((ev->type == ALLEGRO_EVENT_KEY_DOWN) && (ev->keyboard.keycode == ALLEGRO_KEY_LEFT)) {
-		data->backward_right = true;
-		data->lastbackward_right = true;
-		data->right_buttons = false;
-	}
-	if ((ev->type == ALLEGRO_EVENT_KEY_UP) && (ev->keyboard.keycode == ALLEGRO_KEY_LEFT)) {
-		data->backward_right = false;
+	if ((ev->type == ALLEGRO_EVENT_KEY_DOWN) || (ev->type == ALLEGRO_EVENT_KEY_UP)) {
+		data->pacing.idleTicks = 0;
 	}
 
-	if ((ev->type == ALLEGRO_EVENT_KEY_DOWN) && (ev->keyboard.keycode == ALLEGRO_KEY_D)) {
-		data->forward_left = true;
-		data->lastbackward_left = false;
-		data->left_buttons = false;
-	}
-	if ((ev->type == ALLEGRO_EVENT_KEY_UP) && (ev->keyboard.keycode == ALLEGRO_KEY_D)) {
-		data->forward_left = false;
+	if ((ev->type == ALLEGRO_EVENT_KEY_DOWN) && (ev->keyboard.keycode == ALLEGRO_KEY_G)) {
+		PrintGpuTimers(game, data->gpuTimers);
 	}
-	if ((ev->type == ALLEGRO_EVENT_KEY_DOWN) && (ev->keyboard.keycode == ALLEGRO_KEY_A)) {
-		data->backward_left = true;
-		data->lastbackward_left = true;
-		data->left_buttons = false;
+
+	if ((ev->type == ALLEGRO_EVENT_KEY_DOWN) && (ev->keyboard.keycode == ALLEGRO_KEY_N) && data->netplay) {
+		PrintNetplayStats(game, data->netplay);
 	}
-	if ((ev->type == ALLEGRO_EVENT_KEY_UP) && (ev->keyboard.keycode == ALLEGRO_KEY_A)) {
-		data->backward_left = false;
+
+	if ((ev->type == ALLEGRO_EVENT_KEY_DOWN) || (ev->type == ALLEGRO_EVENT_KEY_UP)) {
+		int player = -1;
+		unsigned char key = 0;
+		switch (ev->keyboard.keycode) {
+			case ALLEGRO_KEY_RIGHT:
+				player = 1;
+				key = INPUT_FORWARD;
+				break;
+			case ALLEGRO_KEY_LEFT:
+				player = 1;
+				key = INPUT_BACKWARD;
+				break;
+			case ALLEGRO_KEY_D:
+				player = 0;
+				key = INPUT_FORWARD;
+				break;
+			case ALLEGRO_KEY_A:
+				player = 0;
+				key = INPUT_BACKWARD;
+				break;
+		}
+		if (player >= 0) {
+			if (ev->type == ALLEGRO_EVENT_KEY_DOWN) {
+				PressKey(data, player, key, ev->any.timestamp);
+				if (data->latency) {
+					NoteLatencyPress(data->latency, player, ev->any.timestamp, al_get_time());
+				}
+				if (player) {
+					data->right_buttons = false;
+				} else {
+					data->left_buttons = false;
+				}
+			} else {
+				ReleaseKey(data, player, key, ev->any.timestamp);
+			}
+		}
 	}
+
 	if ((ev->type == ALLEGRO_EVENT_KEY_UP) && (ev->keyboard.keycode == ALLEGRO_KEY_SPACE)) {
-		if (data->started) {
-			return;
+		if (data->matchThread) {
+			TapMatchInput(data->matchThread, 0, INPUT_START);
+		} else {
+			data->pressed[0] |= INPUT_START;
 		}
-		al_rewind_audio_stream(data->music);
-		al_set_audio_stream_playing(data->music, true);
-
-		data->dx = 12 * (((rand() % 2) * 2) - 1);
-		data->dy = 4;
-		data->ballx = 1920 / 2 - 10;
-		data->bally = 1080 / 2 - 100;
-		data->started = true;
-		data->leftscore = 0;
-		data->rightscore = 0;
-		data->scoreleft = (data->dx < 0);
-		data->lastleft = data->scoreleft;
 	}
 }
 
@@ -1047,226 +1283,234 @@ void* Gamestate_Load(struct Game* game, void (*progress)(struct Game*)) {
 	// Good place for allocating memory, loading bitmaps etc.
 	struct GamestateResources* data = calloc(1, sizeof(struct GamestateResources));
 
-	data->small = al_load_font(GetDataFilePath(game, "fonts/belligerent.ttf"), 53, 0);
+	data->small = TrackFont(game, RESOURCE_OWNER, al_load_font(GetDataFilePath(game, "fonts/belligerent.ttf"), 53, 0));
 	progress(game); // report that we progressed with the loading, so the engine can draw a progress bar
-	data->big = al_load_font(GetDataFilePath(game, "fonts/belligerent.ttf"), 200, 0);
+	data->big = TrackFont(game, RESOURCE_OWNER, al_load_font(GetDataFilePath(game, "fonts/belligerent.ttf"), 200, 0));
 	progress(game);
-	data->scorefont = al_load_font(GetDataFilePath(game, "fonts/belligerent.ttf"), 400, 0);
+	data->scorefont = TrackFont(game, RESOURCE_OWNER, al_load_font(GetDataFilePath(game, "fonts/belligerent.ttf"), 400, 0));
 	progress(game);
 
-	data->yay1s = al_load_sample(GetDataFilePath(game, "sounds/yay1.flac"));
-	data->yay1 = al_create_sample_instance(data->yay1s);
-	al_attach_sample_instance_to_mixer(data->yay1, game->audio.fx);
-	al_set_sample_instance_gain(data->yay1, 2.2);
-	al_set_sample_instance_playmode(data->yay1, ALLEGRO_PLAYMODE_ONCE);
+	data->yay1s = TrackSample(game, RESOURCE_OWNER, al_load_sample(GetDataFilePath(game, "sounds/yay1.flac")));
 	progress(game);
 
-	data->yay2s = al_load_sample(GetDataFilePath(game, "sounds/yay2.flac"));
-	data->yay2 = al_create_sample_instance(data->yay2s);
-	al_attach_sample_instance_to_mixer(data->yay2, game->audio.fx);
-	al_set_sample_instance_gain(data->yay2, 2.2);
-	al_set_sample_instance_playmode(data->yay2, ALLEGRO_PLAYMODE_ONCE);
+	data->yay2s = TrackSample(game, RESOURCE_OWNER, al_load_sample(GetDataFilePath(game, "sounds/yay2.flac")));
 	progress(game);
 
-	data->yay3s = al_load_sample(GetDataFilePath(game, "sounds/yay3.flac"));
-	data->yay3 = al_create_sample_instance(data->yay3s);
-	al_attach_sample_instance_to_mixer(data->yay3, game->audio.fx);
-	al_set_sample_instance_gain(data->yay3, 2.2);
-	al_set_sample_instance_playmode(data->yay3, ALLEGRO_PLAYMODE_ONCE);
+	data->yay3s = TrackSample(game, RESOURCE_OWNER, al_load_sample(GetDataFilePath(game, "sounds/yay3.flac")));
 	progress(game);
 
-	data->balls = al_load_sample(GetDataFilePath(game, "sounds/ball.flac"));
-	data->ballsound = al_create_sample_instance(data->balls);
-	al_attach_sample_instance_to_mixer(data->ballsound, game->audio.fx);
-	al_set_sample_instance_gain(data->ballsound, 2.2);
-	al_set_sample_instance_playmode(data->ballsound, ALLEGRO_PLAYMODE_ONCE);
+	data->balls = TrackSample(game, RESOURCE_OWNER, al_load_sample(GetDataFilePath(game, "sounds/ball.flac")));
+	data->sfx = CreateSfxPool(game, game->audio.fx, strtol(GetConfigOptionDefault(game, "nowandthen", "sfx_voices", "8"), NULL, 10));
 	progress(game);
 
-	data->bg = al_load_bitmap(GetDataFilePath(game, "bg.png"));
+	data->bg = TrackBitmap(game, RESOURCE_OWNER, al_load_bitmap(GetDataFilePath(game, "bg.png")));
 	progress(game);
-	data->bg2 = al_load_bitmap(GetDataFilePath(game, "bg2.png"));
+	data->bg2 = TrackBitmap(game, RESOURCE_OWNER, al_load_bitmap(GetDataFilePath(game, "bg2.png")));
 	progress(game);
-	data->fg = al_load_bitmap(GetDataFilePath(game, "fg.png"));
+	data->fg = TrackBitmap(game, RESOURCE_OWNER, al_load_bitmap(GetDataFilePath(game, "fg.png")));
 	progress(game);
-	data->fg2 = al_load_bitmap(GetDataFilePath(game, "fg2.png"));
+	data->fg2 = TrackBitmap(game, RESOURCE_OWNER, al_load_bitmap(GetDataFilePath(game, "fg2.png")));
 	progress(game);
-	data->frame = al_load_bitmap(GetDataFilePath(game, "frame.png"));
+	data->frame = TrackBitmap(game, RESOURCE_OWNER, al_load_bitmap(GetDataFilePath(game, "frame.png")));
 	progress(game);
-	data->trees = al_load_bitmap(GetDataFilePath(game, "trees.png"));
+	data->trees = TrackBitmap(game, RESOURCE_OWNER, al_load_bitmap(GetDataFilePath(game, "trees.png")));
 	progress(game);
-	data->tree = al_load_bitmap(GetDataFilePath(game, "tree.png"));
+	data->tree = TrackBitmap(game, RESOURCE_OWNER, al_load_bitmap(GetDataFilePath(game, "tree.png")));
 	progress(game);
-	data->key1 = al_load_bitmap(GetDataFilePath(game, "klawisz_lewy.png"));
-	data->key2 = al_load_bitmap(GetDataFilePath(game, "klawisz_prawy.png"));
+	data->key1 = TrackBitmap(game, RESOURCE_OWNER, al_load_bitmap(GetDataFilePath(game, "klawisz_lewy.png")));
+	data->key2 = TrackBitmap(game, RESOURCE_OWNER, al_load_bitmap(GetDataFilePath(game, "klawisz_prawy.png")));
 	progress(game);
-	data->arrow1 = al_load_bitmap(GetDataFilePath(game, "strzalka_lewo.png"));
-	data->arrow2 = al_load_bitmap(GetDataFilePath(game, "strzalka_prawo.png"));
-	progress(game);
-	data->target = CreateNotPreservedBitmap(1920 / 2, 1080 / 2);
-	data->scene = CreateNotPreservedBitmap(1920, 1080);
-	data->scorebmp = CreateNotPreservedBitmap(1920, 1080);
-
-	data->leaf.bitmap = al_load_bitmap(GetDataFilePath(game, "leaf.png"));
+	data->arrow1 = TrackBitmap(game, RESOURCE_OWNER, al_load_bitmap(GetDataFilePath(game, "strzalka_lewo.png")));
+	data->arrow2 = TrackBitmap(game, RESOURCE_OWNER, al_load_bitmap(GetDataFilePath(game, "strzalka_prawo.png")));
 	progress(game);
+	data->render.min = fmax(strtod(GetConfigOptionDefault(game, "nowandthen", "render_scale_min", "0.5"), NULL), RENDER_SCALE_STEP);
+	data->render.max = fmin(strtod(GetConfigOptionDefault(game, "nowandthen", "render_scale_max", "1.0"), NULL), 1.0);
+	data->render.min = fmin(data->render.min, data->render.max);
+	data->render.scale = strtod(GetConfigOptionDefault(game, "nowandthen", "render_scale", "1.0"), NULL);
+	data->render.scale = round(fmax(data->render.min, fmin(data->render.max, data->render.scale)) / RENDER_SCALE_STEP) * RENDER_SCALE_STEP;
+	data->render.dynamic = strtol(GetConfigOptionDefault(game, "nowandthen", "dynamic_resolution", "1"), NULL, 10);
+	data->render.targetFps = fmax(strtod(GetConfigOptionDefault(game, "nowandthen", "target_fps", "60"), NULL), 1.0);
+	SetupViews(game, data);
+	CreateRenderTargets(game, data);
+	data->scorebmp = TrackBitmap(game, RESOURCE_OWNER, CreateNotPreservedBitmap(1920, 1080));
+
+	if (data->render.min <= HALF_LAYER_SCALE) {
+		data->bg_half = CreateHalfSizeBitmap(game, data->bg);
+		data->bg2_half = CreateHalfSizeBitmap(game, data->bg2);
+		data->fg_half = CreateHalfSizeBitmap(game, data->fg);
+		data->fg2_half = CreateHalfSizeBitmap(game, data->fg2);
+		data->trees_half = CreateHalfSizeBitmap(game, data->trees);
+	}
+	data->noise = CreateNoiseBitmap(game);
+	al_set_target_backbuffer(game->display);
 
-	data->ostronos.bitmap = al_load_bitmap(GetDataFilePath(game, "animals/ostronos.png"));
-	progress(game);
-	data->owca.bitmap = al_load_bitmap(GetDataFilePath(game, "animals/owca.png"));
-	progress(game);
-	data->dzik.bitmap = al_load_bitmap(GetDataFilePath(game, "animals/dzik.png"));
+	data->ostronos.bitmap = TrackBitmap(game, RESOURCE_OWNER, al_load_bitmap(GetDataFilePath(game, "animals/ostronos.png")));
 	progress(game);
-	data->ostronos.bitmap_sitting = al_load_bitmap(GetDataFilePath(game, "animals/ostronos1.png"));
+	data->owca.bitmap = TrackBitmap(game, RESOURCE_OWNER, al_load_bitmap(GetDataFilePath(game, "animals/owca.png")));
 	progress(game);
-	data->owca.bitmap_sitting = al_load_bitmap(GetDataFilePath(game, "animals/owca1.png"));
+	data->dzik.bitmap = TrackBitmap(game, RESOURCE_OWNER, al_load_bitmap(GetDataFilePath(game, "animals/dzik.png")));
 	progress(game);
-	data->dzik.bitmap_sitting = al_load_bitmap(GetDataFilePath(game, "animals/dzik1.png"));
+	data->ostronos.bitmap_sitting = TrackBitmap(game, RESOURCE_OWNER, al_load_bitmap(GetDataFilePath(game, "animals/ostronos1.png")));
 	progress(game);
-	data->dzik.benchPos = 310;
-	data->dzik.zIndex = 1;
-	data->owca.benchPos = 310;
-	data->owca.zIndex = 0;
-	data->ostronos.benchPos = 350;
-	data->ostronos.zIndex = 2;
-
-	data->bee1 = al_load_bitmap(GetDataFilePath(game, "animals/pszczolka1.png"));
+	data->owca.bitmap_sitting = TrackBitmap(game, RESOURCE_OWNER, al_load_bitmap(GetDataFilePath(game, "animals/owca1.png")));
 	progress(game);
-	data->bee2 = al_load_bitmap(GetDataFilePath(game, "animals/pszczolka2.png"));
+	data->dzik.bitmap_sitting = TrackBitmap(game, RESOURCE_OWNER, al_load_bitmap(GetDataFilePath(game, "animals/dzik1.png")));
 	progress(game);
-	data->bee3 = al_load_bitmap(GetDataFilePath(game, "animals/pszczolka3.png"));
+	data->animalTypes[ANIMAL_OWCA] = &data->owca;
+	data->animalTypes[ANIMAL_OSTRONOS] = &data->ostronos;
+	data->animalTypes[ANIMAL_DZIK] = &data->dzik;
+
+	data->particles = LoadParticles(game, GetConfigOptionDefault(game, "nowandthen", "particles", "particles.ini"));
 	progress(game);
-	data->title = al_load_bitmap(GetDataFilePath(game, "title.png"));
+	data->title = TrackBitmap(game, RESOURCE_OWNER, al_load_bitmap(GetDataFilePath(game, "title.png")));
 	progress(game);
 
-	data->rewind = al_load_audio_stream(GetDataFilePath(game, "sounds/rewind.ogg"), 8, 1024);
-	al_set_audio_stream_gain(data->rewind, 0);
+	data->rewind = TrackAudioStream(game, RESOURCE_OWNER, LoadLowLatencyAudioStream(game, GetDataFilePath(game, "sounds/rewind.ogg")));
 	al_set_audio_stream_playmode(data->rewind, ALLEGRO_PLAYMODE_LOOP);
-	al_attach_audio_stream_to_mixer(data->rewind, game->audio.fx);
+	data->ramps.rewind = CreateAudioRamp(game, data->rewind, game->audio.fx, 0);
 	progress(game);
 
-	data->music = al_load_audio_stream(GetDataFilePath(game, "sounds/music.flac"), 8, 1024);
+	data->music = TrackAudioStream(game, RESOURCE_OWNER, al_load_audio_stream(GetDataFilePath(game, "sounds/music.flac"), 8, 1024));
 	al_set_audio_stream_playmode(data->music, ALLEGRO_PLAYMODE_LOOP);
 	al_set_audio_stream_playing(data->music, false);
 	al_attach_audio_stream_to_mixer(data->music, game->audio.music);
 	progress(game);
 
-	data->day1 = al_load_audio_stream(GetDataFilePath(game, "sounds/day1.ogg"), 8, 1024);
-	al_set_audio_stream_gain(data->day1, 0);
-	al_attach_audio_stream_to_mixer(data->day1, game->audio.fx);
+	data->day1 = TrackAudioStream(game, RESOURCE_OWNER, LoadLowLatencyAudioStream(game, GetDataFilePath(game, "sounds/day1.ogg")));
+	data->ramps.day1 = CreateAudioRamp(game, data->day1, game->audio.fx, 0);
 	al_set_audio_stream_pan(data->day1, -0.5);
 	al_set_audio_stream_playmode(data->day1, ALLEGRO_PLAYMODE_LOOP);
 	progress(game);
 
-	data->day2 = al_load_audio_stream(GetDataFilePath(game, "sounds/day2.ogg"), 8, 1024);
-	al_set_audio_stream_gain(data->day2, 0);
-	al_attach_audio_stream_to_mixer(data->day2, game->audio.fx);
+	data->day2 = TrackAudioStream(game, RESOURCE_OWNER, LoadLowLatencyAudioStream(game, GetDataFilePath(game, "sounds/day2.ogg")));
+	data->ramps.day2 = CreateAudioRamp(game, data->day2, game->audio.fx, 0);
 	al_set_audio_stream_pan(data->day2, 0.5);
 	al_set_audio_stream_playmode(data->day2, ALLEGRO_PLAYMODE_LOOP);
 	progress(game);
 
-	data->night1 = al_load_audio_stream(GetDataFilePath(game, "sounds/night1.ogg"), 8, 1024);
-	al_set_audio_stream_gain(data->night1, 0);
-	al_attach_audio_stream_to_mixer(data->night1, game->audio.fx);
+	data->night1 = TrackAudioStream(game, RESOURCE_OWNER, LoadLowLatencyAudioStream(game, GetDataFilePath(game, "sounds/night1.ogg")));
+	data->ramps.night1 = CreateAudioRamp(game, data->night1, game->audio.fx, 0);
 	al_set_audio_stream_pan(data->night1, -0.5);
 	al_set_audio_stream_playmode(data->night1, ALLEGRO_PLAYMODE_LOOP);
 	progress(game);
 
-	data->night2 = al_load_audio_stream(GetDataFilePath(game, "sounds/night2.ogg"), 8, 1024);
-	al_set_audio_stream_gain(data->night2, 0);
-	al_attach_audio_stream_to_mixer(data->night2, game->audio.fx);
+	data->night2 = TrackAudioStream(game, RESOURCE_OWNER, LoadLowLatencyAudioStream(game, GetDataFilePath(game, "sounds/night2.ogg")));
+	data->ramps.night2 = CreateAudioRamp(game, data->night2, game->audio.fx, 0);
 	al_set_audio_stream_pan(data->night2, 0.5);
 	al_set_audio_stream_playmode(data->night2, ALLEGRO_PLAYMODE_LOOP);
 	progress(game);
 
-	data->ball = al_load_bitmap(GetDataFilePath(game, "ball.png"));
+	data->ball = TrackBitmap(game, RESOURCE_OWNER, al_load_bitmap(GetDataFilePath(game, "ball.png")));
 	progress(game);
-	data->clock1 = al_load_bitmap(GetDataFilePath(game, "clock1.png"));
+	data->clock1 = TrackBitmap(game, RESOURCE_OWNER, al_load_bitmap(GetDataFilePath(game, "clock1.png")));
 	progress(game);
-	data->clock2 = al_load_bitmap(GetDataFilePath(game, "clock2.png"));
+	data->clock2 = TrackBitmap(game, RESOURCE_OWNER, al_load_bitmap(GetDataFilePath(game, "clock2.png")));
 	progress(game);
-	data->clockball1 = al_load_bitmap(GetDataFilePath(game, "clockball1.png"));
+	data->clockball1 = TrackBitmap(game, RESOURCE_OWNER, al_load_bitmap(GetDataFilePath(game, "clockball1.png")));
 	progress(game);
-	data->clockball2 = al_load_bitmap(GetDataFilePath(game, "clockball2.png"));
+	data->clockball2 = TrackBitmap(game, RESOURCE_OWNER, al_load_bitmap(GetDataFilePath(game, "clockball2.png")));
 	progress(game);
-	data->hand1 = al_load_bitmap(GetDataFilePath(game, "hand1.png"));
+	data->hand1 = TrackBitmap(game, RESOURCE_OWNER, al_load_bitmap(GetDataFilePath(game, "hand1.png")));
 	progress(game);
-	data->hand2 = al_load_bitmap(GetDataFilePath(game, "hand2.png"));
+	data->hand2 = TrackBitmap(game, RESOURCE_OWNER, al_load_bitmap(GetDataFilePath(game, "hand2.png")));
 	progress(game);
-	data->scores = al_load_bitmap(GetDataFilePath(game, "scores.png"));
+	data->scores = TrackBitmap(game, RESOURCE_OWNER, al_load_bitmap(GetDataFilePath(game, "scores.png")));
 	progress(game);
 
-	CreatePaths(game, data);
-	DGZ(game, data);
+	// Stress mode fills a grid of small parks with up to hundreds of thousands of walks a day.
+	data->stress.enabled = strtol(GetConfigOptionDefault(game, "nowandthen", "crowd_stress", "0"), NULL, 10);
+	int tiles = strtol(GetConfigOptionDefault(game, "nowandthen", "crowd_tiles", data->stress.enabled ? "4" : "1"), NULL, 10);
+	data->dgzParams = DefaultDgzParams;
+	data->dgzParams.density = fmax(strtod(GetConfigOptionDefault(game, "nowandthen", "animal_density", data->stress.enabled ? "1280" : "1"), NULL), 0.001);
+	CreateDgzPaths(&data->paths, (tiles > 0) ? tiles : 1);
+	data->dgzSeed = ((uint64_t)rand() << 32) | rand();
+	// Days get generated on a worker thread while the ones before them are played; without
+	// rolling days, the first one just loops.
+	data->days.rolling = strtol(GetConfigOptionDefault(game, "nowandthen", "rolling_days", "1"), NULL, 10);
+	data->days.ring = CreateDayRing(&data->paths, &data->dgzParams, data->dgzSeed);
+	data->days.wait = true;
+	ResetClocks(data);
+	SyncDays(game, data);
+	data->days.wait = false;
 	progress(game);
 
-	data->drawCommandBuffer = calloc(data->animalsCount, sizeof(struct DrawCommand));
-
 	return data;
 }
 
 void Gamestate_Unload(struct Game* game, struct GamestateResources* data) {
 	// Called when the gamestate library is being unloaded.
 	// Good place for freeing all allocated memory and resources.
-
-	al_destroy_font(data->big);
-	al_destroy_font(data->small);
-	al_destroy_font(data->scorefont);
-
-	al_destroy_bitmap(data->bg);
-	al_destroy_bitmap(data->bg2);
-	al_destroy_bitmap(data->fg);
-	al_destroy_bitmap(data->fg2);
-	al_destroy_bitmap(data->frame);
-	al_destroy_bitmap(data->target);
-	al_destroy_bitmap(data->scene);
-	al_destroy_bitmap(data->bee1);
-	al_destroy_bitmap(data->bee2);
-	al_destroy_bitmap(data->bee3);
-	al_destroy_bitmap(data->title);
-	al_destroy_bitmap(data->key1);
-	al_destroy_bitmap(data->key2);
-	al_destroy_bitmap(data->arrow1);
-	al_destroy_bitmap(data->arrow2);
-	al_destroy_bitmap(data->clock1);
-	al_destroy_bitmap(data->clock2);
-	al_destroy_bitmap(data->clockball1);
-	al_destroy_bitmap(data->clockball2);
-	al_destroy_bitmap(data->hand1);
-	al_destroy_bitmap(data->hand2);
-	al_destroy_bitmap(data->ball);
-	al_destroy_bitmap(data->trees);
-	al_destroy_bitmap(data->tree);
-	al_destroy_bitmap(data->scores);
-	al_destroy_bitmap(data->scorebmp);
-	al_destroy_bitmap(data->dzik.bitmap);
-	al_destroy_bitmap(data->ostronos.bitmap);
-	al_destroy_bitmap(data->owca.bitmap);
-	al_destroy_bitmap(data->leaf.bitmap);
-	al_destroy_bitmap(data->dzik.bitmap_sitting);
-	al_destroy_bitmap(data->ostronos.bitmap_sitting);
-	al_destroy_bitmap(data->owca.bitmap_sitting);
-
-	al_destroy_audio_stream(data->day1);
-	al_destroy_audio_stream(data->day2);
-	al_destroy_audio_stream(data->night1);
-	al_destroy_audio_stream(data->night2);
-	al_destroy_audio_stream(data->rewind);
-	al_destroy_audio_stream(data->music);
-
-	al_destroy_sample_instance(data->yay1);
-	al_destroy_sample_instance(data->yay2);
-	al_destroy_sample_instance(data->yay3);
-	al_destroy_sample_instance(data->ballsound);
-	al_destroy_sample(data->yay1s);
-	al_destroy_sample(data->yay2s);
-	al_destroy_sample(data->yay3s);
-	al_destroy_sample(data->balls);
-
-	free(data->animals);
-	free(data->drawCommandBuffer);
-	for (unsigned int i = 0; i < (sizeof(data->paths) / sizeof(struct Path*)); i++) {
-		free(data->paths[i]);
+	PrintResourceReport(game, RESOURCE_OWNER);
+
+	DestroyTrackedFont(game, data->big);
+	DestroyTrackedFont(game, data->small);
+	DestroyTrackedFont(game, data->scorefont);
+
+	DestroyTrackedBitmap(game, data->bg);
+	DestroyTrackedBitmap(game, data->bg2);
+	DestroyTrackedBitmap(game, data->fg);
+	DestroyTrackedBitmap(game, data->fg2);
+	DestroyTrackedBitmap(game, data->frame);
+	DestroyTrackedBitmap(game, data->target);
+	DestroyTrackedBitmap(game, data->scene);
+	DestroyTrackedBitmap(game, data->title);
+	DestroyTrackedBitmap(game, data->key1);
+	DestroyTrackedBitmap(game, data->key2);
+	DestroyTrackedBitmap(game, data->arrow1);
+	DestroyTrackedBitmap(game, data->arrow2);
+	DestroyTrackedBitmap(game, data->clock1);
+	DestroyTrackedBitmap(game, data->clock2);
+	DestroyTrackedBitmap(game, data->clockball1);
+	DestroyTrackedBitmap(game, data->clockball2);
+	DestroyTrackedBitmap(game, data->hand1);
+	DestroyTrackedBitmap(game, data->hand2);
+	DestroyTrackedBitmap(game, data->ball);
+	DestroyTrackedBitmap(game, data->trees);
+	DestroyTrackedBitmap(game, data->noise);
+	if (data->bg_half) {
+		DestroyTrackedBitmap(game, data->bg_half);
+		DestroyTrackedBitmap(game, data->bg2_half);
+		DestroyTrackedBitmap(game, data->fg_half);
+		DestroyTrackedBitmap(game, data->fg2_half);
+		DestroyTrackedBitmap(game, data->trees_half);
 	}
+	DestroyTrackedBitmap(game, data->tree);
+	DestroyTrackedBitmap(game, data->scores);
+	DestroyTrackedBitmap(game, data->scorebmp);
+	DestroyTrackedBitmap(game, data->dzik.bitmap);
+	DestroyTrackedBitmap(game, data->ostronos.bitmap);
+	DestroyTrackedBitmap(game, data->owca.bitmap);
+	DestroyParticles(game, data->particles);
+	DestroyTrackedBitmap(game, data->dzik.bitmap_sitting);
+	DestroyTrackedBitmap(game, data->ostronos.bitmap_sitting);
+	DestroyTrackedBitmap(game, data->owca.bitmap_sitting);
+
+	DestroyAudioRamp(data->ramps.day1);
+	DestroyAudioRamp(data->ramps.day2);
+	DestroyAudioRamp(data->ramps.night1);
+	DestroyAudioRamp(data->ramps.night2);
+	DestroyAudioRamp(data->ramps.rewind);
+	DestroyTrackedAudioStream(game, data->day1);
+	DestroyTrackedAudioStream(game, data->day2);
+	DestroyTrackedAudioStream(game, data->night1);
+	DestroyTrackedAudioStream(game, data->night2);
+	DestroyTrackedAudioStream(game, data->rewind);
+	DestroyTrackedAudioStream(game, data->music);
+
+	if (game->config.debug) {
+		PrintSfxStats(game, data->sfx);
+	}
+	DestroySfxPool(data->sfx);
+	DestroyTrackedSample(game, data->yay1s);
+	DestroyTrackedSample(game, data->yay2s);
+	DestroyTrackedSample(game, data->yay3s);
+	DestroyTrackedSample(game, data->balls);
+
+	DestroyDayRing(data->days.ring);
+	free(data->poses);
+	DestroyDgzPaths(&data->paths);
 
+	ReportResourceLeaks(game, RESOURCE_OWNER);
 	free(data);
 }
 
@@ -1274,51 +1518,74 @@ void Gamestate_Start(struct Game* game, struct GamestateResources* data) {
 	// Called when this gamestate gets control. Good place for initializing state,
 	// playing music etc.
 	data->counter = 0;
-	data->cooldown = 0;
-	data->fade_left = 0;
-	data->fade_right = 0;
-	data->time_left = 0;
-	data->time_right = 0;
-	data->backward_left = false;
-	data->forward_right = false;
-	data->backward_right = false;
-	data->forward_left = false;
-	data->lastbackward_left = false;
-	data->lastbackward_right = false;
-	data->ballrot = 0;
+	InitMatch(&data->match, ((uint64_t)rand() << 32) | rand());
+	ResetClocks(data);
+	SyncDays(game, data);
+	memset(data->keys, 0, sizeof(data->keys));
+	memset(data->pressed, 0, sizeof(data->pressed));
+	memset(data->pressedAt, 0, sizeof(data->pressedAt));
+	memset(data->releasedAt, 0, sizeof(data->releasedAt));
+	data->lastTick = al_get_time();
+
+	data->netplay = NULL;
+	data->spectateServer = NULL;
+	data->spectateClient = NULL;
+	struct NetplayOptions* options = &game->data->netplay;
+	if (options->spectateAddress[0]) {
+		data->spectateClient = CreateSpectateClient(options->spectateAddress, options->spectatePort);
+		PrintConsole(game, data->spectateClient ? "Spectating %s:%d" : "Can't spectate %s:%d", options->spectateAddress, options->spectatePort);
+	} else if (options->mode != NETPLAY_OFF) {
+		data->netplay = CreateNetplay(game, options);
+	}
+	if (options->spectateServer && !data->spectateClient) {
+		int interval = strtol(GetConfigOptionDefault(game, "nowandthen", "spectate_interval", "2"), NULL, 10);
+		data->spectateServer = CreateSpectateServer(options->spectatePort, interval);
+		PrintConsole(game, data->spectateServer ? "Broadcasting to spectators on port %d" : "Can't broadcast on port %d", options->spectatePort);
+	}
+	// netplay and spectating have their own clocks to follow, and the benchmark has to be repeatable
+	data->matchThread = NULL;
+	if (!data->netplay && !data->spectateClient && !game->data->benchmark.frames && strtol(GetConfigOptionDefault(game, "nowandthen", "match_thread", "1"), NULL, 10)) {
+		data->matchThread = CreateMatchThread(&data->match);
+		if (!data->matchThread) {
+			PrintConsole(game, "Can't start the match thread, stepping the match along with the frames");
+		}
+	}
+	// only the local match is followed; netplay holds the inputs back on purpose
+	data->latency = NULL;
+	if (!data->netplay && !data->spectateClient && !game->data->benchmark.frames && strtol(GetConfigOptionDefault(game, "nowandthen", "input_latency", "0"), NULL, 10)) {
+		data->latency = CreateInputLatency();
+	}
+	data->latencyMarker = data->latency && strtol(GetConfigOptionDefault(game, "nowandthen", "latency_marker", "0"), NULL, 10);
 
 	data->left_buttons = true;
 	data->right_buttons = true;
 
-	data->started = false;
-	data->dx = 0;
-	data->dy = 0;
-	data->ballx = 1920 / 2 - 10;
-	data->bally = 1080 / 2 - 100;
-
-	data->leftscore = 0;
-	data->rightscore = 0;
-
-	data->shakeleft = 0;
-	data->shakeright = 0;
-
-	data->score = 0;
-	data->delay = -1;
-
-	data->shader = al_create_shader(ALLEGRO_SHADER_GLSL);
-	PrintConsole(game, "VERTEX: %d", al_attach_shader_source_file(data->shader, ALLEGRO_VERTEX_SHADER, GetDataFilePath(game, "shaders/vertex.glsl")));
-	const char* log;
-	if ((log = al_get_shader_log(data->shader)) && (log[0])) {
-		PrintConsole(game, "%s", log);
-	}
-	PrintConsole(game, "PIXEL: %d", al_attach_shader_source_file(data->shader, ALLEGRO_PIXEL_SHADER, GetDataFilePath(game, "shaders/vhs.glsl")));
-	if ((log = al_get_shader_log(data->shader)) && (log[0])) {
-		PrintConsole(game, "%s", log);
-	}
-	al_build_shader(data->shader);
-	if ((log = al_get_shader_log(data->shader)) && (log[0])) {
-		PrintConsole(game, "%s", log);
+	// the stress mode is there to measure every frame
+	data->pacing.enabled = strtol(GetConfigOptionDefault(game, "nowandthen", "adaptive_pacing", "1"), NULL, 10) && !data->stress.enabled;
+	data->pacing.idleFps = fmax(strtod(GetConfigOptionDefault(game, "nowandthen", "idle_fps", "10"), NULL), 1.0);
+	data->pacing.idleTicks = 0;
+	data->pacing.invalidated = true;
+	data->pacing.reportTime = al_get_time();
+
+	data->render.cost = 1.0 / data->render.targetFps;
+	data->render.nextAdjust = al_get_time() + 1.0;
+	data->render.lastIncrease = 0;
+	data->render.increaseDelay = 5.0;
+
+	const char* quality = GetConfigOptionDefault(game, "nowandthen", "vhs_effect", "full");
+	data->vhsQuality = VHS_FULL;
+	for (int i = 0; i < VHS_VARIANTS; i++) {
+		if (strcmp(quality, vhsVariantNames[i]) == 0) {
+			data->vhsQuality = i;
+		}
 	}
+	data->vhsProfile.enabled = strtol(GetConfigOptionDefault(game, "nowandthen", "profile_vhs", "0"), NULL, 10);
+	data->vhsProfile.reportTime = al_get_time();
+	data->stress.reportTime = al_get_time();
+	CreateVHSShaders(game, data);
+	CreateAnimalRenderer(game, data);
+	CreateParticleRenderer(game, data);
+	data->gpuTimers = CreateGpuTimers(game, PASS_VIEWS + data->viewCount * 2, passNames);
 
 	al_set_target_bitmap(data->scorebmp);
 	al_clear_to_color(al_map_rgba(0, 0, 0, 0));
@@ -1327,35 +1594,58 @@ void Gamestate_Start(struct Game* game, struct GamestateResources* data) {
 
 void Gamestate_Stop(struct Game* game, struct GamestateResources* data) {
 	// Called when gamestate gets stopped. Stop timers, music etc. here.
-	al_destroy_shader(data->shader);
+	if (data->matchThread) {
+		DestroyMatchThread(data->matchThread);
+		data->matchThread = NULL;
+	}
+	if (data->latency) {
+		DestroyInputLatency(game, data->latency);
+		data->latency = NULL;
+	}
+	DestroyVHSShaders(game, data);
+	DestroyAnimalRenderer(game, data);
+	DestroyParticleBuffer(game, data->particles);
+	DestroyGpuTimers(data->gpuTimers);
+	if (data->netplay) {
+		PrintNetplayStats(game, data->netplay);
+		DestroyNetplay(data->netplay);
+	}
+	if (data->spectateServer) {
+		PrintConsole(game, "Spectators: %d frames, %llu bytes sent", data->spectateServer->seq, data->spectateServer->bytes);
+		DestroySpectateServer(data->spectateServer);
+	}
+	if (data->spectateClient) {
+		PrintConsole(game, "Spectating: %llu frames, %llu bytes, %llu undecodable", data->spectateClient->packets, data->spectateClient->bytes, data->spectateClient->undecodable);
+		DestroySpectateClient(data->spectateClient);
+	}
 }
 
 void Gamestate_Pause(struct Game* game, struct GamestateResources* data) {
 	// Called when gamestate gets paused (so only Draw is being called, no Logic not ProcessEvent)
 	// Pause your timers here.
+	if (data->matchThread) {
+		PauseMatchThread(data->matchThread, true);
+	}
 }
 
 void Gamestate_Resume(struct Game* game, struct GamestateResources* data) {
 	// Called when gamestate gets resumed. Resume your timers here.
+	if (data->matchThread) {
+		PauseMatchThread(data->matchThread, false);
+	}
 }
 
 void Gamestate_Reload(struct Game* game, struct GamestateResources* data) {
-	data->target = CreateNotPreservedBitmap(1920 / 2, 1080 / 2);
-	data->scene = CreateNotPreservedBitmap(1920, 1080);
-	data->scorebmp = CreateNotPreservedBitmap(1920, 1080);
-	al_destroy_shader(data->shader);
-	data->shader = al_create_shader(ALLEGRO_SHADER_GLSL);
-	PrintConsole(game, "VERTEX: %d", al_attach_shader_source_file(data->shader, ALLEGRO_VERTEX_SHADER, GetDataFilePath(game, "shaders/vertex.glsl")));
-	const char* log;
-	if ((log = al_get_shader_log(data->shader)) && (log[0])) {
-		PrintConsole(game, "%s", log);
-	}
-	PrintConsole(game, "PIXEL: %d", al_attach_shader_source_file(data->shader, ALLEGRO_PIXEL_SHADER, GetDataFilePath(game, "shaders/vhs.glsl")));
-	if ((log = al_get_shader_log(data->shader)) && (log[0])) {
-		PrintConsole(game, "%s", log);
-	}
-	al_build_shader(data->shader);
-	if ((log = al_get_shader_log(data->shader)) && (log[0])) {
-		PrintConsole(game, "%s", log);
-	}
+	DestroyTrackedBitmap(game, data->target);
+	DestroyTrackedBitmap(game, data->scene);
+	DestroyTrackedBitmap(game, data->scorebmp);
+	CreateRenderTargets(game, data);
+	data->scorebmp = TrackBitmap(game, RESOURCE_OWNER, CreateNotPreservedBitmap(1920, 1080));
+	DestroyVHSShaders(game, data);
+	CreateVHSShaders(game, data);
+	DestroyAnimalRenderer(game, data);
+	CreateAnimalRenderer(game, data);
+	DestroyParticleBuffer(game, data->particles);
+	CreateParticleRenderer(game, data);
+	ReloadGpuTimers(game, data->gpuTimers);
 }
@@ -22,6 +22,7 @@
 #include "../common.h"
 #include <libsuperderpy.h>
 
+#define RESOURCE_OWNER "holypangolin"
 #define NEXT_GAMESTATE "game"
 #define SKIP_GAMESTATE NEXT_GAMESTATE
 
@@ -57,10 +58,10 @@ void Gamestate_ProcessEvent(struct Game* game, struct GamestateResources* data,
 
 void* Gamestate_Load(struct Game* game, void (*progress)(struct Game*)) {
 	struct GamestateResources* data = malloc(sizeof(struct GamestateResources));
-	data->bmp = al_load_bitmap(GetDataFilePath(game, "holypangolin.png"));
+	data->bmp = TrackBitmap(game, RESOURCE_OWNER, al_load_bitmap(GetDataFilePath(game, "holypangolin.png")));
 	progress(game); // report that we progressed with the loading, so the engine can draw a progress bar
 
-	data->monkeys = al_load_audio_stream(GetDataFilePath(game, "holypangolin.flac"), 4, 1024);
+	data->monkeys = TrackAudioStream(game, RESOURCE_OWNER, al_load_audio_stream(GetDataFilePath(game, "holypangolin.flac"), 4, 1024));
 	al_set_audio_stream_playing(data->monkeys, false);
 	al_attach_audio_stream_to_mixer(data->monkeys, game->audio.fx);
 	al_set_audio_stream_gain(data->monkeys, 0.75);
@@ -69,8 +70,10 @@ void* Gamestate_Load(struct Game* game, void (*progress)(struct Game*)) {
 }
 
 void Gamestate_Unload(struct Game* game, struct GamestateResources* data) {
-	al_destroy_bitmap(data->bmp);
-	al_destroy_audio_stream(data->monkeys);
+	PrintResourceReport(game, RESOURCE_OWNER);
+	DestroyTrackedBitmap(game, data->bmp);
+	DestroyTrackedAudioStream(game, data->monkeys);
+	ReportResourceLeaks(game, RESOURCE_OWNER);
 	free(data);
 }
 
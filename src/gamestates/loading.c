@@ -21,6 +21,8 @@
 #include "../common.h"
 #include <libsuperderpy.h>
 
+#define RESOURCE_OWNER "loading"
+
 /*! \brief Resources used by Loading state. */
 struct GamestateResources {
 	ALLEGRO_BITMAP *clock, *hand1, *hand2, *clockball, *bmp;
@@ -53,15 +55,22 @@ void Gamestate_Draw(struct Game* game, struct GamestateResources* data) {
 
 void* Gamestate_Load(struct Game* game, void (*progress)(struct Game*)) {
 	struct GamestateResources* data = malloc(sizeof(struct GamestateResources));
-	data->clock = al_load_bitmap(GetDataFilePath(game, "clock1.png"));
-	data->clockball = al_load_bitmap(GetDataFilePath(game, "clockball1.png"));
-	data->hand1 = al_load_bitmap(GetDataFilePath(game, "hand1.png"));
-	data->hand2 = al_load_bitmap(GetDataFilePath(game, "hand2.png"));
-	data->bmp = CreateNotPreservedBitmap(al_get_bitmap_width(data->clock), al_get_bitmap_height(data->clock));
+	data->clock = TrackBitmap(game, RESOURCE_OWNER, al_load_bitmap(GetDataFilePath(game, "clock1.png")));
+	data->clockball = TrackBitmap(game, RESOURCE_OWNER, al_load_bitmap(GetDataFilePath(game, "clockball1.png")));
+	data->hand1 = TrackBitmap(game, RESOURCE_OWNER, al_load_bitmap(GetDataFilePath(game, "hand1.png")));
+	data->hand2 = TrackBitmap(game, RESOURCE_OWNER, al_load_bitmap(GetDataFilePath(game, "hand2.png")));
+	data->bmp = TrackBitmap(game, RESOURCE_OWNER, CreateNotPreservedBitmap(al_get_bitmap_width(data->clock), al_get_bitmap_height(data->clock)));
 	return data;
 }
 
 void Gamestate_Unload(struct Game* game, struct GamestateResources* data) {
+	PrintResourceReport(game, RESOURCE_OWNER);
+	DestroyTrackedBitmap(game, data->clock);
+	DestroyTrackedBitmap(game, data->clockball);
+	DestroyTrackedBitmap(game, data->hand1);
+	DestroyTrackedBitmap(game, data->hand2);
+	DestroyTrackedBitmap(game, data->bmp);
+	ReportResourceLeaks(game, RESOURCE_OWNER);
 	free(data);
 }
 
@@ -69,7 +78,8 @@ void Gamestate_Start(struct Game* game, struct GamestateResources* data) {}
 void Gamestate_Stop(struct Game* game, struct GamestateResources* data) {}
 
 void Gamestate_Reload(struct Game* game, struct GamestateResources* data) {
-	data->bmp = CreateNotPreservedBitmap(al_get_bitmap_width(data->clock), al_get_bitmap_height(data->clock));
+	DestroyTrackedBitmap(game, data->bmp);
+	data->bmp = TrackBitmap(game, RESOURCE_OWNER, CreateNotPreservedBitmap(al_get_bitmap_width(data->clock), al_get_bitmap_height(data->clock)));
 }
 
 void Gamestate_Pause(struct Game* game, struct GamestateResources* data) {}
@@ -0,0 +1,228 @@
+/*! \file gputimer.c
+ *  \brief Asynchronous GPU timestamp queries around render passes.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "common.h"
+#include "gputimer.h"
+#include <allegro5/allegro_opengl.h>
+#include <libsuperderpy.h>
+
+#ifndef APIENTRY
+#define APIENTRY
+#endif
+#ifndef GL_TIMESTAMP
+#define GL_TIMESTAMP 0x8E28
+#endif
+#ifndef GL_QUERY_COUNTER_BITS
+#define GL_QUERY_COUNTER_BITS 0x8864
+#endif
+#ifndef GL_QUERY_RESULT
+#define GL_QUERY_RESULT 0x8866
+#endif
+#ifndef GL_QUERY_RESULT_AVAILABLE
+#define GL_QUERY_RESULT_AVAILABLE 0x8867
+#endif
+
+// Loaded by hand, as they're not part of OpenGL 1.1 that Windows exports.
+static void(APIENTRY* GenQueries)(GLsizei n, GLuint* ids);
+static void(APIENTRY* DeleteQueries)(GLsizei n, const GLuint* ids);
+static void(APIENTRY* QueryCounter)(GLuint id, GLenum target);
+static void(APIENTRY* GetQueryiv)(GLenum target, GLenum pname, GLint* params);
+static void(APIENTRY* GetQueryObjectiv)(GLuint id, GLenum pname, GLint* params);
+static void(APIENTRY* GetQueryObjectui64v)(GLuint id, GLenum pname, GLuint64* params);
+
+static const char* CheckGpuTimers(struct Game* game) {
+	if (!(al_get_display_flags(game->display) & ALLEGRO_OPENGL)) {
+		return "not an OpenGL display";
+	}
+#ifdef ALLEGRO_CFG_OPENGLES
+	return "not supported on OpenGL ES";
+#else
+	if (!al_have_opengl_extension("GL_ARB_timer_query") && (al_get_opengl_version() < 0x03030000)) {
+		return "GL_ARB_timer_query missing";
+	}
+	*(void**)&GenQueries = al_get_opengl_proc_address("glGenQueries");
+	*(void**)&DeleteQueries = al_get_opengl_proc_address("glDeleteQueries");
+	*(void**)&QueryCounter = al_get_opengl_proc_address("glQueryCounter");
+	*(void**)&GetQueryiv = al_get_opengl_proc_address("glGetQueryiv");
+	*(void**)&GetQueryObjectiv = al_get_opengl_proc_address("glGetQueryObjectiv");
+	*(void**)&GetQueryObjectui64v = al_get_opengl_proc_address("glGetQueryObjectui64v");
+	if (!GenQueries || !DeleteQueries || !QueryCounter || !GetQueryiv || !GetQueryObjectiv || !GetQueryObjectui64v) {
+		return "query functions missing";
+	}
+	GLint bits = 0;
+	GetQueryiv(GL_TIMESTAMP, GL_QUERY_COUNTER_BITS, &bits);
+	if (!bits) {
+		return "timestamp counter has no bits";
+	}
+	return NULL;
+#endif
+}
+
+static void InitQueries(struct Game* game, struct GpuTimers* timers) {
+	const char* error = CheckGpuTimers(game);
+	timers->available = !error;
+	if (error) {
+		PrintConsole(game, "GPU timers unavailable: %s", error);
+		return;
+	}
+	for (int i = 0; i < GPU_TIMER_FRAMES; i++) {
+		GenQueries(GPU_TIMER_MAX_PASSES * 2, &timers->frames[i].queries[0][0]);
+		memset(timers->frames[i].issued, 0, sizeof(timers->frames[i].issued));
+	}
+}
+
+struct GpuTimers* CreateGpuTimers(struct Game* game, int passes, const char* names[]) {
+	struct GpuTimers* timers = calloc(1, sizeof(struct GpuTimers));
+	if (passes > GPU_TIMER_MAX_PASSES) {
+		PrintConsole(game, "GPU timers: %d passes requested, only the first %d are timed", passes, GPU_TIMER_MAX_PASSES);
+		passes = GPU_TIMER_MAX_PASSES;
+	}
+	timers->passes = passes;
+	for (int i = 0; i < passes; i++) {
+		timers->names[i] = names[i];
+		timers->stats[i].min = INFINITY;
+	}
+	timers->logInterval = strtod(GetConfigOptionDefault(game, "nowandthen", "gpu_timers_log", "10"), NULL);
+	timers->lastLog = al_get_time();
+	timers->enabled = strtol(GetConfigOptionDefault(game, "nowandthen", "gpu_timers", "0"), NULL, 10);
+	if (timers->enabled) {
+		InitQueries(game, timers);
+	}
+	return timers;
+}
+
+void DestroyGpuTimers(struct GpuTimers* timers) {
+	if (timers->available) {
+		for (int i = 0; i < GPU_TIMER_FRAMES; i++) {
+			DeleteQueries(GPU_TIMER_MAX_PASSES * 2, &timers->frames[i].queries[0][0]);
+		}
+	}
+	free(timers);
+}
+
+void ReloadGpuTimers(struct Game* game, struct GpuTimers* timers) {
+	// the old query objects went away together with the context
+	if (timers->enabled) {
+		InitQueries(game, timers);
+	}
+}
+
+void EnableGpuTimers(struct Game* game, struct GpuTimers* timers) {
+	if (!timers->enabled) {
+		timers->enabled = true;
+		InitQueries(game, timers);
+	}
+}
+
+static void CollectFrame(struct GpuTimers* timers, int frame) {
+	double total = 0;
+	bool collected = false;
+	for (int i = 0; i < timers->passes; i++) {
+		if (!timers->frames[frame].issued[i]) {
+			continue;
+		}
+		timers->frames[frame].issued[i] = false;
+
+		GLint available = 0;
+		GetQueryObjectiv(timers->frames[frame].queries[i][1], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available) {
+			// the GPU is more than GPU_TIMER_FRAMES behind; waiting would stall
+			timers->dropped++;
+			continue;
+		}
+		GLuint64 start, end;
+		GetQueryObjectui64v(timers->frames[frame].queries[i][0], GL_QUERY_RESULT, &start);
+		GetQueryObjectui64v(timers->frames[frame].queries[i][1], GL_QUERY_RESULT, &end);
+		double ms = (end - start) / 1000000.0;
+
+		struct GpuTimerStats* stats = &timers->stats[i];
+		stats->samples++;
+		stats->sum += ms;
+		stats->min = fmin(stats->min, ms);
+		stats->max = fmax(stats->max, ms);
+		timers->last[i] = ms;
+		total += ms;
+		collected = true;
+	}
+	if (collected) {
+		timers->lastFrame = total;
+	}
+}
+
+void ResetGpuTimers(struct GpuTimers* timers) {
+	for (int i = 0; i < timers->passes; i++) {
+		timers->stats[i] = (struct GpuTimerStats){.min = INFINITY};
+	}
+	timers->dropped = 0;
+}
+
+void GpuTimersNewFrame(struct Game* game, struct GpuTimers* timers) {
+	if (!timers->available) {
+		return;
+	}
+	timers->frame = (timers->frame + 1) % GPU_TIMER_FRAMES;
+	// the slot about to be reused holds the oldest queries in flight
+	CollectFrame(timers, timers->frame);
+
+	double now = al_get_time();
+	if ((timers->logInterval > 0) && (now - timers->lastLog >= timers->logInterval)) {
+		char line[255] = "GPU:";
+		for (int i = 0; i < timers->passes; i++) {
+			size_t len = strlen(line);
+			snprintf(line + len, sizeof(line) - len, " %s %.3f ms", timers->names[i], timers->stats[i].samples ? timers->stats[i].sum / timers->stats[i].samples : 0.0);
+		}
+		PrintConsole(game, "%s", line);
+		timers->lastLog = now;
+		ResetGpuTimers(timers);
+	}
+}
+
+void GpuTimerBegin(struct GpuTimers* timers, int pass) {
+	if (!timers->available || (pass >= timers->passes)) {
+		return;
+	}
+	QueryCounter(timers->frames[timers->frame].queries[pass][0], GL_TIMESTAMP);
+}
+
+void GpuTimerEnd(struct GpuTimers* timers, int pass) {
+	if (!timers->available || (pass >= timers->passes)) {
+		return;
+	}
+	QueryCounter(timers->frames[timers->frame].queries[pass][1], GL_TIMESTAMP);
+	timers->frames[timers->frame].issued[pass] = true;
+}
+
+void PrintGpuTimers(struct Game* game, struct GpuTimers* timers) {
+	if (!timers->available) {
+		PrintConsole(game, "%s", timers->enabled ? "GPU timers unavailable" : "GPU timers disabled, set [nowandthen] gpu_timers=1");
+		return;
+	}
+	for (int i = 0; i < timers->passes; i++) {
+		struct GpuTimerStats* stats = &timers->stats[i];
+		if (stats->samples) {
+			PrintConsole(game, "GPU %-10s last %.3f ms, avg %.3f ms, min %.3f ms, max %.3f ms (%d samples)", timers->names[i], timers->last[i], stats->sum / stats->samples, stats->min, stats->max, stats->samples);
+		} else {
+			PrintConsole(game, "GPU %-10s no samples yet", timers->names[i]);
+		}
+	}
+	if (timers->dropped) {
+		PrintConsole(game, "GPU timers: %d results dropped", timers->dropped);
+	}
+}
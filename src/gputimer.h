@@ -0,0 +1,67 @@
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GPUTIMER_H
+#define GPUTIMER_H
+
+#include <libsuperderpy.h>
+
+// Results are read this many frames after the queries were issued, so reading them never stalls.
+#define GPU_TIMER_FRAMES 4
+#define GPU_TIMER_MAX_PASSES 9 // the composite, and the scene and VHS passes of up to four views
+
+struct GpuTimerStats {
+	int samples;
+	double sum, min, max; // in milliseconds
+};
+
+struct GpuTimers {
+	bool enabled; // by [nowandthen] gpu_timers
+	bool available;
+	int passes;
+	const char* names[GPU_TIMER_MAX_PASSES];
+
+	int frame;
+	struct {
+		unsigned int queries[GPU_TIMER_MAX_PASSES][2];
+		bool issued[GPU_TIMER_MAX_PASSES];
+	} frames[GPU_TIMER_FRAMES];
+
+	struct GpuTimerStats stats[GPU_TIMER_MAX_PASSES];
+	double last[GPU_TIMER_MAX_PASSES];
+	double lastFrame; // all the passes of the newest frame collected, in milliseconds
+	int dropped;
+
+	double logInterval, lastLog;
+};
+
+// Timers degrade to no-ops when disabled or when the driver can't do timestamp queries.
+struct GpuTimers* CreateGpuTimers(struct Game* game, int passes, const char* names[]);
+void DestroyGpuTimers(struct GpuTimers* timers);
+// Needs to be called after the GL context got recreated.
+void ReloadGpuTimers(struct Game* game, struct GpuTimers* timers);
+// Turns the timers on regardless of the config, e.g. for benchmarks.
+void EnableGpuTimers(struct Game* game, struct GpuTimers* timers);
+
+void GpuTimersNewFrame(struct Game* game, struct GpuTimers* timers);
+void GpuTimerBegin(struct GpuTimers* timers, int pass);
+void GpuTimerEnd(struct GpuTimers* timers, int pass);
+
+void ResetGpuTimers(struct GpuTimers* timers);
+void PrintGpuTimers(struct Game* game, struct GpuTimers* timers);
+
+#endif
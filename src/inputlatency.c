@@ -0,0 +1,135 @@
+/*! \file inputlatency.c
+ *  \brief Time from a key press to the frame that shows it, stage by stage.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "common.h"
+#include "inputlatency.h"
+#include "stats.h"
+#include <libsuperderpy.h>
+#include <math.h>
+
+static const char* stageNames[LATENCY_STAGES + 1] = {"queue", "tick", "pickup", "render", "swap", "total"};
+
+static void Finish(struct Game* game, struct InputLatency* latency, int index) {
+	const struct LatencyPress* press = &latency->pending[index];
+	for (int i = 0; i < LATENCY_STAGES; i++) {
+		latency->samples[i][latency->done] = press->time[i + 1] - press->time[i];
+	}
+	latency->samples[LATENCY_STAGES][latency->done] = press->time[LATENCY_STAGES] - press->time[STAGE_QUEUE];
+	latency->done++;
+	latency->pending[index] = latency->pending[--latency->count];
+	if (latency->done == LATENCY_REPORT) {
+		PrintInputLatency(game, latency);
+	}
+}
+
+struct InputLatency* CreateInputLatency(void) {
+	return calloc(1, sizeof(struct InputLatency));
+}
+
+void DestroyInputLatency(struct Game* game, struct InputLatency* latency) {
+	PrintInputLatency(game, latency);
+	free(latency);
+}
+
+void NoteLatencyPress(struct InputLatency* latency, int player, double timestamp, double handled) {
+	if (latency->count == LATENCY_IN_FLIGHT) {
+		latency->dropped++;
+		return;
+	}
+	struct LatencyPress* press = &latency->pending[latency->count++];
+	press->player = player;
+	press->time[STAGE_QUEUE] = timestamp;
+	press->time[STAGE_TICK] = handled;
+	press->stage = STAGE_TICK;
+}
+
+void NoteLatencyTick(struct InputLatency* latency, int player, double seen, double time) {
+	for (int i = 0; i < latency->count; i++) {
+		struct LatencyPress* press = &latency->pending[i];
+		if ((press->stage == STAGE_TICK) && (press->player == player) && (press->time[STAGE_QUEUE] <= seen)) {
+			press->time[STAGE_PICKUP] = time;
+			press->stage = STAGE_PICKUP;
+		}
+	}
+}
+
+bool BeginLatencyFrame(struct InputLatency* latency, double start) {
+	bool shown = false;
+	for (int i = 0; i < latency->count; i++) {
+		struct LatencyPress* press = &latency->pending[i];
+		if (press->stage == STAGE_PICKUP) {
+			press->time[STAGE_RENDER] = start;
+			press->stage = STAGE_RENDER;
+			shown = true;
+		}
+	}
+	return shown;
+}
+
+void EndLatencyFrame(struct InputLatency* latency, double end) {
+	for (int i = 0; i < latency->count; i++) {
+		struct LatencyPress* press = &latency->pending[i];
+		if (press->stage == STAGE_RENDER) {
+			press->time[STAGE_SWAP] = end;
+			press->stage = STAGE_SWAP;
+		}
+	}
+}
+
+void NoteLatencyFlip(struct Game* game, struct InputLatency* latency, double now, double event) {
+	for (int i = latency->count - 1; i >= 0; i--) {
+		struct LatencyPress* press = &latency->pending[i];
+		if (press->stage != STAGE_SWAP) {
+			continue;
+		}
+		// an event that was already queued didn't keep the engine waiting after the flip
+		press->time[LATENCY_STAGES] = (event > press->time[STAGE_SWAP]) ? fmin(event, now) : now;
+		Finish(game, latency, i);
+	}
+}
+
+void PrintInputLatency(struct Game* game, struct InputLatency* latency) {
+	int n = latency->done;
+	if (!n) {
+		return;
+	}
+	double means[LATENCY_STAGES + 1];
+	PrintConsole(game, "Input latency: %d presses, %d dropped", n, latency->dropped);
+	for (int i = 0; i <= LATENCY_STAGES; i++) {
+		double* samples = latency->samples[i];
+		qsort(samples, n, sizeof(double), CompareDoubles);
+		double sum = 0;
+		for (int j = 0; j < n; j++) {
+			sum += samples[j];
+		}
+		means[i] = sum / n;
+		PrintConsole(game, "  %-6s mean %6.2f ms, p50 %6.2f, p90 %6.2f, p99 %6.2f, max %6.2f ms", stageNames[i],
+			means[i] * 1000.0, samples[n / 2] * 1000.0, samples[(n * 9) / 10] * 1000.0, samples[(n * 99) / 100] * 1000.0, samples[n - 1] * 1000.0);
+	}
+	int worst = 0;
+	for (int i = 1; i < LATENCY_STAGES; i++) {
+		if (means[i] > means[worst]) {
+			worst = i;
+		}
+	}
+	PrintConsole(game, "  dominated by %s: %.0f%% of the total", stageNames[worst], (means[LATENCY_STAGES] > 0) ? means[worst] * 100.0 / means[LATENCY_STAGES] : 0.0);
+	latency->done = 0;
+	latency->dropped = 0;
+}
@@ -0,0 +1,71 @@
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INPUTLATENCY_H
+#define INPUTLATENCY_H
+
+#include <libsuperderpy.h>
+
+#define LATENCY_IN_FLIGHT 16 // presses that haven't been flipped onto the screen yet
+#define LATENCY_REPORT 100 // presses per report
+
+enum LATENCY_STAGE {
+	STAGE_QUEUE, // from the key event until the game handled it
+	STAGE_TICK, // until a match tick took it
+	STAGE_PICKUP, // until a frame started drawing that tick; only the match thread makes it wait
+	STAGE_RENDER, // the CPU side of that frame
+	STAGE_SWAP, // until the engine flipped it and gave the control back
+	LATENCY_STAGES
+};
+
+struct LatencyPress {
+	int player;
+	double time[LATENCY_STAGES + 1]; // when each stage began, and when the last one ended
+	enum LATENCY_STAGE stage; // the one it's in
+};
+
+// Follows every clock key press from the key event until the frame that shows its effect is flipped.
+// The engine has no hook after the flip, so it ends when the game gets the control back, which is
+// an upper bound when the engine had to wait for something else to happen first. Whatever the
+// GPU and the display do after that is left for a photodiode to see, hence the marker.
+struct InputLatency {
+	struct LatencyPress pending[LATENCY_IN_FLIGHT];
+	int count;
+	int dropped; // when the presses came faster than frames
+
+	double samples[LATENCY_STAGES + 1][LATENCY_REPORT]; // per stage and the total, in seconds
+	int done;
+};
+
+struct InputLatency* CreateInputLatency(void);
+// Reports the presses that didn't make a full report yet.
+void DestroyInputLatency(struct Game* game, struct InputLatency* latency);
+
+// The timestamp is the one of the key event; handled is when the input was handed over to the match.
+void NoteLatencyPress(struct InputLatency* latency, int player, double timestamp, double handled);
+// The presses of the player with timestamps up to the given one were taken by a tick that ran at the given time.
+void NoteLatencyTick(struct InputLatency* latency, int player, double seen, double time);
+// True when the frame is the first one to show a press.
+bool BeginLatencyFrame(struct InputLatency* latency, double start);
+void EndLatencyFrame(struct InputLatency* latency, double end);
+// To be called whenever the engine hands the control over to the game, with the timestamp of the
+// event that woke it up when there's one; an event that came after the frame bounds the flip.
+void NoteLatencyFlip(struct Game* game, struct InputLatency* latency, double now, double event);
+
+void PrintInputLatency(struct Game* game, struct InputLatency* latency);
+
+#endif
@@ -42,11 +42,20 @@ int main(int argc, char** argv) {
 
 	al_set_window_title(game->display, LIBSUPERDERPY_GAMENAME_PRETTY);
 
-	LoadGamestate(game, "dosowisko");
-	LoadGamestate(game, "holypangolin");
-	StartGamestate(game, "dosowisko");
-
 	game->data = CreateGameData(game);
+	ParseNetplayOptions(game, &game->data->netplay, argc, argv);
+	ParseBenchmarkOptions(game, &game->data->benchmark, argc, argv);
+
+	if (game->data->benchmark.frames) {
+		// skip the intros and make every run render the very same frames
+		srand(0);
+		LoadGamestate(game, "game");
+		StartGamestate(game, "game");
+	} else {
+		LoadGamestate(game, "dosowisko");
+		LoadGamestate(game, "holypangolin");
+		StartGamestate(game, "dosowisko");
+	}
 
 	game->handlers.event = &GlobalEventHandler;
 	game->handlers.destroy = &DestroyGameData;
@@ -0,0 +1,299 @@
+/*! \file match.c
+ *  \brief Deterministic simulation of a match.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "match.h"
+#include <math.h>
+#include <string.h>
+
+#define MATCH_PI 3.14159265358979323846
+
+const struct MatchRules DefaultMatchRules = {
+	.bounceBase = 1.03,
+	.bounceSpeed = 1 / 6.0,
+	.serveX = 12,
+	.serveY = 4,
+	.screenshake = 20,
+};
+
+uint32_t SplitMix(uint64_t* state) {
+	uint64_t z = (*state += 0x9E3779B97F4A7C15ull);
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+	return (z ^ (z >> 31)) >> 32;
+}
+
+uint32_t MatchRandom(struct MatchState* match) {
+	return SplitMix(&match->rng);
+}
+
+double MatchRandomUnit(struct MatchState* match) {
+	return MatchRandom(match) / (double)UINT32_MAX;
+}
+
+void InitMatch(struct MatchState* match, uint64_t seed) {
+	memset(match, 0, sizeof(struct MatchState));
+	match->rng = seed;
+	match->ballx = 1920 / 2 - 10;
+	match->bally = 1080 / 2 - 100;
+	match->delay = -1;
+}
+
+static bool IsBetween(float val, float lim1, float lim2) {
+	return ((val >= lim1) && (val <= lim2)) || ((val >= lim2) && (val <= lim1));
+}
+
+bool CheckCollision(struct MatchState* match, const struct MatchRules* rules, struct MatchEvents* events, int Px, int Py, int Pw, double angle, double speed) {
+	if (match->cooldown) {
+		return false;
+	}
+
+	float m = match->ballx, n = match->bally, r = 42;
+	float a = tan(angle);
+	float b = Py - a * Px;
+	float x1 = (sqrt(-a * a * m * m + a * a * r * r - 2 * a * b * m + 2 * a * m * n - b * b + 2 * b * n - n * n + r * r) - a * b + a * n + m) / (a * a + 1);
+	float x2 = (-sqrt(-a * a * m * m + a * a * r * r - 2 * a * b * m + 2 * a * m * n - b * b + 2 * b * n - n * n + r * r) - a * b + a * n + m) / (a * a + 1);
+	float y1 = a * x1 + b;
+	float y2 = a * x2 + b;
+
+	int xlim = Px + cos(angle) * Pw;
+
+	float y;
+	if ((!isnan(x1)) && (IsBetween(x1, Px, xlim))) {
+		y = y1;
+	} else if ((!isnan(x2)) && (IsBetween(x2, Px, xlim))) {
+		y = y2;
+	} else {
+		return false;
+	}
+
+	match->dx = -match->dx * (rules->bounceBase + speed * rules->bounceSpeed);
+
+	match->dy = ((n - y) / fabs(n - y)) * 5.0;
+	match->dy *= 1.0 + ((speed / 8.0) + MatchRandomUnit(match) / 12.0) / 4.0;
+
+	match->cooldown = 10;
+
+	events->flags |= EVENT_HIT;
+	events->hitSpeed = 0.9 + MatchRandomUnit(match) * 0.2;
+	return true;
+}
+
+static void ApplyInput(unsigned char input, unsigned char last, bool* forward, bool* backward, bool* lastbackward) {
+	*forward = input & INPUT_FORWARD;
+	*backward = input & INPUT_BACKWARD;
+	// the key that got pressed most recently decides the direction
+	if ((input & INPUT_FORWARD) && !(last & INPUT_FORWARD)) {
+		*lastbackward = false;
+	}
+	if ((input & INPUT_BACKWARD) && !(last & INPUT_BACKWARD)) {
+		*lastbackward = true;
+	}
+}
+
+// Winds a player's clock for a part of a tick. The fade ramps linearly towards its limit, so the
+// clock moves by exactly its area over that time, wherever within the tick the part starts.
+static void WindClock(struct MatchState* match, int player, bool held, bool backward, double length) {
+	if (length <= 0) {
+		return;
+	}
+	double fade = match->fade[player];
+	double rate = held ? MATCH_FADE_IN : -MATCH_FADE_OUT, limit = held ? 1 : 0;
+	if (fade == limit) {
+		// nothing to ramp, which is most of the time
+		match->time[player] += MATCH_BASE_RATE * length;
+		match->time[player] += MATCH_WIND_RATE * (backward ? -limit : limit) * length;
+		return;
+	}
+	double ramp = fmin(length, (limit - fade) / rate); // until the fade gets to its limit
+	double end = fade + rate * ramp;
+	double area = (fade + end) / 2.0 * ramp + limit * (length - ramp);
+	match->time[player] += MATCH_BASE_RATE * length;
+	match->time[player] += MATCH_WIND_RATE * (backward ? -area : area);
+	match->fade[player] = end;
+}
+
+float TickPhase(double time, double start, double end) {
+	if ((end <= start) || (time <= start)) {
+		return 0;
+	}
+	return (time >= end) ? 1 : (time - start) / (end - start);
+}
+
+static void StartMatch(struct MatchState* match, const struct MatchRules* rules, struct MatchEvents* events) {
+	match->dx = (MatchRandom(match) & 1) ? rules->serveX : -rules->serveX;
+	match->dy = rules->serveY;
+	match->ballx = 1920 / 2 - 10;
+	match->bally = 1080 / 2 - 100;
+	match->started = true;
+	match->leftscore = 0;
+	match->rightscore = 0;
+	match->scoreleft = (match->dx < 0);
+	match->lastleft = match->scoreleft;
+	events->flags |= EVENT_STARTED;
+}
+
+void StepMatch(struct MatchState* match, const unsigned char inputs[MATCH_PLAYERS], struct MatchEvents* events) {
+	StepMatchWithRules(match, &DefaultMatchRules, inputs, events);
+}
+
+void StepMatchWithRules(struct MatchState* match, const struct MatchRules* rules, const unsigned char inputs[MATCH_PLAYERS], struct MatchEvents* events) {
+	static const struct InputPhases phases[MATCH_PLAYERS] = {{0}};
+	StepMatchWithPhases(match, rules, inputs, phases, events);
+}
+
+// Winds a player's clock for a whole tick, split where the keys went down and up within it. A phase
+// of 0 is a change from before the tick, which already holds from its start.
+static void WindTick(struct MatchState* match, int player, bool wasHeld, bool wasBackward, const struct InputPhases* phases) {
+	bool held = match->forward[player] || match->backward[player], backward = match->lastbackward[player];
+	float pressed = phases->pressed, released = phases->released;
+	if (!pressed && !released) {
+		WindClock(match, player, held, backward, 1);
+		return;
+	}
+	if (pressed <= released) {
+		// down until the release, even when it was a tap within the tick, which the inputs still count as held
+		WindClock(match, player, wasHeld, wasBackward, pressed);
+		WindClock(match, player, true, backward, released - pressed);
+		WindClock(match, player, phases->held & (INPUT_FORWARD | INPUT_BACKWARD), backward, 1 - released);
+	} else {
+		// up from the release until the keys went down again
+		float up = released ? released : pressed;
+		WindClock(match, player, wasHeld, wasBackward, up);
+		WindClock(match, player, false, backward, pressed - up);
+		WindClock(match, player, held, backward, 1 - pressed);
+	}
+}
+
+void StepMatchWithPhases(struct MatchState* match, const struct MatchRules* rules, const unsigned char inputs[MATCH_PLAYERS], const struct InputPhases phases[MATCH_PLAYERS], struct MatchEvents* events) {
+	memset(events, 0, sizeof(struct MatchEvents));
+
+	bool wasHeld[MATCH_PLAYERS], wasBackward[MATCH_PLAYERS];
+	for (int i = 0; i < MATCH_PLAYERS; i++) {
+		wasHeld[i] = match->forward[i] || match->backward[i];
+		wasBackward[i] = match->lastbackward[i];
+		ApplyInput(inputs[i], match->lastInput[i], &match->forward[i], &match->backward[i], &match->lastbackward[i]);
+	}
+	if (((inputs[0] | inputs[1]) & INPUT_START) && !match->started) {
+		StartMatch(match, rules, events);
+	}
+	memcpy(match->lastInput, inputs, sizeof(match->lastInput));
+
+	match->ballrot += 0.02 + fabs(match->dx) * 0.0025 + fabs(match->dy) * 0.0025;
+
+	if (match->delay >= 0) {
+		match->delay--;
+	}
+	for (int i = 0; i < MATCH_PLAYERS; i++) {
+		if (match->shake[i] > 0) {
+			match->shake[i]--;
+		}
+	}
+
+	if ((match->bally > (1080 + 42)) || (match->ballx < -42) || (match->ballx > (1920 + 42))) {
+		if (match->delay == -1) {
+			events->flags |= EVENT_POINT;
+			events->pointLeft = match->scoreleft;
+			events->score = match->score;
+			if (match->scoreleft) {
+				match->leftscore++;
+				match->shake[1] = rules->screenshake;
+			} else {
+				match->rightscore++;
+				match->shake[0] = rules->screenshake;
+			}
+			events->yay = MatchRandom(match) % 3;
+
+			match->delay = 120;
+		} else if (match->delay == 60) {
+			match->dx = (MatchRandom(match) & 1) ? rules->serveX : -rules->serveX;
+			match->dy = rules->serveY;
+			match->ballx = 1920 / 2 - 10;
+			match->bally = 1080 / 2 - 100;
+			match->started = true;
+			match->scoreleft = (match->dx < 0);
+			match->lastleft = match->scoreleft;
+			match->score = 0;
+		}
+	}
+
+	if ((match->leftscore >= 10) || (match->rightscore >= 10)) {
+		if (match->started) {
+			events->flags |= EVENT_FINISHED;
+		}
+		match->started = false;
+	}
+
+	if (match->started) {
+		match->ballx += match->dx;
+		match->bally += match->dy;
+
+		match->dy += 0.1;
+	}
+
+	float x1 = match->ballx, y1 = match->bally;
+	if (match->scoreleft) {
+		float x2 = 223, y2 = 875;
+		if ((sqrt(pow(x2 - x1, 2) + pow(y2 - y1, 2))) <= (42 + 150)) {
+			match->scoreleft = false;
+			events->flags |= EVENT_SCORE_SIDE;
+		}
+	} else {
+		float x2 = 1672, y2 = 879;
+		if ((sqrt(pow(x2 - x1, 2) + pow(y2 - y1, 2))) <= (42 + 150)) {
+			match->scoreleft = true;
+			events->flags |= EVENT_SCORE_SIDE;
+		}
+	}
+
+	// the hands hit the ball as fast as they were going when the tick started
+	float fade[MATCH_PLAYERS];
+	match->phased += (phases[0].pressed || phases[0].released || phases[1].pressed || phases[1].released);
+	for (int i = 0; i < MATCH_PLAYERS; i++) {
+		fade[i] = match->fade[i];
+		WindTick(match, i, wasHeld[i], wasBackward[i], &phases[i]);
+		if (match->time[i] > 1) {
+			match->time[i] -= 1;
+		}
+		if (match->time[i] < 0) {
+			match->time[i] += 1;
+		}
+	}
+
+	if (match->cooldown) {
+		match->cooldown--;
+	}
+
+	bool left = false;
+	left = left || CheckCollision(match, rules, events, 1672, 879, 115, match->time[1] * 4 * MATCH_PI, fade[1]);
+	left = left || CheckCollision(match, rules, events, 1672, 879, 138, match->time[1] * 4 * MATCH_PI * 24, fade[1] / 10.0);
+
+	bool right = false;
+	right = right || CheckCollision(match, rules, events, 223, 875, 115, match->time[0] * 4 * MATCH_PI, fade[0]);
+	right = right || CheckCollision(match, rules, events, 223, 875, 138, match->time[0] * 4 * MATCH_PI * 24, fade[0] / 10.0);
+
+	if (right && match->lastleft) {
+		match->score++;
+		match->lastleft = false;
+	} else if (left && !match->lastleft) {
+		match->score++;
+		match->lastleft = true;
+	}
+
+}
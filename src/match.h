@@ -0,0 +1,125 @@
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MATCH_H
+#define MATCH_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Everything that decides how a match plays out. It's plain data, so a snapshot is a copy.
+// Players: 0 is on the left (A/D), 1 is on the right (LEFT/RIGHT).
+#define MATCH_PLAYERS 2
+
+// How the clocks move. Holding a key ramps the fade up to 1 and letting go ramps it back to 0, per tick;
+// the clocks go at the base rate by themselves and at the wind rate more at full fade, in days per tick.
+#define MATCH_FADE_IN 0.025
+#define MATCH_FADE_OUT 0.04
+#define MATCH_BASE_RATE (1.0 / 24.0 / 60.0 / 60.0)
+#define MATCH_WIND_RATE (1.0 / 24.0 / 60.0)
+
+enum MATCH_INPUT {
+	INPUT_FORWARD = 1 << 0,
+	INPUT_BACKWARD = 1 << 1,
+	INPUT_START = 1 << 2
+};
+
+enum MATCH_EVENT {
+	EVENT_HIT = 1 << 0,
+	EVENT_POINT = 1 << 1,
+	EVENT_STARTED = 1 << 2,
+	EVENT_FINISHED = 1 << 3,
+	EVENT_SCORE_SIDE = 1 << 4
+};
+
+// What happened during a tick, for the sounds and messages that aren't part of the simulation.
+struct MatchEvents {
+	unsigned int flags;
+	float hitSpeed;
+	bool pointLeft;
+	int yay;
+	int score;
+};
+
+struct MatchState {
+	uint64_t rng;
+	unsigned char lastInput[MATCH_PLAYERS];
+	uint8_t phased; // ticks that had keys change within them, wrapping; spectators can't replay those
+
+	// each player winds their own clock, which is the time of day their views show
+	float fade[MATCH_PLAYERS];
+	bool forward[MATCH_PLAYERS];
+	bool backward[MATCH_PLAYERS];
+	bool lastbackward[MATCH_PLAYERS];
+
+	double time[MATCH_PLAYERS];
+
+	float dx, dy;
+
+	int score;
+	int delay;
+
+	float ballx, bally, ballrot;
+
+	int cooldown;
+
+	bool started;
+
+	bool scoreleft;
+	bool lastleft;
+
+	int shake[MATCH_PLAYERS];
+
+	int leftscore, rightscore;
+};
+
+// Tuning constants. The game always plays with DefaultMatchRules; other values are for balancing experiments.
+struct MatchRules {
+	double bounceBase, bounceSpeed; // a hit multiplies dx by -(bounceBase + speed * bounceSpeed)
+	float serveX, serveY; // initial ball velocity
+	int screenshake; // ticks the losing side shakes for
+};
+
+extern const struct MatchRules DefaultMatchRules;
+
+void InitMatch(struct MatchState* match, uint64_t seed);
+void StepMatch(struct MatchState* match, const unsigned char inputs[MATCH_PLAYERS], struct MatchEvents* events);
+void StepMatchWithRules(struct MatchState* match, const struct MatchRules* rules, const unsigned char inputs[MATCH_PLAYERS], struct MatchEvents* events);
+// How much of the tick (0..1) had passed when a player's keys last went down and up, so the clocks
+// move as if they were pressed and released exactly then; 0 when they didn't within the tick.
+struct InputPhases {
+	float pressed, released;
+	unsigned char held; // the keys still down at the end of the tick, unlike the inputs, which also have the ones tapped within it
+};
+
+// The ones above act as if every change happened right at the start of the tick; that's what
+// peers and spectators have to do.
+void StepMatchWithPhases(struct MatchState* match, const struct MatchRules* rules, const unsigned char inputs[MATCH_PLAYERS], const struct InputPhases phases[MATCH_PLAYERS], struct MatchEvents* events);
+// Where within a tick that ran from start to end something happened.
+float TickPhase(double time, double start, double end);
+
+// Bounces the ball off a clock hand of length Pw anchored at Px, Py, if it touches it.
+bool CheckCollision(struct MatchState* match, const struct MatchRules* rules, struct MatchEvents* events, int Px, int Py, int Pw, double angle, double speed);
+
+// splitmix64, small and good enough for gameplay
+uint32_t SplitMix(uint64_t* state);
+
+// Per-match generator, so every peer rolls the same numbers.
+uint32_t MatchRandom(struct MatchState* match);
+double MatchRandomUnit(struct MatchState* match);
+
+#endif
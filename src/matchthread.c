@@ -0,0 +1,212 @@
+/*! \file matchthread.c
+ *  \brief Local match stepped on its own thread at a steady rate.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "common.h"
+#include "matchthread.h"
+#include <libsuperderpy.h>
+
+#define MATCH_SNAPSHOT_INDEX 3u
+#define MATCH_SNAPSHOT_FRESH 4u
+#define MATCH_LATE 0.002 // a tick that starts later than that counts as late
+#define MATCH_MAX_CATCH_UP 6 // ticks; after a longer stall the clock just carries on from now
+
+static void Publish(struct MatchThread* thread) {
+	struct MatchSnapshot* snapshot = &thread->snapshots[thread->writing];
+	snapshot->match = thread->match;
+	snapshot->tick = thread->tick;
+	for (int i = 0; i < MATCH_PLAYERS; i++) {
+		snapshot->taken[i] = thread->taken[i];
+		snapshot->takenAt[i] = thread->takenAt[i];
+	}
+	unsigned int old = atomic_exchange_explicit(&thread->ready, thread->writing | MATCH_SNAPSHOT_FRESH, memory_order_acq_rel);
+	thread->writing = old & MATCH_SNAPSHOT_INDEX;
+}
+
+static void QueueEvents(struct MatchThread* thread, const struct MatchEvents* events) {
+	unsigned int head = atomic_load_explicit(&thread->head, memory_order_relaxed);
+	unsigned int tail = atomic_load_explicit(&thread->tail, memory_order_acquire);
+	if (head - tail >= MATCH_EVENT_QUEUE) {
+		// the main thread stopped taking them
+		atomic_fetch_add_explicit(&thread->dropped, 1, memory_order_relaxed);
+		return;
+	}
+	thread->queue[head % MATCH_EVENT_QUEUE] = (struct QueuedMatchEvents){.events = *events, .tick = thread->tick};
+	atomic_store_explicit(&thread->head, head + 1, memory_order_release);
+}
+
+static void Tick(struct MatchThread* thread, double now, double late) {
+	unsigned char inputs[MATCH_PLAYERS];
+	struct InputPhases phases[MATCH_PLAYERS];
+	for (int i = 0; i < MATCH_PLAYERS; i++) {
+		// a press shorter than a tick still counts
+		phases[i].held = atomic_load_explicit(&thread->keys[i], memory_order_relaxed);
+		inputs[i] = phases[i].held | atomic_exchange_explicit(&thread->pressed[i], 0, memory_order_relaxed);
+		// a change that races with the tick counts from its start, as the phase of an older change is 0
+		double pressed = atomic_load_explicit(&thread->pressedAt[i], memory_order_relaxed);
+		phases[i].pressed = TickPhase(pressed, thread->lastTick, now);
+		phases[i].released = TickPhase(atomic_load_explicit(&thread->releasedAt[i], memory_order_relaxed), thread->lastTick, now);
+		if (pressed != thread->taken[i]) {
+			thread->taken[i] = pressed;
+			thread->takenAt[i] = now;
+		}
+	}
+	thread->lastTick = now;
+	struct MatchEvents events;
+	StepMatchWithPhases(&thread->match, &DefaultMatchRules, inputs, phases, &events);
+	thread->tick++;
+	if (events.flags) {
+		QueueEvents(thread, &events);
+	}
+	Publish(thread);
+
+	atomic_fetch_add_explicit(&thread->ticks, 1, memory_order_relaxed);
+	if (late > MATCH_LATE) {
+		atomic_fetch_add_explicit(&thread->late, 1, memory_order_relaxed);
+	}
+	unsigned int us = late * 1000000;
+	if (us > atomic_load_explicit(&thread->worstLate, memory_order_relaxed)) {
+		atomic_store_explicit(&thread->worstLate, us, memory_order_relaxed);
+	}
+}
+
+static void* Run(ALLEGRO_THREAD* t, void* arg) {
+	struct MatchThread* thread = arg;
+	double next = al_get_time();
+	thread->lastTick = next;
+	while (!atomic_load_explicit(&thread->quit, memory_order_relaxed)) {
+		double now = al_get_time();
+		if (atomic_load_explicit(&thread->paused, memory_order_relaxed)) {
+			next = now + MATCH_TICK;
+			thread->lastTick = now;
+			al_rest(MATCH_TICK);
+			continue;
+		}
+		if (now < next) {
+			al_rest(next - now);
+			continue;
+		}
+		double late = now - next;
+		if (late > MATCH_MAX_CATCH_UP * MATCH_TICK) {
+			// the whole process was stalled, so rushing through the missed ticks wouldn't be any better
+			unsigned int skipped = late / MATCH_TICK;
+			atomic_fetch_add_explicit(&thread->skipped, skipped, memory_order_relaxed);
+			next += skipped * MATCH_TICK;
+			late -= skipped * MATCH_TICK;
+		}
+		// a late tick is followed by the next one right away, so the average rate stays the same
+		Tick(thread, now, late);
+		next += MATCH_TICK;
+	}
+	return NULL;
+}
+
+struct MatchThread* CreateMatchThread(const struct MatchState* match) {
+	struct MatchThread* thread = calloc(1, sizeof(struct MatchThread));
+	thread->match = *match;
+	for (int i = 0; i < 3; i++) {
+		thread->snapshots[i] = (struct MatchSnapshot){.match = *match, .tick = 0};
+	}
+	thread->writing = 0;
+	atomic_init(&thread->ready, 1);
+	thread->reading = 2;
+	for (int i = 0; i < MATCH_PLAYERS; i++) {
+		atomic_init(&thread->keys[i], 0);
+		atomic_init(&thread->pressed[i], 0);
+		atomic_init(&thread->pressedAt[i], 0);
+		atomic_init(&thread->releasedAt[i], 0);
+	}
+	atomic_init(&thread->paused, false);
+	atomic_init(&thread->quit, false);
+	atomic_init(&thread->head, 0);
+	atomic_init(&thread->tail, 0);
+	atomic_init(&thread->ticks, 0);
+	atomic_init(&thread->late, 0);
+	atomic_init(&thread->skipped, 0);
+	atomic_init(&thread->dropped, 0);
+	atomic_init(&thread->worstLate, 0);
+
+	thread->thread = al_create_thread(Run, thread);
+	if (!thread->thread) {
+		free(thread);
+		return NULL;
+	}
+	al_start_thread(thread->thread);
+	return thread;
+}
+
+void DestroyMatchThread(struct MatchThread* thread) {
+	atomic_store_explicit(&thread->quit, true, memory_order_relaxed);
+	al_join_thread(thread->thread, NULL);
+	al_destroy_thread(thread->thread);
+	free(thread);
+}
+
+void PauseMatchThread(struct MatchThread* thread, bool paused) {
+	atomic_store_explicit(&thread->paused, paused, memory_order_relaxed);
+}
+
+void PressMatchInput(struct MatchThread* thread, int player, unsigned char input, double timestamp) {
+	atomic_store_explicit(&thread->pressedAt[player], timestamp, memory_order_relaxed);
+	atomic_fetch_or_explicit(&thread->keys[player], input, memory_order_relaxed);
+	atomic_fetch_or_explicit(&thread->pressed[player], input, memory_order_relaxed);
+}
+
+void ReleaseMatchInput(struct MatchThread* thread, int player, unsigned char input, double timestamp) {
+	atomic_store_explicit(&thread->releasedAt[player], timestamp, memory_order_relaxed);
+	atomic_fetch_and_explicit(&thread->keys[player], (unsigned char)~input, memory_order_relaxed);
+}
+
+void TapMatchInput(struct MatchThread* thread, int player, unsigned char input) {
+	atomic_fetch_or_explicit(&thread->pressed[player], input, memory_order_relaxed);
+}
+
+const struct MatchSnapshot* TakeMatchSnapshot(struct MatchThread* thread) {
+	if (atomic_load_explicit(&thread->ready, memory_order_relaxed) & MATCH_SNAPSHOT_FRESH) {
+		unsigned int old = atomic_exchange_explicit(&thread->ready, thread->reading, memory_order_acq_rel);
+		thread->reading = old & MATCH_SNAPSHOT_INDEX;
+	}
+	return &thread->snapshots[thread->reading];
+}
+
+bool TakeMatchEvents(struct MatchThread* thread, unsigned int tick, struct MatchEvents* events) {
+	unsigned int tail = atomic_load_explicit(&thread->tail, memory_order_relaxed);
+	unsigned int head = atomic_load_explicit(&thread->head, memory_order_acquire);
+	if (tail == head) {
+		return false;
+	}
+	const struct QueuedMatchEvents* queued = &thread->queue[tail % MATCH_EVENT_QUEUE];
+	if ((int)(queued->tick - tick) > 0) {
+		// happened after the snapshot; they'll be heard together with the tick that shows them
+		return false;
+	}
+	*events = queued->events;
+	atomic_store_explicit(&thread->tail, tail + 1, memory_order_release);
+	return true;
+}
+
+void PrintMatchThreadStats(struct Game* game, struct MatchThread* thread, double seconds) {
+	unsigned int ticks = atomic_exchange_explicit(&thread->ticks, 0, memory_order_relaxed);
+	unsigned int late = atomic_exchange_explicit(&thread->late, 0, memory_order_relaxed);
+	unsigned int skipped = atomic_exchange_explicit(&thread->skipped, 0, memory_order_relaxed);
+	unsigned int dropped = atomic_exchange_explicit(&thread->dropped, 0, memory_order_relaxed);
+	unsigned int worst = atomic_exchange_explicit(&thread->worstLate, 0, memory_order_relaxed);
+	PrintConsole(game, "Match thread: %.2f ticks per second, %u late (worst by %.2f ms), %u skipped, %u events dropped",
+		ticks / seconds, late, worst / 1000.0, skipped, dropped);
+}
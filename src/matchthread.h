@@ -0,0 +1,93 @@
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MATCHTHREAD_H
+#define MATCHTHREAD_H
+
+#include "match.h"
+#include <libsuperderpy.h>
+#include <stdatomic.h>
+
+// Must be a power of two.
+#define MATCH_EVENT_QUEUE 64
+#define MATCH_TICK (1.0 / 60)
+
+struct MatchSnapshot {
+	struct MatchState match;
+	unsigned int tick;
+	// the newest key press of each player that a tick took, and when that tick ran
+	double taken[MATCH_PLAYERS], takenAt[MATCH_PLAYERS];
+};
+
+struct QueuedMatchEvents {
+	struct MatchEvents events;
+	unsigned int tick;
+};
+
+// Steps a local match at a steady 60 Hz on its own thread, so that a frame that takes too long
+// can't hold the game back. The main thread only ever sees complete snapshots of the state, handed
+// over through a triple buffer, and the events of every tick, handed over through a queue.
+struct MatchThread {
+	// owned by the match thread
+	struct MatchState match;
+	unsigned int tick;
+	unsigned int writing; // the snapshot being filled
+	double lastTick; // when the last tick ran
+	double taken[MATCH_PLAYERS], takenAt[MATCH_PLAYERS]; // as in the snapshots
+
+	// single producer (main thread), single consumer (match thread)
+	atomic_uchar keys[MATCH_PLAYERS]; // currently held
+	atomic_uchar pressed[MATCH_PLAYERS]; // since the last tick
+	_Atomic double pressedAt[MATCH_PLAYERS], releasedAt[MATCH_PLAYERS]; // when the clock keys last went down and up
+	atomic_bool paused, quit;
+
+	// the newest complete snapshot, with MATCH_SNAPSHOT_FRESH set until the main thread takes it
+	struct MatchSnapshot snapshots[3];
+	atomic_uint ready;
+	unsigned int reading; // owned by the main thread
+
+	// single producer (match thread), single consumer (main thread)
+	struct QueuedMatchEvents queue[MATCH_EVENT_QUEUE];
+	atomic_uint head, tail;
+
+	// written by the match thread, reset when printed
+	atomic_uint ticks, late, skipped, dropped;
+	atomic_uint worstLate; // in microseconds
+
+	ALLEGRO_THREAD* thread;
+};
+
+// Takes over the match from the given state. NULL when there are no threads to run it on.
+struct MatchThread* CreateMatchThread(const struct MatchState* match);
+void DestroyMatchThread(struct MatchThread* thread);
+// The clock doesn't move while paused, so the match resumes exactly where it stopped.
+void PauseMatchThread(struct MatchThread* thread, bool paused);
+
+// The timestamps are the ones of the events, so that the clocks react from the exact moment.
+void PressMatchInput(struct MatchThread* thread, int player, unsigned char input, double timestamp);
+void ReleaseMatchInput(struct MatchThread* thread, int player, unsigned char input, double timestamp);
+// Counts for the next tick only, like a key that got released before it.
+void TapMatchInput(struct MatchThread* thread, int player, unsigned char input);
+
+// The newest state. Stays valid until the next call.
+const struct MatchSnapshot* TakeMatchSnapshot(struct MatchThread* thread);
+// The events of the ticks up to the given one, oldest first; false once there are no more.
+bool TakeMatchEvents(struct MatchThread* thread, unsigned int tick, struct MatchEvents* events);
+
+void PrintMatchThreadStats(struct Game* game, struct MatchThread* thread, double seconds);
+
+#endif
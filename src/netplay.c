@@ -0,0 +1,359 @@
+/*! \file netplay.c
+ *  \brief Rollback netcode for two player matches over UDP.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "common.h"
+#include "netplay.h"
+#include "udp.h"
+#include <libsuperderpy.h>
+
+enum PACKET_TYPE {
+	PACKET_HELLO,
+	PACKET_WELCOME,
+	PACKET_INPUT
+};
+
+#define PACKET_HEADER 32
+#define PACKET_MAX_INPUTS (NETPLAY_PACKET_SIZE - PACKET_HEADER)
+
+static uint32_t Milliseconds(void) {
+	return (uint32_t)(al_get_time() * 1000.0);
+}
+
+static void Put32(unsigned char* buf, uint32_t value) {
+	buf[0] = value >> 24;
+	buf[1] = value >> 16;
+	buf[2] = value >> 8;
+	buf[3] = value;
+}
+
+static uint32_t Get32(const unsigned char* buf) {
+	return ((uint32_t)buf[0] << 24) | ((uint32_t)buf[1] << 16) | ((uint32_t)buf[2] << 8) | buf[3];
+}
+
+static void SendRaw(struct Netplay* net, const unsigned char* data, int size) {
+	SendUdp(net->socket, net->peerAddress, net->peerPort, data, size);
+}
+
+static void Send(struct Netplay* net, const unsigned char* data, int size) {
+	if ((net->options.loss > 0) && (rand() / (double)RAND_MAX < net->options.loss)) {
+		net->stats.dropped++;
+		return;
+	}
+	if ((!net->options.latency && !net->options.jitter) || (net->shimCount == NETPLAY_SHIM_QUEUE)) {
+		SendRaw(net, data, size);
+		return;
+	}
+	struct NetplayPacket* packet = &net->shim[net->shimCount++];
+	packet->time = al_get_time() + (net->options.latency + (net->options.jitter ? rand() % (net->options.jitter + 1) : 0)) / 1000.0;
+	packet->size = size;
+	memcpy(packet->data, data, size);
+}
+
+static void FlushShim(struct Netplay* net) {
+	double now = al_get_time();
+	int kept = 0;
+	for (int i = 0; i < net->shimCount; i++) {
+		if (net->shim[i].time <= now) {
+			SendRaw(net, net->shim[i].data, net->shim[i].size);
+		} else {
+			net->shim[kept++] = net->shim[i];
+		}
+	}
+	net->shimCount = kept;
+}
+
+static int WriteHeader(struct Netplay* net, unsigned char* buf, enum PACKET_TYPE type) {
+	memset(buf, 0, PACKET_HEADER);
+	buf[0] = 'N';
+	buf[1] = 'T';
+	buf[2] = type;
+	Put32(buf + 4, net->tick);
+	Put32(buf + 8, net->remoteConfirmed + 1);
+	Put32(buf + 16, Milliseconds());
+	Put32(buf + 20, net->remoteSent);
+	Put32(buf + 24, net->seed >> 32);
+	Put32(buf + 28, net->seed);
+	return PACKET_HEADER;
+}
+
+static void SendInputs(struct Netplay* net) {
+	unsigned char buf[NETPLAY_PACKET_SIZE];
+	int size = WriteHeader(net, buf, PACKET_INPUT);
+	// everything the peer hasn't acknowledged yet goes into every packet, so losing some doesn't matter
+	int first = net->localAcked + 1;
+	int count = (net->tick - 1 + net->inputDelay) - first + 1;
+	if (count > PACKET_MAX_INPUTS) {
+		count = PACKET_MAX_INPUTS;
+	}
+	if (count < 0) {
+		count = 0;
+	}
+	buf[3] = count;
+	Put32(buf + 12, first);
+	for (int i = 0; i < count; i++) {
+		buf[size++] = net->inputs[(first + i) % NETPLAY_RING][net->local];
+	}
+	Send(net, buf, size);
+}
+
+static unsigned char PredictInput(struct Netplay* net) {
+	if (net->remoteConfirmed < 0) {
+		return 0;
+	}
+	// keys are likely to be still held, but a start request isn't repeated
+	return net->inputs[net->remoteConfirmed % NETPLAY_RING][!net->local] & ~INPUT_START;
+}
+
+static void Connect(struct Game* game, struct Netplay* net, struct MatchState* match) {
+	net->connected = true;
+	InitMatch(match, net->seed);
+	PrintConsole(game, "Netplay: connected as %s player, seed %016llx", net->local ? "right" : "left", (unsigned long long)net->seed);
+}
+
+static void ReceiveInputs(struct Netplay* net, const unsigned char* buf, int size) {
+	int remote = !net->local;
+	int first = Get32(buf + 12);
+	int count = buf[3];
+	if (size < PACKET_HEADER + count) {
+		return;
+	}
+	for (int i = 0; i < count; i++) {
+		int tick = first + i;
+		if (tick != net->remoteConfirmed + 1) {
+			continue;
+		}
+		if (tick - net->tick >= NETPLAY_RING - NETPLAY_MAX_ROLLBACK) {
+			break;
+		}
+		unsigned char input = buf[PACKET_HEADER + i];
+		net->inputs[tick % NETPLAY_RING][remote] = input;
+		if ((tick < net->tick) && (net->used[tick % NETPLAY_RING] != input) && ((net->rollbackFrom < 0) || (tick < net->rollbackFrom))) {
+			net->rollbackFrom = tick;
+		}
+		net->remoteConfirmed = tick;
+	}
+}
+
+static void Receive(struct Game* game, struct Netplay* net, struct MatchState* match) {
+	unsigned char buf[NETPLAY_PACKET_SIZE];
+	uint32_t address;
+	uint16_t port;
+	int size;
+	while ((size = ReceiveUdp(net->socket, buf, sizeof(buf), &address, &port)) >= 0) {
+		if ((size < PACKET_HEADER) || (buf[0] != 'N') || (buf[1] != 'T')) {
+			continue;
+		}
+		if (buf[2] == PACKET_HELLO) {
+			if (net->options.mode != NETPLAY_HOST) {
+				continue;
+			}
+			if (!net->connected) {
+				net->peerAddress = address;
+				net->peerPort = port;
+				Connect(game, net, match);
+			}
+			if ((address == net->peerAddress) && (port == net->peerPort)) {
+				// repeated until the joining side hears it
+				unsigned char reply[NETPLAY_PACKET_SIZE];
+				Send(net, reply, WriteHeader(net, reply, PACKET_WELCOME));
+			}
+			continue;
+		}
+		if ((address != net->peerAddress) || (port != net->peerPort)) {
+			continue;
+		}
+		if (buf[2] == PACKET_WELCOME) {
+			if (!net->connected && (net->options.mode == NETPLAY_JOIN)) {
+				net->seed = ((uint64_t)Get32(buf + 24) << 32) | Get32(buf + 28);
+				Connect(game, net, match);
+			}
+			continue;
+		}
+		if (!net->connected || (buf[2] != PACKET_INPUT)) {
+			continue;
+		}
+
+		int ack = (int)Get32(buf + 8) - 1;
+		if (ack > net->localAcked) {
+			net->localAcked = ack;
+		}
+		int tick = Get32(buf + 4);
+		if (tick > net->remoteTick) {
+			net->remoteTick = tick;
+		}
+		net->remoteSent = Get32(buf + 16);
+		uint32_t echo = Get32(buf + 20);
+		if (echo) {
+			double rtt = (uint32_t)(Milliseconds() - echo) / 1000.0;
+			net->rtt = net->rtt ? (net->rtt * 0.9 + rtt * 0.1) : rtt;
+		}
+		ReceiveInputs(net, buf, size);
+	}
+}
+
+// The events that weren't heard yet: the ones the tick didn't have before, and a point that went the other way.
+static unsigned int NewEvents(const struct MatchEvents* reported, const struct MatchEvents* events) {
+	unsigned int flags = events->flags & ~reported->flags;
+	if ((events->flags & reported->flags & EVENT_POINT) && ((events->pointLeft != reported->pointLeft) || (events->score != reported->score))) {
+		flags |= EVENT_POINT;
+	}
+	return flags;
+}
+
+static void AddEvents(struct MatchEvents* to, const struct MatchEvents* from, unsigned int flags) {
+	flags &= from->flags;
+	to->flags |= flags;
+	if (flags & EVENT_HIT) {
+		to->hitSpeed = from->hitSpeed;
+	}
+	if (flags & EVENT_POINT) {
+		to->pointLeft = from->pointLeft;
+		to->score = from->score;
+		to->yay = from->yay;
+	}
+}
+
+static void Rollback(struct Netplay* net, struct MatchState* match, struct MatchEvents* events) {
+	int from = net->rollbackFrom;
+	net->rollbackFrom = -1;
+
+	*match = net->snapshots[from % NETPLAY_RING];
+	// sounds of these ticks were already played when they ran the first time, so only what
+	// happens differently in the corrected timeline gets reported
+	struct MatchEvents stepped;
+	for (int tick = from; tick < net->tick; tick++) {
+		unsigned char inputs[MATCH_PLAYERS];
+		inputs[net->local] = net->inputs[tick % NETPLAY_RING][net->local];
+		inputs[!net->local] = (tick <= net->remoteConfirmed) ? net->inputs[tick % NETPLAY_RING][!net->local] : PredictInput(net);
+		net->used[tick % NETPLAY_RING] = inputs[!net->local];
+		net->snapshots[tick % NETPLAY_RING] = *match;
+		StepMatch(match, inputs, &stepped);
+		struct MatchEvents* reported = &net->reported[tick % NETPLAY_RING];
+		unsigned int fresh = NewEvents(reported, &stepped);
+		AddEvents(events, &stepped, fresh);
+		AddEvents(reported, &stepped, fresh);
+	}
+
+	net->stats.rollbacks++;
+	net->stats.resimulated += net->tick - from;
+	if ((unsigned int)(net->tick - from) > net->stats.deepest) {
+		net->stats.deepest = net->tick - from;
+	}
+}
+
+struct Netplay* CreateNetplay(struct Game* game, struct NetplayOptions* options) {
+	struct Netplay* net = calloc(1, sizeof(struct Netplay));
+	net->options = *options;
+	net->remoteConfirmed = -1;
+	net->localAcked = -1;
+	net->rollbackFrom = -1;
+	net->maxRollback = strtol(GetConfigOptionDefault(game, "nowandthen", "net_max_rollback", "8"), NULL, 10);
+	net->inputDelay = strtol(GetConfigOptionDefault(game, "nowandthen", "net_input_delay", "0"), NULL, 10);
+	if ((net->maxRollback < 1) || (net->maxRollback > NETPLAY_MAX_ROLLBACK)) {
+		net->maxRollback = NETPLAY_MAX_ROLLBACK;
+	}
+	if ((net->inputDelay < 0) || (net->inputDelay > NETPLAY_MAX_ROLLBACK)) {
+		net->inputDelay = 0;
+	}
+
+	if (options->mode == NETPLAY_HOST) {
+		net->seed = ((uint64_t)rand() << 32) ^ ((uint64_t)rand() << 16) ^ (uint64_t)(al_get_time() * 1000000.0);
+	} else {
+		if (!ResolveUdpAddress(options->address, options->port, &net->peerAddress, &net->peerPort)) {
+			PrintConsole(game, "Netplay: can't resolve %s", options->address);
+			free(net);
+			return NULL;
+		}
+		net->local = 1;
+	}
+	net->socket = OpenUdpSocket((options->mode == NETPLAY_HOST) ? options->port : 0);
+	if (net->socket < 0) {
+		PrintConsole(game, "Netplay: can't open port %d", options->port);
+		free(net);
+		return NULL;
+	}
+
+	if (options->mode == NETPLAY_HOST) {
+		PrintConsole(game, "Netplay: waiting for a peer on port %d", options->port);
+	} else {
+		PrintConsole(game, "Netplay: joining %s:%d", options->address, options->port);
+	}
+	if (options->latency || options->jitter || options->loss) {
+		PrintConsole(game, "Netplay: simulating %d+%d ms latency and %.0f%% loss on outgoing packets", options->latency, options->jitter, options->loss * 100);
+	}
+	return net;
+}
+
+void DestroyNetplay(struct Netplay* net) {
+	CloseUdpSocket(net->socket);
+	free(net);
+}
+
+bool AdvanceNetplay(struct Game* game, struct Netplay* net, struct MatchState* match, unsigned char input, struct MatchEvents* events) {
+	memset(events, 0, sizeof(struct MatchEvents));
+	Receive(game, net, match);
+	FlushShim(net);
+
+	if (!net->connected) {
+		double now = al_get_time();
+		if ((net->options.mode == NETPLAY_JOIN) && (now - net->lastHello >= 0.5)) {
+			unsigned char buf[NETPLAY_PACKET_SIZE];
+			Send(net, buf, WriteHeader(net, buf, PACKET_HELLO));
+			net->lastHello = now;
+		}
+		return false;
+	}
+
+	if (net->rollbackFrom >= 0) {
+		Rollback(net, match, events);
+	}
+
+	// Don't get further ahead than can be rolled back, and let the peer catch up
+	// when it runs behind, as otherwise it'd be the only one doing rollbacks.
+	if ((net->tick - net->remoteConfirmed > net->maxRollback) || (net->tick - (net->remoteTick + net->rtt * 60 / 2) >= 2)) {
+		net->stats.stalls++;
+		SendInputs(net);
+		return false;
+	}
+
+	int tick = net->tick;
+	net->inputs[(tick + net->inputDelay) % NETPLAY_RING][net->local] = input;
+
+	unsigned char inputs[MATCH_PLAYERS];
+	inputs[net->local] = net->inputs[tick % NETPLAY_RING][net->local];
+	inputs[!net->local] = (tick <= net->remoteConfirmed) ? net->inputs[tick % NETPLAY_RING][!net->local] : PredictInput(net);
+	net->used[tick % NETPLAY_RING] = inputs[!net->local];
+	net->snapshots[tick % NETPLAY_RING] = *match;
+	struct MatchEvents stepped;
+	StepMatch(match, inputs, &stepped);
+	net->reported[tick % NETPLAY_RING] = stepped;
+	AddEvents(events, &stepped, stepped.flags);
+	net->tick++;
+	net->stats.ticks++;
+
+	SendInputs(net);
+	return true;
+}
+
+void PrintNetplayStats(struct Game* game, struct Netplay* net) {
+	PrintConsole(game, "Netplay: tick %d, rtt %.0f ms, input delay %d, %d rollbacks (%.1f ticks avg, %d deepest), %d stalls, %d packets dropped by the shim",
+	  net->tick, net->rtt * 1000, net->inputDelay, net->stats.rollbacks, net->stats.rollbacks ? net->stats.resimulated / (double)net->stats.rollbacks : 0.0,
+	  net->stats.deepest, net->stats.stalls, net->stats.dropped);
+}
@@ -0,0 +1,99 @@
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef NETPLAY_H
+#define NETPLAY_H
+
+#include "match.h"
+#include <libsuperderpy.h>
+
+// Must be a power of two, larger than the rollback window plus the input delay.
+#define NETPLAY_RING 128
+#define NETPLAY_MAX_ROLLBACK 32
+#define NETPLAY_SHIM_QUEUE 256
+#define NETPLAY_PACKET_SIZE 96
+
+enum NETPLAY_MODE {
+	NETPLAY_OFF,
+	NETPLAY_HOST,
+	NETPLAY_JOIN
+};
+
+struct NetplayOptions {
+	enum NETPLAY_MODE mode;
+	char address[64];
+	int port;
+	// the shim applies these to outgoing packets, so set them on both peers
+	int latency, jitter; // in milliseconds
+	double loss; // 0..1
+
+	bool spectateServer;
+	char spectateAddress[64]; // empty unless spectating
+	int spectatePort;
+};
+
+struct NetplayPacket {
+	double time; // when the shim lets it out
+	int size;
+	unsigned char data[NETPLAY_PACKET_SIZE];
+};
+
+struct Netplay {
+	struct NetplayOptions options;
+	int socket;
+	uint32_t peerAddress; // IPv4, in network byte order
+	uint16_t peerPort;
+	bool connected;
+	int local; // index of the player controlled from here
+	uint64_t seed;
+	double lastHello;
+
+	int maxRollback, inputDelay;
+
+	int tick; // next one to simulate
+	unsigned char inputs[NETPLAY_RING][MATCH_PLAYERS];
+	unsigned char used[NETPLAY_RING]; // remote input the tick was simulated with
+	struct MatchState snapshots[NETPLAY_RING]; // state before the tick
+	struct MatchEvents reported[NETPLAY_RING]; // what the tick was heard doing, in any of the timelines
+	int remoteConfirmed; // all remote inputs up to this tick are known
+	int localAcked; // the peer knows all our inputs up to this tick
+	int remoteTick;
+	int rollbackFrom;
+
+	uint32_t remoteSent; // timestamp of the newest packet from the peer
+	double rtt;
+
+	struct NetplayPacket shim[NETPLAY_SHIM_QUEUE];
+	int shimCount;
+
+	struct {
+		unsigned int ticks, rollbacks, resimulated, stalls, deepest, dropped;
+	} stats;
+};
+
+// Returns NULL when the socket can't be set up.
+struct Netplay* CreateNetplay(struct Game* game, struct NetplayOptions* options);
+void DestroyNetplay(struct Netplay* net);
+
+// Simulates the next tick, rolling back first when a remote input turned out to differ
+// from the prediction. Returns false when the tick has to wait for the peer. The events include
+// whatever a rollback turned up that wasn't heard the first time.
+bool AdvanceNetplay(struct Game* game, struct Netplay* net, struct MatchState* match, unsigned char input, struct MatchEvents* events);
+
+void PrintNetplayStats(struct Game* game, struct Netplay* net);
+
+#endif
@@ -0,0 +1,370 @@
+/*! \file particles.c
+ *  \brief Loads and draws the particle emitters described in the data files.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "common.h"
+#include "particles.h"
+#include <libsuperderpy.h>
+#include <stddef.h>
+#include <string.h>
+
+#define RESOURCE_OWNER "particles"
+#define ATLAS_PADDING 2
+
+struct ParticleVertex {
+	float x, y; // corner, relative to the middle of the sprite
+	float u, v; // within the frame, in pixels
+	float px, py, vx, vy;
+	float spawn, from, to, phase;
+	float angle, spin, wobble, wobbleSpeed;
+	float wave, waveSpeed, frameRate, frameOffset;
+	float firstFrame, frames;
+};
+
+static const char* Value(ALLEGRO_CONFIG* config, const char* section, const char* key, const char* def) {
+	const char* value = al_get_config_value(config, section, key);
+	return value ? value : def;
+}
+
+static float Number(ALLEGRO_CONFIG* config, const char* section, const char* key) {
+	return strtod(Value(config, section, key, "0"), NULL);
+}
+
+static void Pair(ALLEGRO_CONFIG* config, const char* section, const char* key, float* a, float* b) {
+	*a = *b = 0;
+	sscanf(Value(config, section, key, ""), "%f %f", a, b);
+}
+
+static int LoadFrame(struct Game* game, struct ParticleSystem* system, const char* path) {
+	for (unsigned int i = 0; i < system->bitmapsCount; i++) {
+		if (strcmp(system->paths[i], path) == 0) {
+			return i;
+		}
+	}
+	ALLEGRO_BITMAP* bitmap = al_load_bitmap(GetDataFilePath(game, path));
+	if (!bitmap) {
+		return -1;
+	}
+	system->paths[system->bitmapsCount] = strdup(path);
+	system->bitmaps[system->bitmapsCount] = TrackBitmap(game, RESOURCE_OWNER, bitmap);
+	return system->bitmapsCount++;
+}
+
+// Space separated paths, each one a frame; repeat a path to show it again.
+static bool LoadFrames(struct Game* game, struct ParticleSystem* system, const char* name, const char* list, struct EmitterLook* look) {
+	look->firstFrame = system->framesCount;
+	look->frames = 0;
+	while (*(list += strspn(list, " \t"))) {
+		size_t len = strcspn(list, " \t");
+		char path[255];
+		snprintf(path, sizeof(path), "%.*s", (int)len, list);
+		list += len;
+		if (look->firstFrame + look->frames >= PARTICLE_MAX_FRAMES) {
+			PrintConsole(game, "Particles: %s has too many frames, at most %d in total", name, PARTICLE_MAX_FRAMES);
+			return false;
+		}
+		int frame = LoadFrame(game, system, path);
+		if (frame < 0) {
+			PrintConsole(game, "Particles: %s can't load %s", name, path);
+			return false;
+		}
+		system->frames[look->firstFrame + look->frames++] = frame;
+	}
+	if (!look->frames) {
+		PrintConsole(game, "Particles: %s has no frames", name);
+		return false;
+	}
+	system->framesCount += look->frames;
+	return true;
+}
+
+static bool ReadEmitter(ALLEGRO_CONFIG* config, const char* name, struct Emitter* emitter) {
+	*emitter = (struct Emitter){0};
+	const char* trajectory = Value(config, name, "trajectory", "linear");
+	for (int i = 0; i < TRAJECTORY_TYPES; i++) {
+		if (strcmp(trajectory, TrajectoryNames[i]) == 0) {
+			emitter->trajectory = i;
+			break;
+		}
+		if (i == TRAJECTORY_TYPES - 1) {
+			return false;
+		}
+	}
+	emitter->count = strtol(Value(config, name, "count", "1"), NULL, 10);
+	float start, end;
+	Pair(config, name, "spawn", &start, &end);
+	emitter->start = start;
+	emitter->end = fmax(start, end);
+	Pair(config, name, "origin", &emitter->x, &emitter->y);
+	Pair(config, name, "origin_spread", &emitter->spreadX, &emitter->spreadY);
+	Pair(config, name, "velocity", &emitter->vx, &emitter->vy);
+	Pair(config, name, "velocity_spread", &emitter->spreadVX, &emitter->spreadVY);
+	emitter->angle = Number(config, name, "angle");
+	emitter->spin = Number(config, name, "spin");
+	emitter->spreadSpin = Number(config, name, "spin_spread");
+	Pair(config, name, "wobble", &emitter->wobble, &emitter->wobbleSpeed);
+	Pair(config, name, "wave", &emitter->wave, &emitter->waveSpeed);
+	emitter->frameRate = Number(config, name, "frame_rate");
+	emitter->scatter = strtol(Value(config, name, "scatter", "0"), NULL, 10);
+	emitter->seed = strtoull(Value(config, name, "seed", "0"), NULL, 10);
+	return true;
+}
+
+static int ReadFlip(const char* flip) {
+	int flags = 0;
+	if (strstr(flip, "horizontal")) {
+		flags |= ALLEGRO_FLIP_HORIZONTAL;
+	}
+	if (strstr(flip, "vertical")) {
+		flags |= ALLEGRO_FLIP_VERTICAL;
+	}
+	return flags;
+}
+
+struct ParticleSystem* LoadParticles(struct Game* game, const char* filename) {
+	struct ParticleSystem* system = calloc(1, sizeof(struct ParticleSystem));
+	ALLEGRO_CONFIG* config = al_load_config_file(GetDataFilePath(game, filename));
+	if (!config) {
+		PrintConsole(game, "Particles: can't read %s", filename);
+		return system;
+	}
+
+	unsigned int sections = 0;
+	ALLEGRO_CONFIG_SECTION* iterator;
+	for (const char* name = al_get_first_config_section(config, &iterator); name; name = al_get_next_config_section(&iterator)) {
+		sections++;
+	}
+	system->emitters = calloc(sections, sizeof(struct Emitter));
+	system->looks = calloc(sections, sizeof(struct EmitterLook));
+
+	for (const char* name = al_get_first_config_section(config, &iterator); name; name = al_get_next_config_section(&iterator)) {
+		if (!name[0]) {
+			continue; // the global section
+		}
+		struct Emitter* emitter = &system->emitters[system->emittersCount];
+		struct EmitterLook* look = &system->looks[system->emittersCount];
+		if (!ReadEmitter(config, name, emitter)) {
+			PrintConsole(game, "Particles: %s has an unknown trajectory", name);
+			continue;
+		}
+		if (!LoadFrames(game, system, name, Value(config, name, "frames", ""), look)) {
+			continue;
+		}
+		look->flags = ReadFlip(Value(config, name, "flip", ""));
+		ALLEGRO_BITMAP* bitmap = system->bitmaps[system->frames[look->firstFrame]];
+		emitter->radius = hypot(al_get_bitmap_width(bitmap), al_get_bitmap_height(bitmap)) / 2.0;
+		system->count += emitter->count;
+		system->emittersCount++;
+	}
+	al_destroy_config(config);
+
+	system->particles = calloc(system->count, sizeof(struct Particle));
+	system->poses = calloc(system->count, sizeof(struct ParticlePose));
+	unsigned int offset = 0;
+	for (unsigned int i = 0; i < system->emittersCount; i++) {
+		SpawnParticles(&system->emitters[i], i, &system->particles[offset]);
+		offset += system->emitters[i].count;
+	}
+	PrintConsole(game, "Particles: %u from %u emitters", system->count, system->emittersCount);
+	return system;
+}
+
+void DestroyParticles(struct Game* game, struct ParticleSystem* system) {
+	DestroyParticleBuffer(game, system);
+	for (unsigned int i = 0; i < system->bitmapsCount; i++) {
+		DestroyTrackedBitmap(game, system->bitmaps[i]);
+		free(system->paths[i]);
+	}
+	free(system->particles);
+	free(system->poses);
+	free(system->emitters);
+	free(system->looks);
+	free(system);
+}
+
+static ALLEGRO_SHADER* CreateParticleShader(struct Game* game) {
+	ALLEGRO_SHADER* shader = al_create_shader(ALLEGRO_SHADER_GLSL);
+	if (!shader) {
+		return NULL;
+	}
+	// plain textured quads, just like the animals
+	bool ok = al_attach_shader_source_file(shader, ALLEGRO_VERTEX_SHADER, GetDataFilePath(game, "shaders/particles_vertex.glsl")) &&
+		al_attach_shader_source_file(shader, ALLEGRO_PIXEL_SHADER, GetDataFilePath(game, "shaders/animals.glsl")) &&
+		al_build_shader(shader);
+	const char* log = al_get_shader_log(shader);
+	if (log && log[0]) {
+		PrintConsole(game, "%s", log);
+	}
+	if (!ok) {
+		al_destroy_shader(shader);
+		return NULL;
+	}
+	return shader;
+}
+
+static void CreateAtlas(struct Game* game, struct ParticleSystem* system) {
+	int width = 0, height = 0, atlasX[PARTICLE_MAX_FRAMES];
+	for (unsigned int i = 0; i < system->bitmapsCount; i++) {
+		atlasX[i] = width;
+		width += al_get_bitmap_width(system->bitmaps[i]) + ATLAS_PADDING;
+		if (al_get_bitmap_height(system->bitmaps[i]) > height) {
+			height = al_get_bitmap_height(system->bitmaps[i]);
+		}
+	}
+	for (unsigned int i = 0; i < system->framesCount; i++) {
+		system->frameUV[i][0] = atlasX[system->frames[i]];
+		system->frameUV[i][1] = 0;
+	}
+	system->atlas = TrackBitmap(game, RESOURCE_OWNER, al_create_bitmap(width, height));
+
+	ALLEGRO_STATE state;
+	al_store_state(&state, ALLEGRO_STATE_TARGET_BITMAP | ALLEGRO_STATE_BLENDER);
+	al_set_target_bitmap(system->atlas);
+	al_clear_to_color(al_map_rgba(0, 0, 0, 0));
+	al_set_blender(ALLEGRO_ADD, ALLEGRO_ONE, ALLEGRO_ZERO); // copy, it's premultiplied already
+	for (unsigned int i = 0; i < system->bitmapsCount; i++) {
+		al_draw_bitmap(system->bitmaps[i], atlasX[i], 0, 0);
+	}
+	al_restore_state(&state);
+}
+
+static void FillQuad(const struct ParticleSystem* system, const struct Particle* particle, struct ParticleVertex* quad) {
+	const struct EmitterLook* look = &system->looks[particle->emitter];
+	// all the frames of an emitter get the size of the first one
+	ALLEGRO_BITMAP* bitmap = system->bitmaps[system->frames[look->firstFrame]];
+	int width = al_get_bitmap_width(bitmap), height = al_get_bitmap_height(bitmap);
+	bool flipX = look->flags & ALLEGRO_FLIP_HORIZONTAL, flipY = look->flags & ALLEGRO_FLIP_VERTICAL;
+	for (int i = 0; i < 4; i++) {
+		bool right = (i == 1) || (i == 2);
+		bool bottom = i >= 2;
+		quad[i] = (struct ParticleVertex){
+			.x = (right ? width : 0) - width / 2,
+			.y = (bottom ? height : 0) - height / 2,
+			.u = (right != flipX) ? width : 0,
+			.v = (bottom != flipY) ? height : 0,
+			.px = particle->x,
+			.py = particle->y,
+			.vx = particle->vx,
+			.vy = particle->vy,
+			.spawn = particle->spawn,
+			.from = particle->from,
+			.to = particle->to,
+			.phase = particle->phase,
+			.angle = particle->angle,
+			.spin = particle->spin,
+			.wobble = particle->wobble,
+			.wobbleSpeed = particle->wobbleSpeed,
+			.wave = particle->wave,
+			.waveSpeed = particle->waveSpeed,
+			.frameRate = particle->frameRate,
+			.frameOffset = particle->frameOffset,
+			.firstFrame = look->firstFrame,
+			.frames = look->frames,
+		};
+	}
+}
+
+static bool UploadParticles(struct ParticleSystem* system) {
+	ALLEGRO_VERTEX_ELEMENT elements[] = {
+		{ALLEGRO_PRIM_POSITION, ALLEGRO_PRIM_FLOAT_2, offsetof(struct ParticleVertex, x)},
+		{ALLEGRO_PRIM_TEX_COORD_PIXEL, ALLEGRO_PRIM_FLOAT_2, offsetof(struct ParticleVertex, u)},
+		{ALLEGRO_PRIM_USER_ATTR, ALLEGRO_PRIM_FLOAT_4, offsetof(struct ParticleVertex, px)},
+		{ALLEGRO_PRIM_USER_ATTR + 1, ALLEGRO_PRIM_FLOAT_4, offsetof(struct ParticleVertex, spawn)},
+		{ALLEGRO_PRIM_USER_ATTR + 2, ALLEGRO_PRIM_FLOAT_4, offsetof(struct ParticleVertex, angle)},
+		{ALLEGRO_PRIM_USER_ATTR + 3, ALLEGRO_PRIM_FLOAT_4, offsetof(struct ParticleVertex, wave)},
+		{ALLEGRO_PRIM_USER_ATTR + 4, ALLEGRO_PRIM_FLOAT_2, offsetof(struct ParticleVertex, firstFrame)},
+		{0, 0, 0},
+	};
+	system->decl = al_create_vertex_decl(elements, sizeof(struct ParticleVertex));
+
+	struct ParticleVertex* vertices = malloc(system->count * 4 * sizeof(struct ParticleVertex));
+	uint32_t* indices = malloc(system->count * 6 * sizeof(uint32_t));
+	static const int corners[6] = {0, 1, 2, 0, 2, 3};
+	for (unsigned int q = 0; q < system->count; q++) {
+		FillQuad(system, &system->particles[q], &vertices[q * 4]);
+		for (int i = 0; i < 6; i++) {
+			indices[q * 6 + i] = q * 4 + corners[i];
+		}
+	}
+	system->vertices = al_create_vertex_buffer(system->decl, vertices, system->count * 4, ALLEGRO_PRIM_BUFFER_STATIC);
+	system->indices = al_create_index_buffer(sizeof(uint32_t), indices, system->count * 6, ALLEGRO_PRIM_BUFFER_STATIC);
+	free(vertices);
+	free(indices);
+	return system->vertices && system->indices;
+}
+
+void CreateParticleBuffer(struct Game* game, struct ParticleSystem* system) {
+	if (!system->count) {
+		return;
+	}
+	system->shader = CreateParticleShader(game);
+	if (!system->shader) {
+		PrintConsole(game, "Particle shader unavailable, drawing particles one by one");
+		return;
+	}
+	CreateAtlas(game, system);
+	if (!UploadParticles(system)) {
+		PrintConsole(game, "Can't upload %u particle quads", system->count);
+		DestroyParticleBuffer(game, system);
+	}
+}
+
+void DestroyParticleBuffer(struct Game* game, struct ParticleSystem* system) {
+	if (system->vertices) {
+		al_destroy_vertex_buffer(system->vertices);
+	}
+	if (system->indices) {
+		al_destroy_index_buffer(system->indices);
+	}
+	if (system->decl) {
+		al_destroy_vertex_decl(system->decl);
+	}
+	if (system->atlas) {
+		DestroyTrackedBitmap(game, system->atlas);
+	}
+	if (system->shader) {
+		al_destroy_shader(system->shader);
+	}
+	system->vertices = NULL;
+	system->indices = NULL;
+	system->decl = NULL;
+	system->atlas = NULL;
+	system->shader = NULL;
+}
+
+unsigned int DrawParticles(struct ParticleSystem* system, double time) {
+	if (system->vertices) {
+		al_use_shader(system->shader);
+		al_set_shader_float("time", time);
+		al_set_shader_float_vector("frames", 2, &system->frameUV[0][0], system->framesCount);
+		al_draw_indexed_buffer(system->vertices, system->atlas, system->indices, 0, system->count * 6, ALLEGRO_PRIM_TRIANGLE_LIST);
+		al_use_shader(NULL);
+		return 0;
+	}
+
+	unsigned int count = PoseParticles(system->particles, system->count, time, system->poses);
+	for (unsigned int i = 0; i < count; i++) {
+		const struct ParticlePose* pose = &system->poses[i];
+		const struct EmitterLook* look = &system->looks[pose->particle->emitter];
+		ALLEGRO_BITMAP* bitmap = system->bitmaps[system->frames[look->firstFrame + pose->frame % look->frames]];
+		al_draw_rotated_bitmap(bitmap, al_get_bitmap_width(bitmap) / 2, al_get_bitmap_height(bitmap) / 2,
+		  pose->x, pose->y, pose->angle, look->flags);
+	}
+	return count;
+}
@@ -0,0 +1,72 @@
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PARTICLES_H
+#define PARTICLES_H
+
+#include "emitters.h"
+#include <allegro5/allegro_primitives.h>
+#include <libsuperderpy.h>
+
+// In all the emitters together; the shader gets them as a uniform array of the same size.
+#define PARTICLE_MAX_FRAMES 32
+
+// What the particles of one emitter look like.
+struct EmitterLook {
+	unsigned int firstFrame, frames;
+	int flags; // ALLEGRO_FLIP_*
+};
+
+// Bees, leaves and whatever else the emitters in the data file describe. Every particle gets
+// a quad in a static vertex buffer and the vertex shader places it from the time alone;
+// without shaders they're posed on the CPU and drawn one by one.
+struct ParticleSystem {
+	struct Emitter* emitters;
+	struct EmitterLook* looks;
+	unsigned int emittersCount;
+
+	char* paths[PARTICLE_MAX_FRAMES];
+	ALLEGRO_BITMAP* bitmaps[PARTICLE_MAX_FRAMES];
+	unsigned int bitmapsCount;
+	unsigned int frames[PARTICLE_MAX_FRAMES]; // which bitmap every frame shows
+	unsigned int framesCount;
+
+	struct Particle* particles;
+	struct ParticlePose* poses;
+	unsigned int count;
+
+	ALLEGRO_SHADER* shader;
+	ALLEGRO_BITMAP* atlas;
+	float frameUV[PARTICLE_MAX_FRAMES][2];
+	ALLEGRO_VERTEX_DECL* decl;
+	ALLEGRO_VERTEX_BUFFER* vertices;
+	ALLEGRO_INDEX_BUFFER* indices;
+};
+
+// Reads the emitters from the data file, loads their frames and spawns all the particles.
+// Problems with single emitters get reported and the emitters skipped.
+struct ParticleSystem* LoadParticles(struct Game* game, const char* filename);
+void DestroyParticles(struct Game* game, struct ParticleSystem* system);
+// Moves the particles to the GPU. Has to be called on the main thread; when it fails, or isn't
+// called at all, the particles get drawn one by one.
+void CreateParticleBuffer(struct Game* game, struct ParticleSystem* system);
+void DestroyParticleBuffer(struct Game* game, struct ParticleSystem* system);
+// Draws the particles at time (0..1) in 1920x1080 coordinates and returns how many were posed on
+// the CPU, which is none when they're drawn from the buffer.
+unsigned int DrawParticles(struct ParticleSystem* system, double time);
+
+#endif
@@ -0,0 +1,137 @@
+/*! \file sfx.c
+ *  \brief Pooled voices for one-shot effects and low latency streams.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "common.h"
+#include "sfx.h"
+#include <libsuperderpy.h>
+
+static void MeasureLatency(void* buf, unsigned int samples, void* userdata) {
+	struct SfxPool* pool = userdata;
+	if (!atomic_load_explicit(&pool->pending, memory_order_acquire)) {
+		return;
+	}
+	float* data = buf;
+	for (unsigned int i = 0; i < samples * 2; i++) {
+		if (data[i] != 0.0) {
+			// the voice's own buffering isn't included, as there's no portable way to query it
+			uint_fast64_t us = (al_get_time() - pool->triggered) * 1000000.0;
+			atomic_fetch_add(&pool->latencySum, us);
+			atomic_fetch_add(&pool->latencyCount, 1);
+			if (us > atomic_load(&pool->latencyMax)) {
+				atomic_store(&pool->latencyMax, us);
+			}
+			atomic_store_explicit(&pool->pending, false, memory_order_release);
+			return;
+		}
+	}
+}
+
+struct SfxPool* CreateSfxPool(struct Game* game, ALLEGRO_MIXER* parent, int voices) {
+	struct SfxPool* pool = calloc(1, sizeof(struct SfxPool));
+	pool->count = (voices < 1) ? 1 : (voices < SFX_MAX_VOICES) ? voices : SFX_MAX_VOICES;
+	atomic_init(&pool->pending, false);
+	atomic_init(&pool->latencyCount, 0);
+	atomic_init(&pool->latencySum, 0);
+	atomic_init(&pool->latencyMax, 0);
+
+	pool->mixer = al_create_mixer(al_get_mixer_frequency(parent), ALLEGRO_AUDIO_DEPTH_FLOAT32, ALLEGRO_CHANNEL_CONF_2);
+	al_set_mixer_postprocess_callback(pool->mixer, MeasureLatency, pool);
+	al_attach_mixer_to_mixer(pool->mixer, parent);
+	for (int i = 0; i < pool->count; i++) {
+		pool->voices[i] = al_create_sample_instance(NULL);
+		al_set_sample_instance_playmode(pool->voices[i], ALLEGRO_PLAYMODE_ONCE);
+	}
+	PrintConsole(game, "SFX pool: %d voices", pool->count);
+	return pool;
+}
+
+void DestroySfxPool(struct SfxPool* pool) {
+	for (int i = 0; i < pool->count; i++) {
+		al_destroy_sample_instance(pool->voices[i]);
+	}
+	al_detach_mixer(pool->mixer);
+	al_destroy_mixer(pool->mixer);
+	free(pool);
+}
+
+void PlaySfx(struct SfxPool* pool, ALLEGRO_SAMPLE* sample, float gain, float speed) {
+	int voice = -1;
+	for (int i = 0; i < pool->count; i++) {
+		if (!al_get_sample_instance_playing(pool->voices[i])) {
+			voice = i;
+			break;
+		}
+		if ((voice == -1) || (pool->started[i] < pool->started[voice])) {
+			voice = i;
+		}
+	}
+	ALLEGRO_SAMPLE_INSTANCE* instance = pool->voices[voice];
+	if (al_get_sample_instance_playing(instance)) {
+		pool->stolen++;
+	}
+	// the mixer can only tell when the new voice starts if nothing else makes a sound
+	bool silent = true;
+	for (int i = 0; i < pool->count; i++) {
+		if (al_get_sample_instance_playing(pool->voices[i])) {
+			silent = false;
+		}
+	}
+
+	if (al_get_sample(instance) != sample) {
+		// stops the instance and reattaches it if the format differs
+		al_set_sample(instance, sample);
+		if (!al_get_sample_instance_attached(instance)) {
+			al_attach_sample_instance_to_mixer(instance, pool->mixer);
+		}
+	} else {
+		al_stop_sample_instance(instance);
+	}
+	al_set_sample_instance_position(instance, 0);
+	al_set_sample_instance_gain(instance, gain);
+	al_set_sample_instance_speed(instance, speed);
+
+	pool->started[voice] = al_get_time();
+	if (silent && !atomic_load_explicit(&pool->pending, memory_order_acquire)) {
+		pool->triggered = pool->started[voice];
+		atomic_store_explicit(&pool->pending, true, memory_order_release);
+	}
+	al_play_sample_instance(instance);
+	pool->played++;
+}
+
+void PrintSfxStats(struct Game* game, struct SfxPool* pool) {
+	unsigned int count = atomic_load(&pool->latencyCount);
+	PrintConsole(game, "SFX: %d played, %d voices stolen", pool->played, pool->stolen);
+	if (count) {
+		PrintConsole(game, "SFX: event to mix latency avg %.1f ms, max %.1f ms (%d samples)", atomic_load(&pool->latencySum) / 1000.0 / count, atomic_load(&pool->latencyMax) / 1000.0, count);
+	}
+}
+
+ALLEGRO_AUDIO_STREAM* LoadLowLatencyAudioStream(struct Game* game, const char* filename) {
+	int fragments = strtol(GetConfigOptionDefault(game, "nowandthen", "stream_fragments", "4"), NULL, 10);
+	int samples = strtol(GetConfigOptionDefault(game, "nowandthen", "stream_fragment_samples", "512"), NULL, 10);
+	if (fragments < 2) {
+		fragments = 2;
+	}
+	if (samples < 64) {
+		samples = 64;
+	}
+	return al_load_audio_stream(filename, fragments, samples);
+}
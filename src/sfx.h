@@ -0,0 +1,52 @@
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SFX_H
+#define SFX_H
+
+#include <libsuperderpy.h>
+#include <stdatomic.h>
+
+#define SFX_MAX_VOICES 16
+
+// A fixed set of sample instances shared by all one-shot effects, so overlapping
+// sounds get their own voice instead of restarting the same instance.
+struct SfxPool {
+	ALLEGRO_MIXER* mixer;
+	ALLEGRO_SAMPLE_INSTANCE* voices[SFX_MAX_VOICES];
+	double started[SFX_MAX_VOICES];
+	int count;
+	unsigned int played, stolen;
+
+	// event-to-mix latency, measured by the mixer callback for the sounds that start in silence
+	double triggered;
+	atomic_bool pending;
+	atomic_uint latencyCount;
+	atomic_uint_fast64_t latencySum, latencyMax; // in microseconds
+};
+
+struct SfxPool* CreateSfxPool(struct Game* game, ALLEGRO_MIXER* parent, int voices);
+void DestroySfxPool(struct SfxPool* pool);
+// Uses a free voice, or the one that has been playing the longest when all are busy.
+void PlaySfx(struct SfxPool* pool, ALLEGRO_SAMPLE* sample, float gain, float speed);
+void PrintSfxStats(struct Game* game, struct SfxPool* pool);
+
+// Streams whose buffering adds latency to gameplay, sized by [nowandthen] stream_fragments
+// and stream_fragment_samples.
+ALLEGRO_AUDIO_STREAM* LoadLowLatencyAudioStream(struct Game* game, const char* filename);
+
+#endif
@@ -0,0 +1,514 @@
+/*! \file spectate.c
+ *  \brief Delta-compressed broadcast of match state to spectators.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "spectate.h"
+#include "udp.h"
+#include <stdlib.h>
+#include <string.h>
+
+enum SPECTATE_PACKET {
+	SPECTATE_SUBSCRIBE,
+	SPECTATE_FRAME
+};
+
+// Each field is sent only when it differs from the baseline the viewer acknowledged.
+enum SPECTATE_FIELD {
+	FIELD_SEED,
+	FIELD_RNG,
+	FIELD_BALLX,
+	FIELD_BALLY,
+	FIELD_DX,
+	FIELD_DY,
+	FIELD_BALLROT,
+	FIELD_TIME_LEFT,
+	FIELD_TIME_RIGHT,
+	FIELD_FADE_LEFT,
+	FIELD_FADE_RIGHT,
+	FIELD_SCORE,
+	FIELD_SCORES,
+	FIELD_DELAY,
+	FIELD_SHAKE,
+	FIELD_COOLDOWN,
+	FIELD_FLAGS,
+	FIELD_INPUTS,
+	FIELD_EVENTS,
+	FIELD_LAST_EVENTS,
+	FIELDS
+};
+
+// magic (2), type, field mask (3), seq (4), baseline seq (4)
+#define SPECTATE_HEADER 14
+#define NO_BASELINE 0xFFFFFFFF
+
+struct Writer {
+	unsigned char* buf;
+	int pos;
+};
+
+static void Put(struct Writer* w, uint64_t value, int bytes) {
+	for (int i = bytes - 1; i >= 0; i--) {
+		w->buf[w->pos++] = value >> (i * 8);
+	}
+}
+
+static uint64_t Get(const unsigned char* buf, int* pos, int bytes) {
+	uint64_t value = 0;
+	for (int i = 0; i < bytes; i++) {
+		value = (value << 8) | buf[(*pos)++];
+	}
+	return value;
+}
+
+static uint32_t FloatBits(float value) {
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+	return bits;
+}
+
+static float BitsFloat(uint32_t bits) {
+	float value;
+	memcpy(&value, &bits, sizeof(value));
+	return value;
+}
+
+static uint64_t DoubleBits(double value) {
+	uint64_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+	return bits;
+}
+
+static double BitsDouble(uint64_t bits) {
+	double value;
+	memcpy(&value, &bits, sizeof(value));
+	return value;
+}
+
+static unsigned int PackFlags(const struct MatchState* state) {
+	return state->started | (state->scoreleft << 1) | (state->lastleft << 2) | (state->lastbackward[0] << 3) | (state->lastbackward[1] << 4) |
+		(state->forward[0] << 5) | (state->backward[0] << 6) | (state->forward[1] << 7) | (state->backward[1] << 8);
+}
+
+static void UnpackFlags(struct MatchState* state, unsigned int flags) {
+	state->started = flags & (1 << 0);
+	state->scoreleft = flags & (1 << 1);
+	state->lastleft = flags & (1 << 2);
+	state->lastbackward[0] = flags & (1 << 3);
+	state->lastbackward[1] = flags & (1 << 4);
+	state->forward[0] = flags & (1 << 5);
+	state->backward[0] = flags & (1 << 6);
+	state->forward[1] = flags & (1 << 7);
+	state->backward[1] = flags & (1 << 8);
+}
+
+// Encodes each field as (bytes, value); both sides go through this, so they can't disagree on the layout.
+static int FieldValue(const struct SpectateFrame* frame, enum SPECTATE_FIELD field, uint64_t* value) {
+	const struct MatchState* s = &frame->state;
+	switch (field) {
+		case FIELD_SEED:
+			*value = frame->seed;
+			return 8;
+		case FIELD_RNG:
+			*value = s->rng;
+			return 8;
+		case FIELD_BALLX:
+			*value = FloatBits(s->ballx);
+			return 4;
+		case FIELD_BALLY:
+			*value = FloatBits(s->bally);
+			return 4;
+		case FIELD_DX:
+			*value = FloatBits(s->dx);
+			return 4;
+		case FIELD_DY:
+			*value = FloatBits(s->dy);
+			return 4;
+		case FIELD_BALLROT:
+			*value = FloatBits(s->ballrot);
+			return 4;
+		case FIELD_TIME_LEFT:
+			*value = DoubleBits(s->time[0]);
+			return 8;
+		case FIELD_TIME_RIGHT:
+			*value = DoubleBits(s->time[1]);
+			return 8;
+		case FIELD_FADE_LEFT:
+			*value = FloatBits(s->fade[0]);
+			return 4;
+		case FIELD_FADE_RIGHT:
+			*value = FloatBits(s->fade[1]);
+			return 4;
+		case FIELD_SCORE:
+			*value = (uint16_t)s->score;
+			return 2;
+		case FIELD_SCORES:
+			*value = ((s->leftscore & 0xFF) << 8) | (s->rightscore & 0xFF);
+			return 2;
+		case FIELD_DELAY:
+			*value = (uint16_t)s->delay;
+			return 2;
+		case FIELD_SHAKE:
+			*value = ((s->shake[0] & 0xFF) << 8) | (s->shake[1] & 0xFF);
+			return 2;
+		case FIELD_COOLDOWN:
+			*value = s->cooldown & 0xFF;
+			return 1;
+		case FIELD_FLAGS:
+			*value = PackFlags(s);
+			return 2;
+		case FIELD_INPUTS:
+			*value = (s->lastInput[0] << 4) | (s->lastInput[1] & 0xF);
+			return 1;
+		case FIELD_EVENTS:
+			*value = ((uint64_t)frame->events.hits << 40) | ((uint64_t)frame->events.points << 32) | ((uint64_t)frame->events.starts << 24) | (frame->events.finishes << 16) |
+				(frame->events.sides << 8) | frame->events.changes;
+			return 6;
+		case FIELD_LAST_EVENTS:
+			*value = ((uint64_t)FloatBits(frame->events.last.hitSpeed) << 24) | ((uint64_t)(uint16_t)frame->events.last.score << 8) | (frame->events.last.pointLeft << 2) | (frame->events.last.yay & 3);
+			return 7;
+		case FIELDS:
+			break;
+	}
+	return 0;
+}
+
+static void SetFieldValue(struct SpectateFrame* frame, enum SPECTATE_FIELD field, uint64_t value) {
+	struct MatchState* s = &frame->state;
+	switch (field) {
+		case FIELD_SEED:
+			frame->seed = value;
+			break;
+		case FIELD_RNG:
+			s->rng = value;
+			break;
+		case FIELD_BALLX:
+			s->ballx = BitsFloat(value);
+			break;
+		case FIELD_BALLY:
+			s->bally = BitsFloat(value);
+			break;
+		case FIELD_DX:
+			s->dx = BitsFloat(value);
+			break;
+		case FIELD_DY:
+			s->dy = BitsFloat(value);
+			break;
+		case FIELD_BALLROT:
+			s->ballrot = BitsFloat(value);
+			break;
+		case FIELD_TIME_LEFT:
+			s->time[0] = BitsDouble(value);
+			break;
+		case FIELD_TIME_RIGHT:
+			s->time[1] = BitsDouble(value);
+			break;
+		case FIELD_FADE_LEFT:
+			s->fade[0] = BitsFloat(value);
+			break;
+		case FIELD_FADE_RIGHT:
+			s->fade[1] = BitsFloat(value);
+			break;
+		case FIELD_SCORE:
+			s->score = (int16_t)value;
+			break;
+		case FIELD_SCORES:
+			s->leftscore = (value >> 8) & 0xFF;
+			s->rightscore = value & 0xFF;
+			break;
+		case FIELD_DELAY:
+			s->delay = (int16_t)value;
+			break;
+		case FIELD_SHAKE:
+			s->shake[0] = (value >> 8) & 0xFF;
+			s->shake[1] = value & 0xFF;
+			break;
+		case FIELD_COOLDOWN:
+			s->cooldown = value;
+			break;
+		case FIELD_FLAGS:
+			UnpackFlags(s, value);
+			break;
+		case FIELD_INPUTS:
+			s->lastInput[0] = value >> 4;
+			s->lastInput[1] = value & 0xF;
+			break;
+		case FIELD_EVENTS:
+			frame->events.hits = value >> 40;
+			frame->events.points = value >> 32;
+			frame->events.starts = value >> 24;
+			frame->events.finishes = value >> 16;
+			frame->events.sides = value >> 8;
+			frame->events.changes = value;
+			break;
+		case FIELD_LAST_EVENTS:
+			frame->events.last.hitSpeed = BitsFloat(value >> 24);
+			frame->events.last.score = (int16_t)(value >> 8);
+			frame->events.last.pointLeft = value & (1 << 2);
+			frame->events.last.yay = value & 3;
+			break;
+		case FIELDS:
+			break;
+	}
+}
+
+static int EncodeFrame(unsigned char* buf, const struct SpectateFrame* frame, const struct SpectateFrame* baseline) {
+	struct Writer w = {.buf = buf, .pos = SPECTATE_HEADER};
+	uint32_t mask = 0;
+	for (int i = 0; i < FIELDS; i++) {
+		uint64_t value, old = 0;
+		int bytes = FieldValue(frame, i, &value);
+		if (baseline) {
+			FieldValue(baseline, i, &old);
+			if (value == old) {
+				continue;
+			}
+		}
+		mask |= 1u << i;
+		Put(&w, value, bytes);
+	}
+	int size = w.pos;
+	w.pos = 0;
+	Put(&w, 'N', 1);
+	Put(&w, 'S', 1);
+	Put(&w, SPECTATE_FRAME, 1);
+	Put(&w, mask, 3);
+	Put(&w, frame->seq, 4);
+	Put(&w, baseline ? baseline->seq : NO_BASELINE, 4);
+	return size;
+}
+
+struct SpectateServer* CreateSpectateServer(int port, int interval) {
+	int sock = OpenUdpSocket(port);
+	if (sock < 0) {
+		return NULL;
+	}
+	struct SpectateServer* server = calloc(1, sizeof(struct SpectateServer));
+	server->socket = sock;
+	server->interval = (interval > 0) ? interval : 1;
+	return server;
+}
+
+void DestroySpectateServer(struct SpectateServer* server) {
+	CloseUdpSocket(server->socket);
+	free(server);
+}
+
+static void ReceiveSubscriptions(struct SpectateServer* server, double now) {
+	unsigned char buf[SPECTATE_PACKET_SIZE];
+	uint32_t address;
+	uint16_t port;
+	int size;
+	while ((size = ReceiveUdp(server->socket, buf, sizeof(buf), &address, &port)) >= 0) {
+		if ((size < 8) || (buf[0] != 'N') || (buf[1] != 'S') || (buf[2] != SPECTATE_SUBSCRIBE)) {
+			continue;
+		}
+		int pos = 3;
+		bool acked = Get(buf, &pos, 1);
+		uint32_t ack = Get(buf, &pos, 4);
+
+		struct SpectateViewer* viewer = NULL;
+		for (int i = 0; i < server->viewerCount; i++) {
+			if ((server->viewers[i].address == address) && (server->viewers[i].port == port)) {
+				viewer = &server->viewers[i];
+			}
+		}
+		if (!viewer) {
+			if (server->viewerCount == SPECTATE_MAX_CLIENTS) {
+				continue;
+			}
+			viewer = &server->viewers[server->viewerCount++];
+			*viewer = (struct SpectateViewer){.address = address, .port = port};
+		}
+		viewer->lastSeen = now;
+		// acks can arrive out of order
+		if (acked && (!viewer->acked || ((int32_t)(ack - viewer->ack) > 0))) {
+			viewer->acked = true;
+			viewer->ack = ack;
+		}
+	}
+
+	for (int i = 0; i < server->viewerCount; i++) {
+		if (now - server->viewers[i].lastSeen > SPECTATE_TIMEOUT) {
+			server->viewers[i--] = server->viewers[--server->viewerCount];
+		}
+	}
+}
+
+void BroadcastSpectate(struct SpectateServer* server, struct MatchState* state, uint64_t seed, double now) {
+	ReceiveSubscriptions(server, now);
+	// where the keys change, the server moved the clocks with phases the viewers don't get, and
+	// some changes, like a key let go and pressed again within a tick, don't show in the inputs
+	if (memcmp(state->lastInput, server->lastInput, sizeof(server->lastInput)) || (state->phased != server->phased)) {
+		server->events.changes++;
+		memcpy(server->lastInput, state->lastInput, sizeof(server->lastInput));
+		server->phased = state->phased;
+	}
+	if (server->ticks++ % server->interval) {
+		return;
+	}
+
+	struct SpectateFrame* frame = &server->history[server->seq % SPECTATE_HISTORY];
+	frame->seq = server->seq++;
+	frame->state = *state;
+	frame->seed = seed;
+	frame->events = server->events;
+
+	for (int i = 0; i < server->viewerCount; i++) {
+		struct SpectateViewer* viewer = &server->viewers[i];
+		struct SpectateFrame* baseline = NULL;
+		if (viewer->acked && (frame->seq - viewer->ack < SPECTATE_HISTORY)) {
+			baseline = &server->history[viewer->ack % SPECTATE_HISTORY];
+		}
+		unsigned char buf[SPECTATE_PACKET_SIZE];
+		int size = EncodeFrame(buf, frame, baseline);
+		SendUdp(server->socket, viewer->address, viewer->port, buf, size);
+		server->bytes += size;
+	}
+}
+
+void NoteSpectateEvents(struct SpectateServer* server, const struct MatchEvents* events) {
+	struct SpectateEvents* counts = &server->events;
+	if (events->flags & EVENT_HIT) {
+		counts->hits++;
+		counts->last.hitSpeed = events->hitSpeed;
+	}
+	if (events->flags & EVENT_POINT) {
+		counts->points++;
+		counts->last.pointLeft = events->pointLeft;
+		counts->last.score = events->score;
+		counts->last.yay = events->yay;
+	}
+	counts->starts += !!(events->flags & EVENT_STARTED);
+	counts->finishes += !!(events->flags & EVENT_FINISHED);
+	counts->sides += !!(events->flags & EVENT_SCORE_SIDE);
+}
+
+struct SpectateClient* CreateSpectateClient(const char* host, int port) {
+	struct SpectateClient* client = calloc(1, sizeof(struct SpectateClient));
+	if (!ResolveUdpAddress(host, port, &client->address, &client->port)) {
+		free(client);
+		return NULL;
+	}
+	client->socket = OpenUdpSocket(0);
+	if (client->socket < 0) {
+		free(client);
+		return NULL;
+	}
+	client->lastSubscribe = -SPECTATE_TIMEOUT;
+	return client;
+}
+
+void DestroySpectateClient(struct SpectateClient* client) {
+	CloseUdpSocket(client->socket);
+	free(client);
+}
+
+static void Subscribe(struct SpectateClient* client, double now) {
+	unsigned char buf[8];
+	struct Writer w = {.buf = buf};
+	Put(&w, 'N', 1);
+	Put(&w, 'S', 1);
+	Put(&w, SPECTATE_SUBSCRIBE, 1);
+	Put(&w, client->have, 1);
+	Put(&w, client->latest, 4);
+	SendUdp(client->socket, client->address, client->port, buf, w.pos);
+	client->lastSubscribe = now;
+}
+
+static bool DecodeFrame(struct SpectateClient* client, const unsigned char* buf, int size, uint32_t* seq) {
+	int pos = 3;
+	uint32_t mask = Get(buf, &pos, 3);
+	*seq = Get(buf, &pos, 4);
+	uint32_t base = Get(buf, &pos, 4);
+
+	struct SpectateFrame frame = {0};
+	if (base != NO_BASELINE) {
+		struct SpectateFrame* baseline = &client->history[base % SPECTATE_HISTORY];
+		if (baseline->seq != base) {
+			return false;
+		}
+		frame = *baseline;
+	} else {
+		InitMatch(&frame.state, 0);
+	}
+	for (int i = 0; i < FIELDS; i++) {
+		if (!(mask & (1u << i))) {
+			continue;
+		}
+		uint64_t unused;
+		int bytes = FieldValue(&frame, i, &unused);
+		if (pos + bytes > size) {
+			return false;
+		}
+		SetFieldValue(&frame, i, Get(buf, &pos, bytes));
+	}
+	frame.seq = *seq;
+	client->history[*seq % SPECTATE_HISTORY] = frame;
+	return true;
+}
+
+struct SpectateFrame* ReceiveSpectate(struct SpectateClient* client, double now) {
+	unsigned char buf[SPECTATE_PACKET_SIZE];
+	uint32_t address;
+	uint16_t port;
+	int size;
+	bool updated = false;
+	while ((size = ReceiveUdp(client->socket, buf, sizeof(buf), &address, &port)) >= 0) {
+		if ((address != client->address) || (port != client->port) || (size < SPECTATE_HEADER) || (buf[0] != 'N') || (buf[1] != 'S') || (buf[2] != SPECTATE_FRAME)) {
+			continue;
+		}
+		client->bytes += size;
+		client->packets++;
+		uint32_t seq;
+		if (!DecodeFrame(client, buf, size, &seq)) {
+			client->undecodable++;
+			continue;
+		}
+		if (!client->have || ((int32_t)(seq - client->latest) > 0)) {
+			client->have = true;
+			client->latest = seq;
+			updated = true;
+			// acknowledging every frame keeps the deltas small
+			Subscribe(client, now);
+		}
+	}
+	if (now - client->lastSubscribe >= 1.0) {
+		Subscribe(client, now);
+	}
+	return updated ? &client->history[client->latest % SPECTATE_HISTORY] : NULL;
+}
+
+void TakeSpectateEvents(struct SpectateClient* client, const struct SpectateFrame* frame, struct MatchEvents* events) {
+	memset(events, 0, sizeof(struct MatchEvents));
+	const struct SpectateEvents *now = &frame->events, *then = &client->played;
+	if (client->playing) {
+		// whatever happened before the viewer joined stays in the past
+		events->flags |= (now->hits != then->hits) ? EVENT_HIT : 0;
+		events->flags |= (now->points != then->points) ? EVENT_POINT : 0;
+		events->flags |= (now->starts != then->starts) ? EVENT_STARTED : 0;
+		events->flags |= (now->finishes != then->finishes) ? EVENT_FINISHED : 0;
+		events->flags |= (now->sides != then->sides) ? EVENT_SCORE_SIDE : 0;
+		events->hitSpeed = now->last.hitSpeed;
+		events->pointLeft = now->last.pointLeft;
+		events->score = now->last.score;
+		events->yay = now->last.yay;
+	}
+	client->played = *now;
+	client->playing = true;
+}
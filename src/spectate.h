@@ -0,0 +1,97 @@
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SPECTATE_H
+#define SPECTATE_H
+
+#include "match.h"
+
+#define SPECTATE_MAX_CLIENTS 16
+// Must be a power of two. At the default interval it covers about four seconds.
+#define SPECTATE_HISTORY 128
+#define SPECTATE_PACKET_SIZE 128
+#define SPECTATE_TIMEOUT 5.0
+
+// Counts what happened on the server so far, wrapping around, so a viewer can tell what went on
+// in the frames it lost.
+struct SpectateEvents {
+	uint8_t hits, points, starts, finishes, sides;
+	uint8_t changes; // ticks on which the keys differed from the tick before
+	struct MatchEvents last; // the newest hit's speed and point's details
+};
+
+// One broadcast state. The scene is drawn from the clocks and the animal seed alone.
+struct SpectateFrame {
+	uint32_t seq;
+	struct MatchState state;
+	uint64_t seed; // of the animal generator
+	struct SpectateEvents events;
+};
+
+struct SpectateViewer {
+	uint32_t address;
+	uint16_t port;
+	double lastSeen;
+	bool acked; // whether ack holds a frame the viewer has decoded
+	uint32_t ack;
+};
+
+struct SpectateServer {
+	int socket;
+	int interval; // in ticks
+	int ticks;
+	uint32_t seq;
+	struct SpectateFrame history[SPECTATE_HISTORY];
+	struct SpectateViewer viewers[SPECTATE_MAX_CLIENTS];
+	int viewerCount;
+	struct SpectateEvents events;
+	unsigned char lastInput[MATCH_PLAYERS]; // of the tick before
+	uint8_t phased;
+	unsigned long long bytes;
+};
+
+struct SpectateClient {
+	int socket;
+	uint32_t address;
+	uint16_t port;
+	double lastSubscribe;
+	struct SpectateFrame history[SPECTATE_HISTORY];
+	bool have;
+	uint32_t latest;
+	struct SpectateEvents played; // as of the newest frame whose events were taken
+	bool playing;
+	unsigned long long bytes, packets, undecodable;
+};
+
+// Returns NULL when the socket can't be opened.
+struct SpectateServer* CreateSpectateServer(int port, int interval);
+void DestroySpectateServer(struct SpectateServer* server);
+// Call once per tick; every interval-th state gets sent, delta-compressed against
+// what each viewer has acknowledged.
+void BroadcastSpectate(struct SpectateServer* server, struct MatchState* state, uint64_t seed, double now);
+// Call with the events of every tick, including the ones that aren't broadcast.
+void NoteSpectateEvents(struct SpectateServer* server, const struct MatchEvents* events);
+
+struct SpectateClient* CreateSpectateClient(const char* host, int port);
+void DestroySpectateClient(struct SpectateClient* client);
+// Returns the newest frame when one arrived since the last call, NULL otherwise.
+struct SpectateFrame* ReceiveSpectate(struct SpectateClient* client, double now);
+// What happened on the server since the frame taken the last time, lost frames included; each kind
+// of event is reported once, with the details of its newest occurrence.
+void TakeSpectateEvents(struct SpectateClient* client, const struct SpectateFrame* frame, struct MatchEvents* events);
+
+#endif
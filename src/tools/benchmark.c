@@ -0,0 +1,381 @@
+/*! \file benchmark.c
+ *  \brief Microbenchmarks of the inner loops of the game, with a baseline to compare against.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../dgz.h"
+#include "../emitters.h"
+#include "../match.h"
+#include "toolcommon.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+#define MAX_SAMPLES 101
+#define MAX_BENCHMARKS 32
+#define SWEEP 720 // steps of every time and angle sweep
+#define DAY_SEED 0x6E6F77616E647468ull
+#define SWARM 4096 // particles
+
+struct Context {
+	struct PathGraph park, stressPark;
+	struct DgzDay day, denseDay, stressDay;
+	struct AnimalPose* poses;
+	struct AnimalPose* unsorted[SWEEP];
+	unsigned int unsortedCount[SWEEP];
+	struct MatchState match;
+	struct Particle* particles;
+	struct ParticlePose* particlePoses;
+};
+
+struct Benchmark {
+	const char* name;
+	// runs the operation the given number of times and returns something that depends on the results
+	uint64_t (*run)(struct Context* ctx, const void* arg, long iterations);
+	const void* arg;
+};
+
+struct Result {
+	double median, mean, deviation, min; // ns/op
+};
+
+static volatile uint64_t sink;
+
+static const struct DgzParams sparseParams = {.ticksPerAnimal = 32, .benchingTime = 32, .minBenchingTime = 5, .nightSuppression = 0.5, .density = 1};
+static const struct DgzParams denseParams = {.ticksPerAnimal = 4, .benchingTime = 32, .minBenchingTime = 5, .nightSuppression = 0.5, .density = 1};
+static const struct DgzParams crowdParams = {.ticksPerAnimal = 1, .benchingTime = 32, .minBenchingTime = 5, .nightSuppression = 0.5, .density = 1};
+// about 100k visitors over a 4x4 grid of parks, like the game's crowd stress mode
+static const struct DgzParams stressParams = {.ticksPerAnimal = 16, .benchingTime = 32, .minBenchingTime = 5, .nightSuppression = 0.5, .density = 1280};
+
+static uint64_t RunDGZ(struct Context* ctx, const void* arg, long iterations) {
+	uint64_t result = 0;
+	const struct PathGraph* graph = (arg == &stressParams) ? &ctx->stressPark : &ctx->park;
+	for (long i = 0; i < iterations; i++) {
+		// cycle through a fixed set of days, so that every run does the same work
+		struct DgzDay day;
+		DGZ(graph, arg, DAY_SEED + (i % 16), &day);
+		result += day.count;
+		FreeDgzDay(&day);
+	}
+	return result;
+}
+
+static uint64_t RunPose(struct Context* ctx, const void* arg, long iterations) {
+	const struct DgzDay* day = arg;
+	uint64_t result = 0;
+	for (long i = 0; i < iterations; i++) {
+		result += PoseAnimals(day, (i % SWEEP) / (double)SWEEP, ctx->poses);
+	}
+	return result;
+}
+
+// a day-long cloud of bees crossing the screen in every direction
+static const struct Emitter swarmEmitter = {
+	.trajectory = TRAJECTORY_WAVE,
+	.count = SWARM,
+	.start = 0,
+	.end = 1,
+	.x = 960,
+	.y = 540,
+	.spreadX = 960,
+	.spreadY = 540,
+	.spreadVX = 200000,
+	.spreadVY = 100000,
+	.spin = 0,
+	.wobble = 1 / 6.0,
+	.wobbleSpeed = 12000,
+	.wave = 40,
+	.waveSpeed = 3000,
+	.frameRate = 20000,
+	.scatter = true,
+	.radius = 260,
+	.seed = DAY_SEED,
+};
+
+static uint64_t RunParticles(struct Context* ctx, const void* arg, long iterations) {
+	(void)arg;
+	uint64_t result = 0;
+	for (long i = 0; i < iterations; i++) {
+		result += PoseParticles(ctx->particles, SWARM, (i % SWEEP) / (double)SWEEP, ctx->particlePoses);
+	}
+	return result;
+}
+
+static uint64_t RunSeek(struct Context* ctx, const void* arg, long iterations) {
+	(void)ctx;
+	const struct DgzDay* day = arg;
+	uint64_t result = 0;
+	struct AnimalPose pose;
+	for (long i = 0; i < iterations; i++) {
+		// jumping around the day, like rewinding does
+		const struct Trajectory* trajectory = &day->trajectories[i % day->trajectoriesCount];
+		result += PoseTrajectory(day, trajectory, ((i * 97) % SWEEP) / (double)SWEEP, &pose);
+	}
+	return result;
+}
+
+static uint64_t RunSort(struct Context* ctx, const void* arg, long iterations) {
+	(void)arg;
+	uint64_t result = 0;
+	for (long i = 0; i < iterations; i++) {
+		int step = i % SWEEP;
+		// sorting happens in place, so it has to start from the scan order every time
+		memcpy(ctx->poses, ctx->unsorted[step], ctx->unsortedCount[step] * sizeof(struct AnimalPose));
+		SortAnimalPoses(ctx->poses, ctx->unsortedCount[step]);
+		result += ctx->unsortedCount[step] ? ctx->poses[0].animal->id : 0;
+	}
+	return result;
+}
+
+static uint64_t RunCollision(struct Context* ctx, const void* arg, long iterations) {
+	(void)arg;
+	// ball spots around the right clock: touching the long hand, the short one, and out of reach
+	static const float spots[][2] = {{1760, 820}, {1700, 960}, {1560, 700}, {1400, 879}};
+	uint64_t result = 0;
+	struct MatchEvents events;
+	for (long i = 0; i < iterations; i++) {
+		struct MatchState* match = &ctx->match;
+		match->cooldown = 0;
+		match->ballx = spots[i % 4][0];
+		match->bally = spots[i % 4][1];
+		match->dx = 12;
+		match->dy = 4;
+		double angle = ((i / 4) % SWEEP) * 2 * M_PI / SWEEP;
+		result += CheckCollision(match, &DefaultMatchRules, &events, 1672, 879, (i & 1) ? 138 : 115, angle, 0.5);
+	}
+	return result;
+}
+
+static uint64_t RunNightValue(struct Context* ctx, const void* arg, long iterations) {
+	(void)ctx;
+	(void)arg;
+	double result = 0;
+	for (long i = 0; i < iterations; i++) {
+		result += NightValue((i % (SWEEP * 8)) / (double)(SWEEP * 8));
+	}
+	return result * 1000;
+}
+
+static struct Result Measure(struct Context* ctx, const struct Benchmark* benchmark, int samples, double sampleTime) {
+	// find out how many iterations fill a sample, which also warms up the caches
+	long iterations = 1;
+	for (;;) {
+		double start = Now();
+		sink += benchmark->run(ctx, benchmark->arg, iterations);
+		double elapsed = Now() - start;
+		if (elapsed >= sampleTime) {
+			break;
+		}
+		iterations = (elapsed > sampleTime / 100) ? iterations * sampleTime / elapsed * 1.1 : iterations * 10;
+	}
+
+	double times[MAX_SAMPLES];
+	struct Result result = {.min = INFINITY};
+	for (int i = 0; i < samples; i++) {
+		double start = Now();
+		sink += benchmark->run(ctx, benchmark->arg, iterations);
+		times[i] = (Now() - start) * 1000000000.0 / iterations;
+		result.mean += times[i] / samples;
+		result.min = fmin(result.min, times[i]);
+	}
+	for (int i = 0; i < samples; i++) {
+		result.deviation += pow(times[i] - result.mean, 2) / samples;
+	}
+	result.deviation = sqrt(result.deviation);
+	qsort(times, samples, sizeof(double), CompareDoubles);
+	result.median = times[samples / 2];
+	return result;
+}
+
+// Lines of "name ns/op"; anything after a # is a comment.
+static double LookupBaseline(FILE* file, const char* name) {
+	char line[256];
+	rewind(file);
+	while (fgets(line, sizeof(line), file)) {
+		char key[128];
+		double value;
+		if ((line[0] != '#') && (sscanf(line, "%127s %lf", key, &value) == 2) && (strcmp(key, name) == 0)) {
+			return value;
+		}
+	}
+	return 0;
+}
+
+static void Usage(const char* name) {
+	fprintf(stderr, "usage: %s [options] [FILTER]\n"
+									"  --baseline FILE    compare with the results stored in FILE\n"
+									"  --save FILE        store the results in FILE\n"
+									"  --threshold PCT    slowdown that counts as a regression (10)\n"
+									"  --samples N        samples per benchmark (15)\n"
+									"  --sample-ms MS     length of a sample (20)\n"
+									"Only benchmarks whose name contains FILTER are run.\n",
+		name);
+}
+
+int main(int argc, char** argv) {
+	const char *baselinePath = NULL, *savePath = NULL, *filter = NULL;
+	double threshold = 10, sampleTime = 0.02;
+	int samples = 15;
+	for (int i = 1; i < argc; i++) {
+		const char* value = (i + 1 < argc) ? argv[i + 1] : NULL;
+		if (strncmp(argv[i], "--", 2) != 0) {
+			filter = argv[i];
+			continue;
+		}
+		if (!value) {
+			Usage(argv[0]);
+			return 1;
+		}
+		if (strcmp(argv[i], "--baseline") == 0) {
+			baselinePath = value;
+		} else if (strcmp(argv[i], "--save") == 0) {
+			savePath = value;
+		} else if (strcmp(argv[i], "--threshold") == 0) {
+			threshold = atof(value);
+		} else if (strcmp(argv[i], "--samples") == 0) {
+			samples = atoi(value);
+		} else if (strcmp(argv[i], "--sample-ms") == 0) {
+			sampleTime = atof(value) / 1000.0;
+		} else {
+			Usage(argv[0]);
+			return 1;
+		}
+		i++;
+	}
+	if ((samples < 1) || (samples > MAX_SAMPLES) || (sampleTime <= 0)) {
+		Usage(argv[0]);
+		return 1;
+	}
+
+	FILE* baseline = NULL;
+	if (baselinePath) {
+		baseline = fopen(baselinePath, "r");
+		if (!baseline) {
+			fprintf(stderr, "can't read %s\n", baselinePath);
+			return 1;
+		}
+	}
+
+	struct Context* ctx = calloc(1, sizeof(struct Context));
+	CreateDgzPaths(&ctx->park, 1);
+	CreateDgzPaths(&ctx->stressPark, 4);
+	// indexed like in the game; the dense day stays in generation order to keep the sort honest
+	DGZ(&ctx->park, &DefaultDgzParams, DAY_SEED, &ctx->day);
+	IndexDgzDay(&ctx->day);
+	DGZ(&ctx->park, &denseParams, DAY_SEED, &ctx->denseDay);
+	DGZ(&ctx->stressPark, &stressParams, DAY_SEED, &ctx->stressDay);
+	IndexDgzDay(&ctx->stressDay);
+	ctx->poses = malloc(ctx->stressDay.count * sizeof(struct AnimalPose));
+	for (int i = 0; i < SWEEP; i++) {
+		ctx->unsortedCount[i] = PoseAnimals(&ctx->denseDay, i / (double)SWEEP, ctx->poses);
+		ctx->unsorted[i] = malloc((ctx->unsortedCount[i] + 1) * sizeof(struct AnimalPose));
+		memcpy(ctx->unsorted[i], ctx->poses, ctx->unsortedCount[i] * sizeof(struct AnimalPose));
+	}
+	InitMatch(&ctx->match, DAY_SEED);
+	ctx->particles = malloc(SWARM * sizeof(struct Particle));
+	ctx->particlePoses = malloc(SWARM * sizeof(struct ParticlePose));
+	SpawnParticles(&swarmEmitter, 0, ctx->particles);
+
+	const struct Benchmark benchmarks[] = {
+		{"dgz/sparse", RunDGZ, &sparseParams},
+		{"dgz/default", RunDGZ, &DefaultDgzParams},
+		{"dgz/dense", RunDGZ, &denseParams},
+		{"dgz/crowd", RunDGZ, &crowdParams},
+		{"dgz/stress", RunDGZ, &stressParams},
+		{"scan/default", RunPose, &ctx->day},
+		{"scan/dense", RunPose, &ctx->denseDay},
+		{"scan/stress", RunPose, &ctx->stressDay},
+		{"seek/stress", RunSeek, &ctx->stressDay},
+		{"sort/dense", RunSort, NULL},
+		{"particles/swarm", RunParticles, NULL},
+		{"collision/sweep", RunCollision, NULL},
+		{"nightvalue", RunNightValue, NULL},
+	};
+
+	printf("day %u animal walks, dense day %u, stress day %u\n", ctx->day.count, ctx->denseDay.count, ctx->stressDay.count);
+	printf("%-16s %12s %8s %12s", "benchmark", "ns/op", "stddev", "min");
+	if (baseline) {
+		printf(" %12s %8s", "baseline", "change");
+	}
+	printf("\n");
+
+	struct {
+		const char* name;
+		double median;
+	} saved[MAX_BENCHMARKS];
+	int savedCount = 0, regressions = 0;
+	for (size_t i = 0; i < sizeof(benchmarks) / sizeof(benchmarks[0]); i++) {
+		if (filter && !strstr(benchmarks[i].name, filter)) {
+			continue;
+		}
+		struct Result result = Measure(ctx, &benchmarks[i], samples, sampleTime);
+		printf("%-16s %12.1f %7.1f%% %12.1f", benchmarks[i].name, result.median, result.deviation * 100 / result.mean, result.min);
+		if (baseline) {
+			double base = LookupBaseline(baseline, benchmarks[i].name);
+			if (base > 0) {
+				double change = (result.median - base) * 100 / base;
+				bool regressed = change > threshold;
+				regressions += regressed;
+				printf(" %12.1f %+7.1f%%%s", base, change, regressed ? "  REGRESSION" : "");
+			} else {
+				printf(" %12s", "-");
+			}
+		}
+		printf("\n");
+		saved[savedCount].name = benchmarks[i].name;
+		saved[savedCount++].median = result.median;
+	}
+
+	if (savePath) {
+		FILE* file = fopen(savePath, "w");
+		if (file) {
+			fprintf(file, "# median ns/op, from %d samples of %.0f ms\n", samples, sampleTime * 1000);
+			for (int i = 0; i < savedCount; i++) {
+				fprintf(file, "%s %.3f\n", saved[i].name, saved[i].median);
+			}
+			fclose(file);
+		} else {
+			fprintf(stderr, "can't write %s\n", savePath);
+		}
+	}
+	if (regressions) {
+		printf("%d benchmark(s) more than %.0f%% slower than the baseline\n", regressions, threshold);
+	}
+
+	if (baseline) {
+		fclose(baseline);
+	}
+	for (int i = 0; i < SWEEP; i++) {
+		free(ctx->unsorted[i]);
+	}
+	free(ctx->poses);
+	free(ctx->particles);
+	free(ctx->particlePoses);
+	FreeDgzDay(&ctx->day);
+	FreeDgzDay(&ctx->denseDay);
+	FreeDgzDay(&ctx->stressDay);
+	DestroyDgzPaths(&ctx->park);
+	DestroyDgzPaths(&ctx->stressPark);
+	free(ctx);
+	return regressions ? 2 : 0;
+}
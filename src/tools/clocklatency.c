@@ -0,0 +1,176 @@
+/*! \file clocklatency.c
+ *  \brief How far behind the key presses the clock hands are, with and without sub-tick timestamps.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../match.h"
+#include "toolcommon.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TICK_MS (1000.0 / 60)
+#define HOLD_TICKS 60 // long enough for the fade to get to 1 before the release
+#define MEASURED_TICKS 10 // after every press and release
+#define TAP_TICKS 40 // long enough for the fade to get back to 0 after a tap
+
+struct Options {
+	int presses;
+	uint64_t seed;
+};
+
+struct Samples {
+	double* values; // ms
+	int count;
+};
+
+// How far the hand went by itself since the given tick, in ticks at full fade.
+static double Wound(const struct MatchState* match, double start, int ticks) {
+	return (match->time[0] - start - ticks * MATCH_BASE_RATE) / MATCH_WIND_RATE;
+}
+
+// Presses a key at the given phase of a tick, holds it and releases it at another one. Each tick, the
+// hand is compared with one that reacted at exactly the moment of the key event: the latency is how
+// much later it would have had to start (or stop) turning to be where the match put it.
+static void Measure(uint64_t seed, float pressPhase, float releasePhase, bool timestamps, struct Samples* press, struct Samples* release, struct Samples* motion) {
+	struct MatchState match;
+	InitMatch(&match, seed);
+	struct MatchEvents events;
+	unsigned char held[MATCH_PLAYERS] = {INPUT_FORWARD, 0}, idle[MATCH_PLAYERS] = {0, 0};
+	struct InputPhases phases[MATCH_PLAYERS] = {{.pressed = timestamps ? pressPhase : 0, .held = INPUT_FORWARD}}, none[MATCH_PLAYERS] = {{0}};
+
+	double start = match.time[0];
+	bool moved = false;
+	for (int tick = 0; tick < HOLD_TICKS; tick++) {
+		StepMatchWithPhases(&match, &DefaultMatchRules, held, tick ? none : phases, &events);
+		double elapsed = tick + 1 - pressPhase; // ticks since the press
+		double wound = Wound(&match, start, tick + 1);
+		if (!moved && (wound > 0)) {
+			motion->values[motion->count++] = elapsed * TICK_MS;
+			moved = true;
+		}
+		if (tick < MEASURED_TICKS) {
+			// the fade ramps up linearly, so the ideal hand went MATCH_FADE_IN * t^2 / 2
+			double equivalent = sqrt(fmax(wound, 0) * 2 / MATCH_FADE_IN);
+			press->values[press->count++] = (elapsed - equivalent) * TICK_MS;
+		}
+	}
+
+	// the fade is full by now, so until the release the hand goes 1 per tick
+	start = match.time[0];
+	phases[0] = (struct InputPhases){.released = timestamps ? releasePhase : 0};
+	for (int tick = 0; tick < MEASURED_TICKS; tick++) {
+		StepMatchWithPhases(&match, &DefaultMatchRules, idle, tick ? none : phases, &events);
+		double elapsed = tick + 1 - releasePhase; // ticks since the release
+		double coasted = Wound(&match, start, tick + 1) - releasePhase;
+		// the ideal hand coasted t - MATCH_FADE_OUT * t^2 / 2 since the release
+		double equivalent = (1 - sqrt(fmax(1 - 2 * MATCH_FADE_OUT * coasted, 0))) / MATCH_FADE_OUT;
+		release->values[release->count++] = (equivalent - elapsed) * TICK_MS;
+	}
+}
+
+// Taps a key within a single tick and tells how much longer or shorter it wound the clock for than it was held.
+static void MeasureTap(uint64_t seed, float pressPhase, float releasePhase, bool timestamps, struct Samples* tap) {
+	struct MatchState match;
+	InitMatch(&match, seed);
+	struct MatchEvents events;
+	// the inputs count a tap as held for the tick, and only the phases tell it apart
+	unsigned char tapped[MATCH_PLAYERS] = {INPUT_FORWARD, 0}, idle[MATCH_PLAYERS] = {0, 0};
+	struct InputPhases phases[MATCH_PLAYERS] = {{.pressed = timestamps ? pressPhase : 0, .released = timestamps ? releasePhase : 0}}, none[MATCH_PLAYERS] = {{0}};
+
+	double start = match.time[0];
+	StepMatchWithPhases(&match, &DefaultMatchRules, tapped, phases, &events);
+	for (int tick = 1; tick < TAP_TICKS; tick++) {
+		StepMatchWithPhases(&match, &DefaultMatchRules, idle, none, &events);
+	}
+	// held for h, the fade got to MATCH_FADE_IN * h and then went back down, which winds MATCH_FADE_IN * h^2 / 2 and then MATCH_FADE_IN^2 * h^2 / MATCH_FADE_OUT / 2
+	double wound = Wound(&match, start, TAP_TICKS);
+	double equivalent = sqrt(fmax(wound, 0) * 2 / (MATCH_FADE_IN + MATCH_FADE_IN * MATCH_FADE_IN / MATCH_FADE_OUT));
+	tap->values[tap->count++] = (equivalent - (releasePhase - pressPhase)) * TICK_MS;
+}
+
+static void PrintSamples(const char* name, struct Samples* samples) {
+	qsort(samples->values, samples->count, sizeof(double), CompareDoubles);
+	double sum = 0;
+	for (int i = 0; i < samples->count; i++) {
+		sum += samples->values[i];
+	}
+	int n = samples->count;
+	printf("  %-22s mean %6.2f ms, p1 %6.2f, p50 %6.2f, p99 %6.2f ms, spread %5.2f ms\n", name, sum / n,
+		samples->values[n / 100], samples->values[n / 2], samples->values[(n * 99) / 100], samples->values[n - 1] - samples->values[0]);
+}
+
+static void Usage(const char* name) {
+	fprintf(stderr, "Usage: %s [options]\n"
+									"Presses and releases a clock key at random moments within a tick and reports how far\n"
+									"behind those moments the hand reacts, and how long a tap between two of them winds it\n"
+									"for, with the event timestamps ignored and used.\n"
+									"  --presses N        number of presses (10000)\n"
+									"  --seed N           seed of the moments (1)\n",
+		name);
+}
+
+int main(int argc, char** argv) {
+	struct Options options = {.presses = 10000, .seed = 1};
+	for (int i = 1; i < argc; i++) {
+		const char* value = (i + 1 < argc) ? argv[i + 1] : NULL;
+		if (!value) {
+			Usage(argv[0]);
+			return 1;
+		}
+		if (strcmp(argv[i], "--presses") == 0) {
+			options.presses = strtol(value, NULL, 10);
+		} else if (strcmp(argv[i], "--seed") == 0) {
+			options.seed = strtoull(value, NULL, 10);
+		} else {
+			Usage(argv[0]);
+			return 1;
+		}
+		i++;
+	}
+	if (options.presses <= 0) {
+		Usage(argv[0]);
+		return 1;
+	}
+
+	for (int timestamps = 0; timestamps < 2; timestamps++) {
+		struct Samples press = {calloc(options.presses * MEASURED_TICKS, sizeof(double)), 0};
+		struct Samples release = {calloc(options.presses * MEASURED_TICKS, sizeof(double)), 0};
+		struct Samples motion = {calloc(options.presses, sizeof(double)), 0};
+		struct Samples tap = {calloc(options.presses, sizeof(double)), 0};
+		// the same moments both times
+		uint64_t rng = options.seed;
+		for (int i = 0; i < options.presses; i++) {
+			float pressPhase = SplitMix(&rng) / 4294967296.0;
+			float releasePhase = SplitMix(&rng) / 4294967296.0;
+			Measure(options.seed + i, pressPhase, releasePhase, timestamps, &press, &release, &motion);
+			MeasureTap(options.seed + i, fminf(pressPhase, releasePhase), fmaxf(pressPhase, releasePhase), timestamps, &tap);
+		}
+		printf("%s: %d presses\n", timestamps ? "with timestamps" : "timestamps ignored", options.presses);
+		PrintSamples("press to hand", &press);
+		PrintSamples("release to hand", &release);
+		PrintSamples("press to first motion", &motion);
+		PrintSamples("tap within a tick", &tap);
+		free(press.values);
+		free(release.values);
+		free(motion.values);
+		free(tap.values);
+	}
+	return 0;
+}
@@ -0,0 +1,322 @@
+/*! \file crowd.c
+ *  \brief Generates many DGZ days in parallel and reports what the crowd looks like.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../dgz.h"
+#include "../match.h"
+#include "toolcommon.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define HOURS 24
+#define CLOSE_TICKS 2 // closer than that, two animals overlap
+
+struct Options {
+	struct DgzParams params;
+	int days;
+	int tiles;
+	struct ToolOptions tool;
+};
+
+// Only whole numbers, so adding the days up gives the same totals in any order.
+struct DayStats {
+	int entries; // walks along a single path
+	int animals;
+	int arrivals[HOURS];
+	int present[HOURS]; // animal-ticks
+	int pathTicks[DGZ_PATHS][HOURS];
+	int benchAny, benchFull, benchCenter; // ticks
+	int overtakes, closeCalls; // between walks that follow each other along a path
+	uint64_t hash; // of everything that was generated
+	double ms;
+};
+
+struct Jobs {
+	const struct Options* options;
+	const struct PathGraph* graph;
+	struct DayStats* stats;
+};
+
+static uint64_t Mix(uint64_t hash, uint64_t value) {
+	hash ^= value + 0x9E3779B97F4A7C15ull + (hash << 6) + (hash >> 2);
+	return hash;
+}
+
+// By path and direction, then in the order they start walking.
+static int CompareLanes(const void* a, const void* b) {
+	const struct Animal* first = *(const struct Animal* const*)a;
+	const struct Animal* second = *(const struct Animal* const*)b;
+	int ret = (int)(first->path->index * 2 + first->reverse) - (int)(second->path->index * 2 + second->reverse);
+	if (ret == 0) {
+		ret = first->time.depart - second->time.depart;
+	}
+	if (ret == 0) {
+		ret = first->time.despawn - second->time.despawn;
+	}
+	return ret;
+}
+
+// Walks at a constant speed, so two of them along the same path are the closest at its ends.
+static void MeasureSpacing(const struct DgzDay* day, struct DayStats* stats) {
+	const struct Animal** walks = malloc((day->count + 1) * sizeof(struct Animal*));
+	unsigned int count = 0;
+	for (unsigned int i = 0; i < day->count; i++) {
+		const struct Animal* animal = &day->animals[i];
+		if ((animal->state == ANIMAL_WALKING) && (animal->time.despawn > animal->time.spawn)) {
+			walks[count++] = animal;
+		}
+	}
+	qsort(walks, count, sizeof(struct Animal*), CompareLanes);
+	for (unsigned int i = 1; i < count; i++) {
+		const struct Animal *ahead = walks[i - 1], *behind = walks[i];
+		if ((ahead->path != behind->path) || (ahead->reverse != behind->reverse)) {
+			continue;
+		}
+		int start = behind->time.depart - ahead->time.depart;
+		int end = behind->time.despawn - ahead->time.despawn;
+		if (end < 0) {
+			stats->overtakes++;
+		} else if ((start < CLOSE_TICKS) || (end < CLOSE_TICKS)) {
+			stats->closeCalls++;
+		}
+	}
+	free(walks);
+}
+
+static void MeasureDay(const struct DgzDay* day, struct DayStats* stats) {
+	// animals keep walking after midnight; that's the next morning of the looping day
+	unsigned char bench[TICKS_PER_DAY] = {0};
+	bool* seen = calloc(day->count + 1, sizeof(bool));
+
+	for (unsigned int i = 0; i < day->count; i++) {
+		const struct Animal* animal = &day->animals[i];
+		if ((animal->id >= 0) && ((unsigned int)animal->id <= day->count) && !seen[animal->id]) {
+			seen[animal->id] = true;
+			stats->animals++;
+			stats->arrivals[(animal->time.spawn % TICKS_PER_DAY) / 60]++;
+		}
+		int path = animal->path->index % DGZ_PATHS; // all the copies of the park together
+		for (int tick = animal->time.spawn; tick < animal->time.despawn; tick++) {
+			int hour = (tick % TICKS_PER_DAY) / 60;
+			stats->present[hour]++;
+			stats->pathTicks[path][hour]++;
+			if (animal->state != ANIMAL_WALKING) {
+				bench[tick % TICKS_PER_DAY] |= 1 << animal->state;
+			}
+		}
+		stats->hash = Mix(stats->hash, ((uint64_t)animal->time.spawn << 32) | (uint32_t)animal->time.despawn);
+		stats->hash = Mix(stats->hash, (uint32_t)animal->time.depart);
+		stats->hash = Mix(stats->hash, ((uint64_t)animal->id << 16) | (animal->path->index << 8) | (animal->type << 4) | (animal->state << 1) | animal->reverse);
+	}
+	stats->entries = day->count;
+
+	for (int tick = 0; tick < TICKS_PER_DAY; tick++) {
+		bool left = bench[tick] & ((1 << ANIMAL_BENCH_LEFT) | (1 << ANIMAL_BENCH_CENTER));
+		bool right = bench[tick] & ((1 << ANIMAL_BENCH_RIGHT) | (1 << ANIMAL_BENCH_CENTER));
+		stats->benchAny += left || right;
+		stats->benchFull += left && right;
+		stats->benchCenter += (bench[tick] & (1 << ANIMAL_BENCH_CENTER)) ? 1 : 0;
+	}
+	free(seen);
+	MeasureSpacing(day, stats);
+}
+
+static void Work(void* context, int i) {
+	struct Jobs* jobs = context;
+	// every day gets its own seed, so it doesn't matter which thread generates it
+	uint64_t key = jobs->options->tool.seed + i;
+	uint64_t seed = SplitMix(&key) | ((uint64_t)SplitMix(&key) << 32);
+
+	struct DgzDay day;
+	double start = Now();
+	DGZ(jobs->graph, &jobs->options->params, seed, &day);
+	jobs->stats[i].ms = (Now() - start) * 1000;
+
+	MeasureDay(&day, &jobs->stats[i]);
+	FreeDgzDay(&day);
+}
+
+static void PrintHeatMap(const struct DayStats* total, int days) {
+	static const char shades[] = " .:-=+*#%@";
+	int max = 1;
+	for (int i = 0; i < DGZ_PATHS; i++) {
+		for (int h = 0; h < HOURS; h++) {
+			if (total->pathTicks[i][h] > max) {
+				max = total->pathTicks[i][h];
+			}
+		}
+	}
+	printf("path heat map (animal-minutes per hour, darkest is %.1f per day)\n", max / (double)days);
+	printf("        0     6     12    18    24\n");
+	for (int i = 0; i < DGZ_PATHS; i++) {
+		char row[HOURS + 1];
+		for (int h = 0; h < HOURS; h++) {
+			row[h] = shades[(int)((total->pathTicks[i][h] / (double)max) * (sizeof(shades) - 2) + 0.5)];
+		}
+		row[HOURS] = '\0';
+		printf("path %2d |%s|\n", i, row);
+	}
+}
+
+static void WriteCsv(const struct Options* options, const struct DayStats* total) {
+	FILE* file = fopen(options->tool.csv, "w");
+	if (!file) {
+		fprintf(stderr, "can't write %s\n", options->tool.csv);
+		return;
+	}
+	// per hour, averaged over all days
+	fprintf(file, "hour,arrivals,present");
+	for (int i = 0; i < DGZ_PATHS; i++) {
+		fprintf(file, ",path_%d", i);
+	}
+	fprintf(file, "\n");
+	for (int h = 0; h < HOURS; h++) {
+		fprintf(file, "%d,%.3f,%.3f", h, total->arrivals[h] / (double)options->days, total->present[h] / 60.0 / options->days);
+		for (int i = 0; i < DGZ_PATHS; i++) {
+			fprintf(file, ",%.3f", total->pathTicks[i][h] / 60.0 / options->days);
+		}
+		fprintf(file, "\n");
+	}
+	fclose(file);
+}
+
+static void Report(const struct Options* options, const struct DayStats* stats, double seconds) {
+	struct DayStats total = {0};
+	double* ms = malloc(options->days * sizeof(double));
+	// summed in day order, so the hash comes out the same for any thread count
+	for (int d = 0; d < options->days; d++) {
+		total.entries += stats[d].entries;
+		total.animals += stats[d].animals;
+		for (int h = 0; h < HOURS; h++) {
+			total.arrivals[h] += stats[d].arrivals[h];
+			total.present[h] += stats[d].present[h];
+			for (int i = 0; i < DGZ_PATHS; i++) {
+				total.pathTicks[i][h] += stats[d].pathTicks[i][h];
+			}
+		}
+		total.benchAny += stats[d].benchAny;
+		total.benchFull += stats[d].benchFull;
+		total.benchCenter += stats[d].benchCenter;
+		total.overtakes += stats[d].overtakes;
+		total.closeCalls += stats[d].closeCalls;
+		total.hash = Mix(total.hash, stats[d].hash);
+		total.ms += stats[d].ms;
+		ms[d] = stats[d].ms;
+	}
+	qsort(ms, options->days, sizeof(double), CompareDoubles);
+
+	double days = options->days;
+	printf("%d days in %.2f s on %d threads: %.1f days/s/core, result %016llx\n", options->days, seconds, options->tool.threads, days / seconds / UsedCores(&options->tool), (unsigned long long)total.hash);
+	printf("generation: avg %.3f ms, p50 %.3f ms, p99 %.3f ms per day\n", total.ms / days, ms[options->days / 2], ms[(int)(options->days * 0.99)]);
+	printf("%.1f animals and %.1f walks per day\n", total.animals / days, total.entries / days);
+	printf("bench taken %.1f%% of the day, full %.1f%%, hogged by one animal %.1f%%\n", total.benchAny * 100.0 / days / TICKS_PER_DAY,
+		total.benchFull * 100.0 / days / TICKS_PER_DAY, total.benchCenter * 100.0 / days / TICKS_PER_DAY);
+	printf("following each other along a path: %.1f overtaking, %.1f closer than %d ticks per day\n", total.overtakes / days, total.closeCalls / days, CLOSE_TICKS);
+	printf("hour      ");
+	for (int h = 0; h < HOURS; h++) {
+		printf("%5d", h);
+	}
+	printf("\narrivals  ");
+	for (int h = 0; h < HOURS; h++) {
+		printf("%5.1f", total.arrivals[h] / days);
+	}
+	printf("\non screen ");
+	for (int h = 0; h < HOURS; h++) {
+		printf("%5.1f", total.present[h] / 60.0 / days);
+	}
+	printf("\n");
+	PrintHeatMap(&total, options->days);
+
+	if (options->tool.csv) {
+		WriteCsv(options, &total);
+	}
+	free(ms);
+}
+
+static void Usage(const char* name) {
+	fprintf(stderr, "usage: %s [options]\n"
+									"  --days N                 number of days to generate (1000)\n"
+									"  --threads N              worker threads (all cores)\n"
+									"  --seed N                 day i uses a seed derived from seed + i (1)\n"
+									"  --ticks-per-animal X     average ticks between arrivals (%g)\n"
+									"  --benching-time X        average ticks on the bench (%g)\n"
+									"  --min-benching-time N    (%d)\n"
+									"  --night-suppression X    0..1 (%g)\n"
+									"  --density X              arrivals multiplier (%g)\n"
+									"  --spacing N              ticks between animals on a path, 0 to let them overlap (%d)\n"
+									"  --tiles N                N by N copies of the park, counted together (1)\n"
+									"  --csv FILE               write the hourly averages to FILE\n",
+		name, DefaultDgzParams.ticksPerAnimal, DefaultDgzParams.benchingTime, DefaultDgzParams.minBenchingTime, DefaultDgzParams.nightSuppression, DefaultDgzParams.density, DefaultDgzParams.spacing);
+}
+
+int main(int argc, char** argv) {
+	struct Options options = {
+		.params = DefaultDgzParams,
+		.days = 1000,
+		.tiles = 1,
+	};
+	InitToolOptions(&options.tool);
+	for (int i = 1; i < argc; i++) {
+		const char* value = (i + 1 < argc) ? argv[i + 1] : NULL;
+		if (!value) {
+			Usage(argv[0]);
+			return 1;
+		}
+		if (strcmp(argv[i], "--days") == 0) {
+			options.days = atoi(value);
+		} else if (strcmp(argv[i], "--ticks-per-animal") == 0) {
+			options.params.ticksPerAnimal = atof(value);
+		} else if (strcmp(argv[i], "--benching-time") == 0) {
+			options.params.benchingTime = atof(value);
+		} else if (strcmp(argv[i], "--min-benching-time") == 0) {
+			options.params.minBenchingTime = atoi(value);
+		} else if (strcmp(argv[i], "--night-suppression") == 0) {
+			options.params.nightSuppression = atof(value);
+		} else if (strcmp(argv[i], "--density") == 0) {
+			options.params.density = atof(value);
+		} else if (strcmp(argv[i], "--spacing") == 0) {
+			options.params.spacing = atoi(value);
+		} else if (strcmp(argv[i], "--tiles") == 0) {
+			options.tiles = atoi(value);
+		} else if (!ParseToolOption(&options.tool, argv[i], value)) {
+			Usage(argv[0]);
+			return 1;
+		}
+		i++;
+	}
+	if ((options.days < 1) || !CheckToolOptions(&options.tool) || (options.params.ticksPerAnimal <= 0) || (options.params.benchingTime <= 0) || (options.params.density <= 0) || (options.params.spacing < 0) || (options.tiles < 1)) {
+		Usage(argv[0]);
+		return 1;
+	}
+
+	struct PathGraph graph;
+	CreateDgzPaths(&graph, options.tiles);
+	struct DayStats* stats = calloc(options.days, sizeof(struct DayStats));
+	struct Jobs jobs = {.options = &options, .graph = &graph, .stats = stats};
+	double start = Now();
+	RunJobs(options.days, options.tool.threads, Work, &jobs);
+	double seconds = Now() - start;
+
+	Report(&options, stats, seconds);
+
+	free(stats);
+	DestroyDgzPaths(&graph);
+	return 0;
+}
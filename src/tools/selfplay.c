@@ -0,0 +1,358 @@
+/*! \file selfplay.c
+ *  \brief Headless bot-vs-bot matches in parallel, for balancing the match rules.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../match.h"
+#include "toolcommon.h"
+#include <limits.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_TICKS (60 * 60 * 60) // an hour of play, in case the bots never let the ball drop
+
+static const float clockX[MATCH_PLAYERS] = {223, 1672};
+static const float clockY[MATCH_PLAYERS] = {875, 879};
+
+struct Options {
+	struct MatchRules rules;
+	int matches;
+	struct ToolOptions tool;
+	float skill[MATCH_PLAYERS]; // 0..1
+	const char* label;
+};
+
+// A bot tries each key on a copy of the match and holds the one that works out best.
+// Lower skill thinks less often, looks less far ahead and sometimes picks at random.
+struct Bot {
+	uint64_t rng;
+	float skill;
+	int wait;
+	unsigned char input;
+};
+
+struct MatchResult {
+	int left, right;
+	int ticks;
+	int points;
+	int hits;
+	int longestRally;
+	int serves, servesLeft;
+	float* speeds; // ball speed right after each hit
+	int* rallies; // hits per point
+};
+
+struct Jobs {
+	const struct Options* options;
+	struct MatchResult* results;
+};
+
+// Plays on with a key held on a copy of the match and tells how well that went for the player.
+static int Lookahead(const struct MatchState* match, const struct MatchRules* rules, int player, unsigned char input, int ticks) {
+	struct MatchState copy = *match;
+	struct MatchEvents events;
+	unsigned char inputs[MATCH_PLAYERS];
+	memcpy(inputs, match->lastInput, sizeof(inputs));
+	inputs[player] = input;
+	int value = 0;
+	for (int i = 0; i < ticks; i++) {
+		StepMatchWithRules(&copy, rules, inputs, &events);
+		if (events.flags & EVENT_HIT) {
+			value += 1;
+		}
+		if (events.flags & EVENT_POINT) {
+			return value + ((events.pointLeft == (player == 0)) ? 10 : -10);
+		}
+	}
+	// the ball made it to the other side, so it's going to be their point if it drops
+	return value + ((copy.scoreleft == (player == 0)) ? 3 : 0);
+}
+
+static unsigned char ThinkBot(struct Bot* bot, const struct MatchState* match, const struct MatchRules* rules, int player) {
+	if (bot->wait > 0) {
+		bot->wait--;
+		return bot->input;
+	}
+	bot->wait = (int)((1.0 - bot->skill) * 12) + SplitMix(&bot->rng) % 3;
+
+	double dx = match->ballx - clockX[player], dy = match->bally - clockY[player];
+	bool incoming = player ? (match->dx > 0) : (match->dx < 0);
+
+	if (!match->started) {
+		bot->input = INPUT_START;
+	} else if (incoming && (sqrt(dx * dx + dy * dy) < 600)) {
+		static const unsigned char choices[] = {0, INPUT_FORWARD, INPUT_BACKWARD};
+		int best = INT_MIN;
+		for (int i = 0; i < 3; i++) {
+			int value = Lookahead(match, rules, player, choices[i], 20 + bot->skill * 40);
+			if (value > best) {
+				best = value;
+				bot->input = choices[i];
+			}
+		}
+		if (SplitMix(&bot->rng) / (double)UINT32_MAX > 0.5 + bot->skill / 2) {
+			bot->input = choices[SplitMix(&bot->rng) % 3];
+		}
+	} else {
+		bot->input = 0;
+	}
+	return bot->input;
+}
+
+static int Append(void** array, int count, size_t size) {
+	// grows in powers of two, starting at 16
+	if (!count || ((count >= 16) && !(count & (count - 1)))) {
+		*array = realloc(*array, (count ? count * 2 : 16) * size);
+	}
+	return count;
+}
+
+static void PlayMatch(const struct Options* options, uint64_t seed, struct MatchResult* result) {
+	memset(result, 0, sizeof(struct MatchResult));
+
+	struct MatchState match;
+	InitMatch(&match, SplitMix(&seed) | ((uint64_t)SplitMix(&seed) << 32));
+	struct Bot bots[MATCH_PLAYERS];
+	for (int i = 0; i < MATCH_PLAYERS; i++) {
+		bots[i] = (struct Bot){.rng = SplitMix(&seed) | ((uint64_t)SplitMix(&seed) << 32), .skill = options->skill[i]};
+	}
+
+	int rally = 0;
+	for (result->ticks = 0; result->ticks < MAX_TICKS; result->ticks++) {
+		unsigned char inputs[MATCH_PLAYERS];
+		for (int i = 0; i < MATCH_PLAYERS; i++) {
+			inputs[i] = ThinkBot(&bots[i], &match, &options->rules, i);
+		}
+		struct MatchEvents events;
+		StepMatchWithRules(&match, &options->rules, inputs, &events);
+
+		// the ball is served on the start and again once the point's delay is half over
+		if ((events.flags & EVENT_STARTED) || (match.delay == 60)) {
+			result->serves++;
+			result->servesLeft += match.dx < 0;
+		}
+		if (events.flags & EVENT_HIT) {
+			int i = Append((void**)&result->speeds, result->hits++, sizeof(float));
+			result->speeds[i] = sqrt(match.dx * match.dx + match.dy * match.dy);
+			rally++;
+		}
+		if (events.flags & EVENT_POINT) {
+			int i = Append((void**)&result->rallies, result->points++, sizeof(int));
+			result->rallies[i] = rally;
+			if (rally > result->longestRally) {
+				result->longestRally = rally;
+			}
+			rally = 0;
+		}
+		if (events.flags & EVENT_FINISHED) {
+			result->ticks++;
+			break;
+		}
+	}
+	result->left = match.leftscore;
+	result->right = match.rightscore;
+}
+
+static void Work(void* context, int i) {
+	struct Jobs* jobs = context;
+	PlayMatch(jobs->options, jobs->options->tool.seed + i, &jobs->results[i]);
+}
+
+static int CompareFloat(const void* a, const void* b) {
+	float x = *(const float*)a, y = *(const float*)b;
+	return (x > y) - (x < y);
+}
+
+static int CompareInt(const void* a, const void* b) {
+	return *(const int*)a - *(const int*)b;
+}
+
+static float PercentileFloat(const float* sorted, int count, double p) {
+	return count ? sorted[(int)fmin(count - 1, p * count)] : 0;
+}
+
+static int PercentileInt(const int* sorted, int count, double p) {
+	return count ? sorted[(int)fmin(count - 1, p * count)] : 0;
+}
+
+static void WriteSummary(const struct Options* options, struct MatchResult* results, double seconds) {
+	int hits = 0, points = 0, finished = 0, leftWins = 0, longest = 0, serves = 0, servesLeft = 0;
+	long long ticks = 0;
+	int loserScore[10] = {0};
+	for (int i = 0; i < options->matches; i++) {
+		hits += results[i].hits;
+		points += results[i].points;
+		ticks += results[i].ticks;
+		serves += results[i].serves;
+		servesLeft += results[i].servesLeft;
+		if (results[i].longestRally > longest) {
+			longest = results[i].longestRally;
+		}
+		if ((results[i].left >= 10) || (results[i].right >= 10)) {
+			finished++;
+			leftWins += results[i].left > results[i].right;
+			int loser = (results[i].left < results[i].right) ? results[i].left : results[i].right;
+			loserScore[loser < 10 ? loser : 9]++;
+		}
+	}
+
+	// gathered in match order, so the output doesn't depend on the thread count
+	float* speeds = malloc((hits ? hits : 1) * sizeof(float));
+	int* rallies = malloc((points ? points : 1) * sizeof(int));
+	for (int i = 0, s = 0, r = 0; i < options->matches; i++) {
+		memcpy(speeds + s, results[i].speeds, results[i].hits * sizeof(float));
+		memcpy(rallies + r, results[i].rallies, results[i].points * sizeof(int));
+		s += results[i].hits;
+		r += results[i].points;
+	}
+	qsort(speeds, hits, sizeof(float), CompareFloat);
+	qsort(rallies, points, sizeof(int), CompareInt);
+
+	double matchesPerCore = options->matches / seconds / UsedCores(&options->tool);
+	printf("%d matches (%d finished) in %.2f s on %d threads: %.1f matches/s/core, %.2f Mticks/s\n", options->matches, finished, seconds, options->tool.threads, matchesPerCore, ticks / seconds / 1000000.0);
+	printf("left wins %.1f%%, %.2f hits per point (p50 %d, p90 %d, max %d), %.1f s per match\n", finished ? leftWins * 100.0 / finished : 0.0,
+		points ? hits / (double)points : 0.0, PercentileInt(rallies, points, 0.5), PercentileInt(rallies, points, 0.9), longest, ticks / 60.0 / options->matches);
+	printf("ball speed after a hit: p10 %.1f, p50 %.1f, p90 %.1f, p99 %.1f\n", PercentileFloat(speeds, hits, 0.1), PercentileFloat(speeds, hits, 0.5),
+		PercentileFloat(speeds, hits, 0.9), PercentileFloat(speeds, hits, 0.99));
+	// equally skilled bots that don't split the wins are playing on a lopsided field
+	if (finished && (options->skill[0] == options->skill[1]) && (fabs(leftWins - finished / 2.0) > 3 * sqrt(finished / 4.0))) {
+		fprintf(stderr, "warning: equally skilled bots, yet the left one wins %.1f%% of the matches\n", leftWins * 100.0 / finished);
+	}
+	printf("serves to the left %.1f%% of %d\n", serves ? servesLeft * 100.0 / serves : 0.0, serves);
+	// a fair coin stays within 5 standard deviations of a half
+	if (serves && (fabs(servesLeft - serves / 2.0) > 5 * sqrt(serves / 4.0))) {
+		fprintf(stderr, "warning: the serves don't go both ways evenly\n");
+	}
+
+	if (options->tool.csv) {
+		FILE* file = fopen(options->tool.csv, "r");
+		bool header = !file;
+		if (file) {
+			fclose(file);
+		}
+		file = fopen(options->tool.csv, "a");
+		if (!file) {
+			fprintf(stderr, "can't write %s\n", options->tool.csv);
+		} else {
+			// one row per run, so sweeps over a constant end up as one table
+			if (header) {
+				fprintf(file, "label,seed,matches,finished,bounce_base,bounce_speed,serve_x,serve_y,screenshake,skill_left,skill_right,"
+											"left_win_rate,seconds_per_match,hits_per_point,rally_p50,rally_p90,rally_max,"
+											"speed_p10,speed_p50,speed_p90,speed_p99");
+				for (int i = 0; i < 10; i++) {
+					fprintf(file, ",loser_%d", i);
+				}
+				fprintf(file, ",matches_per_second_per_core\n");
+			}
+			fprintf(file, "%s,%llu,%d,%d,%g,%g,%g,%g,%d,%g,%g,%.4f,%.2f,%.3f,%d,%d,%d,%.2f,%.2f,%.2f,%.2f", options->label, (unsigned long long)options->tool.seed,
+				options->matches, finished, options->rules.bounceBase, options->rules.bounceSpeed, options->rules.serveX, options->rules.serveY,
+				options->rules.screenshake, options->skill[0], options->skill[1], finished ? leftWins / (double)finished : 0.0, ticks / 60.0 / options->matches,
+				points ? hits / (double)points : 0.0, PercentileInt(rallies, points, 0.5), PercentileInt(rallies, points, 0.9), longest,
+				PercentileFloat(speeds, hits, 0.1), PercentileFloat(speeds, hits, 0.5), PercentileFloat(speeds, hits, 0.9), PercentileFloat(speeds, hits, 0.99));
+			for (int i = 0; i < 10; i++) {
+				fprintf(file, ",%d", loserScore[i]);
+			}
+			fprintf(file, ",%.1f\n", matchesPerCore);
+			fclose(file);
+		}
+	}
+
+	free(speeds);
+	free(rallies);
+}
+
+static void Usage(const char* name) {
+	fprintf(stderr, "usage: %s [options]\n"
+									"  --matches N        number of matches (1000)\n"
+									"  --threads N        worker threads (all cores)\n"
+									"  --seed N           seed of the first match, match i uses seed + i (1)\n"
+									"  --bounce-base X    dx multiplier on a hit (%g)\n"
+									"  --bounce-speed X   extra multiplier per hand speed (%g)\n"
+									"  --serve-x X        horizontal serve velocity (%g)\n"
+									"  --serve-y X        vertical serve velocity (%g)\n"
+									"  --screenshake N    shake ticks after a point (%d)\n"
+									"  --skill X          skill of both bots, 0..1 (0.7)\n"
+									"  --skill-left X     skill of the left bot\n"
+									"  --skill-right X    skill of the right bot\n"
+									"  --csv FILE         append a summary row to FILE\n"
+									"  --label TEXT       first column of the CSV row\n",
+		name, DefaultMatchRules.bounceBase, DefaultMatchRules.bounceSpeed, DefaultMatchRules.serveX, DefaultMatchRules.serveY, DefaultMatchRules.screenshake);
+}
+
+int main(int argc, char** argv) {
+	struct Options options = {
+		.rules = DefaultMatchRules,
+		.matches = 1000,
+		.skill = {0.7, 0.7},
+		.label = "",
+	};
+	InitToolOptions(&options.tool);
+	for (int i = 1; i < argc; i++) {
+		const char* value = (i + 1 < argc) ? argv[i + 1] : NULL;
+		if (!value) {
+			Usage(argv[0]);
+			return 1;
+		}
+		if (strcmp(argv[i], "--matches") == 0) {
+			options.matches = atoi(value);
+		} else if (strcmp(argv[i], "--bounce-base") == 0) {
+			options.rules.bounceBase = atof(value);
+		} else if (strcmp(argv[i], "--bounce-speed") == 0) {
+			options.rules.bounceSpeed = atof(value);
+		} else if (strcmp(argv[i], "--serve-x") == 0) {
+			options.rules.serveX = atof(value);
+		} else if (strcmp(argv[i], "--serve-y") == 0) {
+			options.rules.serveY = atof(value);
+		} else if (strcmp(argv[i], "--screenshake") == 0) {
+			options.rules.screenshake = atoi(value);
+		} else if (strcmp(argv[i], "--skill") == 0) {
+			options.skill[0] = options.skill[1] = atof(value);
+		} else if (strcmp(argv[i], "--skill-left") == 0) {
+			options.skill[0] = atof(value);
+		} else if (strcmp(argv[i], "--skill-right") == 0) {
+			options.skill[1] = atof(value);
+		} else if (strcmp(argv[i], "--label") == 0) {
+			options.label = value;
+		} else if (!ParseToolOption(&options.tool, argv[i], value)) {
+			Usage(argv[0]);
+			return 1;
+		}
+		i++;
+	}
+	if ((options.matches < 1) || !CheckToolOptions(&options.tool)) {
+		Usage(argv[0]);
+		return 1;
+	}
+
+	struct MatchResult* results = calloc(options.matches, sizeof(struct MatchResult));
+	struct Jobs jobs = {.options = &options, .results = results};
+	double start = Now();
+	RunJobs(options.matches, options.tool.threads, Work, &jobs);
+	double seconds = Now() - start;
+
+	WriteSummary(&options, results, seconds);
+
+	for (int i = 0; i < options.matches; i++) {
+		free(results[i].speeds);
+		free(results[i].rallies);
+	}
+	free(results);
+	return 0;
+}
@@ -0,0 +1,118 @@
+/*! \file spectator.c
+ *  \brief Headless stand-in spectator that checks a broadcast stream.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../spectate.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+static double Now(void) {
+#ifdef _WIN32
+	return GetTickCount64() / 1000.0;
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+#endif
+}
+
+static void Nap(void) {
+#ifdef _WIN32
+	Sleep(1);
+#else
+	nanosleep(&(struct timespec){.tv_nsec = 1000000}, NULL);
+#endif
+}
+
+static bool SameState(const struct MatchState* a, const struct MatchState* b) {
+	return (a->ballx == b->ballx) && (a->bally == b->bally) && (a->dx == b->dx) && (a->dy == b->dy) && (a->time[0] == b->time[0]) &&
+		(a->time[1] == b->time[1]) && (a->fade[0] == b->fade[0]) && (a->fade[1] == b->fade[1]) && (a->score == b->score) &&
+		(a->leftscore == b->leftscore) && (a->rightscore == b->rightscore) && (a->delay == b->delay) && (a->rng == b->rng);
+}
+
+int main(int argc, char** argv) {
+	if (argc < 2) {
+		fprintf(stderr, "usage: %s HOST [PORT] [SECONDS] [INTERVAL]\n", argv[0]);
+		return 1;
+	}
+	int port = (argc > 2) ? atoi(argv[2]) : 7778;
+	double duration = (argc > 3) ? atof(argv[3]) : 30;
+	int interval = (argc > 4) ? atoi(argv[4]) : 2;
+
+	struct SpectateClient* client = CreateSpectateClient(argv[1], port);
+	if (!client) {
+		fprintf(stderr, "can't connect to %s:%d\n", argv[1], port);
+		return 1;
+	}
+
+	// Between two consecutive frames with no key changes in between, replaying the simulation
+	// locally has to land exactly on the next frame. Where the keys changed, the server moved the
+	// clocks with the phases of the changes, which only it knows.
+	struct SpectateFrame previous;
+	bool havePrevious = false;
+	unsigned int verified = 0, mismatched = 0, skipped = 0, lost = 0;
+	double start = Now(), first = 0;
+	while (Now() - start < duration) {
+		struct SpectateFrame* frame = ReceiveSpectate(client, Now());
+		if (!frame) {
+			Nap();
+			continue;
+		}
+		if (!havePrevious) {
+			first = Now();
+			printf("receiving, animal seed %016llx\n", (unsigned long long)frame->seed);
+		} else {
+			lost += frame->seq - previous.seq - 1;
+			bool sameInput = frame->events.changes == previous.events.changes;
+			if ((frame->seq == previous.seq + 1) && sameInput && !((frame->state.lastInput[0] | frame->state.lastInput[1]) & INPUT_START)) {
+				struct MatchState replay = previous.state;
+				struct MatchEvents events;
+				for (int i = 0; i < interval; i++) {
+					StepMatch(&replay, frame->state.lastInput, &events);
+				}
+				if (SameState(&replay, &frame->state)) {
+					verified++;
+				} else {
+					mismatched++;
+				}
+			} else {
+				skipped++;
+			}
+		}
+		previous = *frame;
+		havePrevious = true;
+	}
+
+	double seconds = havePrevious ? Now() - first : 0;
+	printf("%llu frames, %llu bytes", client->packets, client->bytes);
+	if (seconds > 0) {
+		printf(" (%.0f B/s, %.1f B/frame)", client->bytes / seconds, client->packets ? client->bytes / (double)client->packets : 0.0);
+	}
+	printf("\n%u lost, %llu undecodable\n", lost, client->undecodable);
+	printf("replay check: %u verified, %u mismatched, %u skipped\n", verified, mismatched, skipped);
+	bool failed = mismatched || client->undecodable;
+	DestroySpectateClient(client);
+	return failed ? 2 : 0;
+}
@@ -0,0 +1,108 @@
+/*! \file toolcommon.c
+ *  \brief Timing, option parsing and the worker pool shared by the tools.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "toolcommon.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+struct Worker {
+	void (*run)(void* context, int job);
+	void* context;
+	int count;
+	atomic_int* next;
+	pthread_t thread;
+};
+
+double Now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+}
+
+void InitToolOptions(struct ToolOptions* options) {
+	long cores = sysconf(_SC_NPROCESSORS_ONLN);
+	*options = (struct ToolOptions){
+		.threads = cores > 0 ? cores : 1,
+		.cores = cores > 0 ? cores : 1,
+		.seed = 1,
+	};
+}
+
+bool ParseToolOption(struct ToolOptions* options, const char* name, const char* value) {
+	if (strcmp(name, "--threads") == 0) {
+		options->threads = atoi(value);
+	} else if (strcmp(name, "--seed") == 0) {
+		options->seed = strtoull(value, NULL, 10);
+	} else if (strcmp(name, "--csv") == 0) {
+		options->csv = value;
+	} else {
+		return false;
+	}
+	return true;
+}
+
+bool CheckToolOptions(struct ToolOptions* options) {
+	if (options->threads < 1) {
+		return false;
+	}
+	if (options->threads > TOOL_MAX_THREADS) {
+		options->threads = TOOL_MAX_THREADS;
+	}
+	return true;
+}
+
+int UsedCores(const struct ToolOptions* options) {
+	return options->threads < options->cores ? options->threads : options->cores;
+}
+
+static void* Work(void* arg) {
+	struct Worker* worker = arg;
+	int i;
+	while ((i = atomic_fetch_add(worker->next, 1)) < worker->count) {
+		worker->run(worker->context, i);
+	}
+	return NULL;
+}
+
+void RunJobs(int count, int threads, void (*run)(void* context, int job), void* context) {
+	struct Worker workers[TOOL_MAX_THREADS];
+	atomic_int next = 0;
+	if (threads > TOOL_MAX_THREADS) {
+		threads = TOOL_MAX_THREADS;
+	}
+	int started = 0;
+	for (; started < threads; started++) {
+		workers[started] = (struct Worker){.run = run, .context = context, .count = count, .next = &next};
+		if (pthread_create(&workers[started].thread, NULL, Work, &workers[started])) {
+			fprintf(stderr, "can't start thread %d of %d, doing with fewer\n", started + 1, threads);
+			// the jobs get done even when no thread starts at all
+			Work(&workers[started]);
+			break;
+		}
+	}
+	for (int i = 0; i < started; i++) {
+		pthread_join(workers[i].thread, NULL);
+	}
+}
@@ -0,0 +1,51 @@
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TOOLCOMMON_H
+#define TOOLCOMMON_H
+
+#include "../stats.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+#define TOOL_MAX_THREADS 256
+
+// What the tools that spread their work over threads have in common.
+struct ToolOptions {
+	int threads; // all cores unless --threads says otherwise
+	int cores;
+	uint64_t seed;
+	const char* csv;
+};
+
+// Monotonic, in seconds.
+double Now(void);
+
+void InitToolOptions(struct ToolOptions* options);
+// Takes --threads, --seed and --csv; false for any other name.
+bool ParseToolOption(struct ToolOptions* options, const char* name, const char* value);
+// False when the options make no sense; caps the threads.
+bool CheckToolOptions(struct ToolOptions* options);
+// Oversubscribed threads don't add any cores.
+int UsedCores(const struct ToolOptions* options);
+
+// Calls run for every job from 0 to count on the given number of threads. The jobs are handed out
+// one at a time, so a long one doesn't hold up a whole chunk, and each one has to depend on its index
+// only, so the results don't depend on the thread count.
+void RunJobs(int count, int threads, void (*run)(void* context, int job), void* context);
+
+#endif
@@ -0,0 +1,121 @@
+/*! \file udp.c
+ *  \brief Thin wrapper over platform UDP sockets.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "udp.h"
+#include <string.h>
+
+#ifndef __EMSCRIPTEN__
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+int OpenUdpSocket(int port) {
+#ifdef _WIN32
+	WSADATA wsa;
+	if (WSAStartup(MAKEWORD(2, 2), &wsa)) {
+		return -1;
+	}
+#endif
+	int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	if (sock < 0) {
+		return -1;
+	}
+#ifdef _WIN32
+	u_long nonblocking = 1;
+	ioctlsocket(sock, FIONBIO, &nonblocking);
+#else
+	fcntl(sock, F_SETFL, fcntl(sock, F_GETFL, 0) | O_NONBLOCK);
+#endif
+	struct sockaddr_in addr = {.sin_family = AF_INET, .sin_port = htons(port)};
+	addr.sin_addr.s_addr = htonl(INADDR_ANY);
+	if (bind(sock, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+		CloseUdpSocket(sock);
+		return -1;
+	}
+	return sock;
+}
+
+void CloseUdpSocket(int socket) {
+#ifdef _WIN32
+	closesocket(socket);
+	WSACleanup();
+#else
+	close(socket);
+#endif
+}
+
+bool ResolveUdpAddress(const char* host, int port, uint32_t* address, uint16_t* netport) {
+	struct addrinfo hints = {.ai_family = AF_INET, .ai_socktype = SOCK_DGRAM};
+	struct addrinfo* result = NULL;
+	if (getaddrinfo(host, NULL, &hints, &result) || !result) {
+		return false;
+	}
+	*address = ((struct sockaddr_in*)result->ai_addr)->sin_addr.s_addr;
+	*netport = htons(port);
+	freeaddrinfo(result);
+	return true;
+}
+
+void SendUdp(int socket, uint32_t address, uint16_t port, const void* data, int size) {
+	struct sockaddr_in addr = {.sin_family = AF_INET, .sin_port = port};
+	addr.sin_addr.s_addr = address;
+	sendto(socket, (const char*)data, size, 0, (struct sockaddr*)&addr, sizeof(addr));
+}
+
+int ReceiveUdp(int socket, void* buf, int size, uint32_t* address, uint16_t* port) {
+	struct sockaddr_in from;
+	socklen_t fromSize = sizeof(from);
+	int received = recvfrom(socket, (char*)buf, size, 0, (struct sockaddr*)&from, &fromSize);
+	if (received < 0) {
+		return -1;
+	}
+	*address = from.sin_addr.s_addr;
+	*port = from.sin_port;
+	return received;
+}
+
+#else
+
+int OpenUdpSocket(int port) {
+	return -1;
+}
+
+void CloseUdpSocket(int socket) {}
+
+bool ResolveUdpAddress(const char* host, int port, uint32_t* address, uint16_t* netport) {
+	return false;
+}
+
+void SendUdp(int socket, uint32_t address, uint16_t port, const void* data, int size) {}
+
+int ReceiveUdp(int socket, void* buf, int size, uint32_t* address, uint16_t* port) {
+	return -1;
+}
+
+#endif
@@ -0,0 +1,34 @@
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef UDP_H
+#define UDP_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Minimal non-blocking IPv4 UDP sockets. Addresses and ports are kept in network byte order.
+
+// Pass port 0 to let the system pick one. Returns -1 on failure.
+int OpenUdpSocket(int port);
+void CloseUdpSocket(int socket);
+bool ResolveUdpAddress(const char* host, int port, uint32_t* address, uint16_t* netport);
+void SendUdp(int socket, uint32_t address, uint16_t port, const void* data, int size);
+// Returns the size of a pending datagram, or -1 when there's none.
+int ReceiveUdp(int socket, void* buf, int size, uint32_t* address, uint16_t* port);
+
+#endif